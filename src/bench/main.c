@@ -0,0 +1,1170 @@
+#include <dirent.h>
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "vgmdecompress.h"
+#include "vgmextract.h"
+#include "vgmgzindex.h"
+#include "vgmhash.h"
+#include "vgmpack.h"
+#include "vgmrom.h"
+#include "vgmscan.h"
+#include "vgmzip.h"
+
+// Benchmark of the reader hot paths on a synthetic file. The generator knows every block it
+// wrote, so each run is also checked against it: block count, types, sizes and hashes. Besides
+// plain PCM blocks it writes compressed blocks with their decompression tables and the pieces of
+// a ROM, which the ROM merge stage puts back together, and the files are read from a .zip too.
+
+#define MAX_GZIP_LEVELS 9
+#define GENERATE_CHUNK  (16 * 1024 * 1024)
+
+enum size_distribution { SIZE_FIXED, SIZE_UNIFORM, SIZE_EXPONENTIAL };
+
+struct options {
+    double size_mb;         // size of the generated .vgm
+    size_t block_count;
+    double block_percent;   // share of the file taken by data blocks
+    enum size_distribution distribution;
+    double density;         // probability of a 0x67 byte in command operands and block data
+    int gzip_levels[MAX_GZIP_LEVELS];
+    int gzip_level_count;
+    int repeats;
+    uint64_t seed;
+    const char* work_dir;
+    bool keep;
+    const char* golden;     // file of golden values to check against
+    bool check_speed;       // also check every stage against the minimum MB/s of the golden file
+    const char* new_golden; // file to write the golden values of this run to
+};
+
+static struct options options = { 64, 1024, 75, SIZE_EXPONENTIAL, 0.02, { 1, 6, 9 }, 3, 3, 1, "vgm-bench", false,
+    NULL, false, NULL };
+
+// A block written by the generator, as it is extracted: a compressed block comes out decompressed
+struct expected_block {
+    uint8_t type;
+    uint32_t size;      // data size, header excluded
+    uint64_t hash;
+    uint8_t written_type;   // type in the .vgm
+    uint32_t written_size;  // data size in the .vgm, header excluded
+    uint8_t format;         // compression_formats[] index of a compressed block or table
+    uint32_t rom_start;     // address of a ROM piece
+};
+
+static struct expected_block* expected = NULL;
+// The blocks extracted with merge_roms: the ones that are no ROM pieces, then the ROM image
+static struct expected_block* merged = NULL;
+static size_t merged_count = 0;
+static size_t vgm_size = 0;
+static bool checks_failed = false;
+static bool too_slow = false;
+
+// Stage throughput: the minimum taken from the golden file, or the one measured for a new golden file
+struct stage_rate {
+    char name[32];
+    double mb_s;
+};
+
+#define MAX_STAGE_RATES 64
+
+static struct stage_rate minimum_rates[MAX_STAGE_RATES];
+static size_t minimum_rate_count = 0;
+static struct stage_rate measured_rates[MAX_STAGE_RATES];
+static size_t measured_rate_count = 0;
+
+enum stage_kind {
+    STAGE_SCAN,         // blocks kept in memory
+    STAGE_RECOVERY,     // same, searching every "67 66" pair
+    STAGE_FILES,        // block_N.raw files
+    STAGE_STORE,        // content-addressed store
+    STAGE_PACK,         // pack file
+    STAGE_INFLATE,      // gzread() only, the ceiling for the .vgz stages
+    STAGE_INDEX,        // blocks kept in memory while writing the checkpoint index
+    STAGE_BLOCKS,       // every block read on its own through the index
+    STAGE_MERGE,        // blocks kept in memory, ROM pieces merged into one image
+    STAGE_ZIP,          // blocks kept in memory, from the .vgm and a .vgz in a .zip
+};
+
+static char blocks_dir[4096];
+static char store_dir[4096];
+static char pack_name[4096];
+static char zip_name[4096];
+
+static void usage(const char* name)
+{
+    fprintf(stderr, "Usage: %s [-s size_mb] [-n blocks] [-f block_percent] [-d fixed|uniform|exp] [-x density]\n"
+        "       [-z levels] [-r repeats] [-S seed] [-o work_dir] [-k] [-g golden_file [-t] | -G golden_file]\n"
+        "  -s  size of the generated .vgm in MB (default: 64)\n"
+        "  -n  number of data blocks (default: 1024)\n"
+        "  -f  percentage of the file taken by data blocks (default: 75)\n"
+        "  -d  block size distribution around the mean (default: exp)\n"
+        "  -x  probability of a 0x67 byte in command operands and block data (default: 0.02)\n"
+        "  -z  comma-separated gzip levels of the .vgz variants, 0 for none (default: 1,6,9)\n"
+        "  -r  runs per stage, the fastest is reported (default: 3)\n"
+        "  -S  random seed (default: 1)\n"
+        "  -o  directory for the generated and extracted files (default: vgm-bench)\n"
+        "  -k  keep the files instead of removing them\n"
+        "  -g  check the generated file and blocks against golden_file\n"
+        "  -t  with -g, also check every stage against the minimum MB/s golden_file lists\n"
+        "  -G  write the golden values of this run to golden_file, with a tenth of the\n"
+        "      measured MB/s as minimums\n"
+        "MB/s are of uncompressed VGM data, or of block data when reading single blocks.\n"
+        "Exits with 1 if any run does not extract exactly the generated blocks, if they\n"
+        "differ from golden_file or, with -t, if a stage is slower than its minimum.\n", name);
+}
+
+static bool parse_gzip_levels(const char* arg)
+{
+    options.gzip_level_count = 0;
+    for (const char* p = arg; *p; )
+    {
+        char* end;
+        long level = strtol(p, &end, 10);
+        if (end == p || level < 0 || level > 9) return false;
+        if (level > 0)
+        {
+            if (options.gzip_level_count == MAX_GZIP_LEVELS) return false;
+            options.gzip_levels[options.gzip_level_count++] = (int)level;
+        }
+        p = *end == ',' ? end + 1 : end;
+        if (*end && *end != ',') return false;
+    }
+    return true;
+}
+
+//
+// Generator
+//
+
+static uint64_t rng_state;
+
+// xorshift64*
+static uint64_t next_random(void)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545f4914f6cdd1dULL;
+}
+
+static double next_double(void)
+{
+    return (next_random() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static uint32_t density_threshold;
+
+// Byte with the requested 0x67 density. A 0x67 is never followed by 0x66 in the command
+// stream, so a recovery scan finds the generated blocks and nothing else.
+static uint8_t next_byte(uint8_t previous)
+{
+    uint64_t r = next_random();
+    if ((uint32_t)r < density_threshold) return 0x67;
+    uint8_t byte = (uint8_t)(r >> 32);
+    if (byte == 0x67) byte = 0x68;
+    if (byte == 0x66 && previous == 0x67) byte = 0x65;
+    return byte;
+}
+
+// Block data sample: a random walk like PCM data, so the .vgz variants compress like real files
+static uint8_t next_sample(uint8_t previous)
+{
+    uint64_t r = next_random();
+    if ((uint32_t)r < density_threshold) return 0x67;
+    uint8_t sample = previous + (uint8_t)((r >> 32) % 9) - 4;
+    return sample == 0x67 ? 0x68 : sample;
+}
+
+static void put_u32(uint8_t* ptr, uint32_t value)
+{
+    ptr[0] = value;
+    ptr[1] = value >> 8;
+    ptr[2] = value >> 16;
+    ptr[3] = value >> 24;
+}
+
+static uint32_t next_block_size(double mean)
+{
+    double size;
+    switch (options.distribution)
+    {
+    case SIZE_FIXED: size = mean; break;
+    case SIZE_UNIFORM: size = 1 + next_double() * (2 * mean - 1); break;
+    default: size = -mean * log(1 - next_double()); break;
+    }
+    if (size < 1) size = 1;
+    if (size > 0x7fff0000) size = 0x7fff0000;
+    return (uint32_t)size;
+}
+
+// Chip writes, waits and DAC writes, with one operand byte per entry after the command
+static const uint8_t commands[][2] = {
+    { 0x50, 1 }, { 0x52, 2 }, { 0x53, 2 }, { 0x54, 2 }, { 0x61, 2 }, { 0x62, 0 }, { 0x63, 0 },
+    { 0x70, 0 }, { 0x7f, 0 }, { 0x80, 0 }, { 0x8f, 0 }, { 0xb4, 2 }, { 0xe0, 4 },
+};
+
+static uint8_t* write_commands(uint8_t* ptr, size_t size)
+{
+    uint8_t* end = ptr + size;
+    while (ptr < end)
+    {
+        const uint8_t* command = commands[next_random() % (sizeof(commands) / sizeof(commands[0]))];
+        *ptr++ = command[0];
+        for (int i = 0; i < command[1]; ++i, ++ptr)
+            *ptr = next_byte(ptr[-1]);
+    }
+    return ptr;
+}
+
+// YM2612 PCM, the same compressed, decompression table, YM2610 ADPCM ROM pieces, RF5C68 RAM
+static const uint8_t block_types[] = { 0x00, 0x40, 0x7f, 0x82, 0xc0 };
+
+// Formats of the compressed blocks and tables. A compressed block drawing a format with a table takes
+// the one of the last table written, or one without a table before the first.
+struct compression_format {
+    uint8_t compression;
+    uint8_t sub_type;
+    uint8_t bits_decompressed;
+    uint8_t bits_compressed;
+};
+
+static const struct compression_format compression_formats[] = {
+    { VGM_COMPRESSION_NBIT, VGM_NBIT_COPY, 16, 12 },
+    { VGM_COMPRESSION_NBIT, VGM_NBIT_SHIFT, 16, 12 },
+    { VGM_COMPRESSION_NBIT, VGM_NBIT_COPY, 8, 5 },
+    { VGM_COMPRESSION_NBIT, VGM_NBIT_TABLE, 16, 10 },
+    { VGM_COMPRESSION_DPCM, 0, 8, 4 },
+};
+
+#define FORMAT_COUNT (sizeof(compression_formats) / sizeof(compression_formats[0]))
+#define FIRST_TABLE_FORMAT 3
+
+static uint16_t table_values[1 << 16]; // of the last table written
+
+static uint32_t get_value_size(const struct compression_format* format)
+{
+    return format->bits_decompressed > 8 ? 2 : 1;
+}
+
+static uint32_t get_table_size(const struct compression_format* format)
+{
+    return 6 + (1u << format->bits_compressed) * get_value_size(format);
+}
+
+static uint32_t get_compressed_size(const struct compression_format* format, uint32_t size)
+{
+    uint64_t bits = (uint64_t)(size / get_value_size(format)) * format->bits_compressed;
+    return VGM_COMPRESSED_HEADER_SIZE + (uint32_t)((bits + 7) / 8);
+}
+
+static void put_u16(uint8_t* ptr, uint16_t value)
+{
+    ptr[0] = value;
+    ptr[1] = value >> 8;
+}
+
+// tt ss dd cc nn nn, then a value for every field
+static uint8_t* write_table(uint8_t* ptr, const struct compression_format* format)
+{
+    uint32_t count = 1u << format->bits_compressed;
+    uint16_t mask = (uint16_t)((1u << format->bits_decompressed) - 1);
+    ptr[0] = format->compression;
+    ptr[1] = format->sub_type;
+    ptr[2] = format->bits_decompressed;
+    ptr[3] = format->bits_compressed;
+    put_u16(ptr + 4, (uint16_t)count);
+    ptr += 6;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        table_values[i] = (uint16_t)next_random() & mask;
+        if (get_value_size(format) == 2)
+            put_u16(ptr + 2 * i, table_values[i]);
+        else
+            ptr[i] = (uint8_t)table_values[i];
+    }
+    return ptr + count * get_value_size(format);
+}
+
+// Compression header and random fields packed MSB first, decoded on the side into output
+static uint8_t* write_compressed(uint8_t* ptr, const struct compression_format* format, uint32_t size, uint8_t* output)
+{
+    const unsigned width = format->bits_compressed;
+    const uint32_t value_size = get_value_size(format);
+    const uint16_t mask = (uint16_t)((1u << format->bits_decompressed) - 1);
+    uint16_t add = (uint16_t)next_random();
+    if (format->compression == VGM_COMPRESSION_DPCM) add &= mask;
+
+    ptr[0] = format->compression;
+    put_u32(ptr + 1, size);
+    ptr[5] = format->bits_decompressed;
+    ptr[6] = format->bits_compressed;
+    ptr[7] = format->sub_type;
+    put_u16(ptr + 8, add);
+    ptr += VGM_COMPRESSED_HEADER_SIZE;
+
+    uint64_t bits = 0;
+    unsigned bit_count = 0;
+    uint16_t value = add;
+    for (uint32_t i = 0; i < size / value_size; ++i)
+    {
+        uint32_t field = (uint32_t)next_random() & ((1u << width) - 1);
+        bits = bits << width | field;
+        for (bit_count += width; bit_count >= 8; bit_count -= 8)
+            *ptr++ = (uint8_t)(bits >> (bit_count - 8));
+
+        if (format->compression == VGM_COMPRESSION_DPCM)
+            value = (value + table_values[field]) & mask;
+        else if (format->sub_type == VGM_NBIT_TABLE)
+            value = table_values[field];
+        else if (format->sub_type == VGM_NBIT_SHIFT)
+            value = (uint16_t)((field << (format->bits_decompressed - width)) + add);
+        else
+            value = (uint16_t)(field + add);
+        output[i * value_size] = (uint8_t)value;
+        if (value_size == 2) output[i * value_size + 1] = (uint8_t)(value >> 8);
+    }
+    if (bit_count > 0) *ptr++ = (uint8_t)(bits << (8 - bit_count));
+    return ptr;
+}
+
+static uint8_t* write_block(uint8_t* ptr, struct expected_block* block, uint32_t rom_size, uint8_t* rom)
+{
+    uint32_t header_size = vgm_block_header_size(block->written_type);
+    ptr[0] = 0x67;
+    ptr[1] = 0x66;
+    ptr[2] = block->written_type;
+    put_u32(ptr + 3, header_size + block->written_size);
+    ptr += 7;
+    if (header_size == 8)
+    {
+        // every piece declares the size of the whole ROM
+        put_u32(ptr, rom_size);
+        put_u32(ptr + 4, block->rom_start);
+    }
+    else
+    {
+        memset(ptr, 0, header_size);
+    }
+    ptr += header_size;
+
+    if (block->written_type == 0x7f)
+    {
+        write_table(ptr, &compression_formats[block->format]);
+    }
+    else if (block->written_type == 0x40)
+    {
+        // the decompressed data is hashed, it goes nowhere else
+        uint8_t* output = (uint8_t*)malloc(block->size ? block->size : 1);
+        if (!output) return NULL;
+        write_compressed(ptr, &compression_formats[block->format], block->size, output);
+        block->hash = vgm_hash_buffer(output, block->size);
+        free(output);
+        return ptr + block->written_size;
+    }
+    else
+    {
+        uint8_t previous = 0x80;
+        for (uint32_t i = 0; i < block->size; ++i)
+            previous = ptr[i] = next_sample(previous);
+        if (vgm_rom_is_dump(block->written_type)) memcpy(rom + block->rom_start, ptr, block->size);
+    }
+    block->hash = vgm_hash_buffer(ptr, block->size);
+    return ptr + block->size;
+}
+
+// Types and sizes of the blocks. The ROM pieces overlap, or leave holes the merged image has zeros in.
+static uint32_t choose_blocks(double mean)
+{
+    int table_format = -1;
+    uint32_t rom_end = 0;
+    for (size_t i = 0; i < options.block_count; ++i)
+    {
+        struct expected_block* block = &expected[i];
+        block->type = block->written_type = block_types[next_random() % sizeof(block_types)];
+        block->size = block->written_size = next_block_size(mean);
+        if (block->type == 0x7f)
+        {
+            block->format = FIRST_TABLE_FORMAT + next_random() % (FORMAT_COUNT - FIRST_TABLE_FORMAT);
+            block->size = block->written_size = get_table_size(&compression_formats[block->format]);
+            table_format = block->format;
+        }
+        else if (block->type == 0x40)
+        {
+            block->format = next_random() % FORMAT_COUNT;
+            if (block->format >= FIRST_TABLE_FORMAT)
+                block->format = table_format >= 0 ? table_format : block->format - FIRST_TABLE_FORMAT;
+            const struct compression_format* format = &compression_formats[block->format];
+            block->type -= 0x40;
+            block->size = (block->size + get_value_size(format) - 1) / get_value_size(format) * get_value_size(format);
+            block->written_size = get_compressed_size(format, block->size);
+        }
+        else if (vgm_rom_is_dump(block->type))
+        {
+            uint32_t overlap = rom_end < block->size / 2 ? rom_end : block->size / 2;
+            block->rom_start = rom_end - (uint32_t)(next_random() % (overlap + 1));
+            if (next_random() % 4 == 0) block->rom_start = rom_end + (uint32_t)(next_random() % 256);
+            if (block->rom_start + block->size > rom_end) rom_end = block->rom_start + block->size;
+        }
+    }
+    // with a few bytes at the end no piece writes
+    return rom_end ? rom_end + 16 : 0;
+}
+
+// The .vgm in memory, filling in expected[] and merged[]
+static uint8_t* generate(size_t* size)
+{
+    rng_state = options.seed ? options.seed : 1;
+    density_threshold = (uint32_t)(options.density * 4294967295.0);
+    expected = (struct expected_block*)calloc(options.block_count ? options.block_count : 1, sizeof(struct expected_block));
+    merged = (struct expected_block*)calloc(options.block_count + 1, sizeof(struct expected_block));
+    if (!expected || !merged) return NULL;
+
+    size_t target = (size_t)(options.size_mb * 1e6);
+    double mean = target * options.block_percent / 100 / (options.block_count ? options.block_count : 1);
+    uint32_t rom_size = choose_blocks(mean);
+    size_t block_bytes = 0;
+    for (size_t i = 0; i < options.block_count; ++i)
+        block_bytes += 7 + vgm_block_header_size(expected[i].written_type) + expected[i].written_size;
+
+    // commands fill the rest, spread evenly between the blocks
+    size_t command_bytes = target > 0x100 + block_bytes ? target - 0x100 - block_bytes : 0;
+    size_t gap = command_bytes / (options.block_count + 1);
+    // a command may end up to 4 bytes past its gap, then 0x62 0x66 end the stream
+    size_t capacity = 0x100 + block_bytes + (gap + 4) * (options.block_count + 1) + 2;
+    uint8_t* data = (uint8_t*)malloc(capacity);
+    uint8_t* rom = rom_size ? (uint8_t*)calloc(rom_size, 1) : NULL;
+    if (!data || (rom_size && !rom))
+    {
+        free(data);
+        return NULL;
+    }
+
+    memset(data, 0, 0x100);
+    memcpy(data, "Vgm ", 4);
+    put_u32(data + 0x08, 0x171);          // version 1.71
+    put_u32(data + 0x2c, 7670453);        // YM2612 clock
+    put_u32(data + 0x34, 0x100 - 0x34);   // data offset
+
+    uint8_t* ptr = write_commands(data + 0x100, gap);
+    for (size_t i = 0; ptr && i < options.block_count; ++i)
+    {
+        ptr = write_block(ptr, &expected[i], rom_size, rom);
+        if (ptr) ptr = write_commands(ptr, gap);
+        if (!vgm_rom_is_dump(expected[i].type)) merged[merged_count++] = expected[i];
+    }
+    if (rom)
+    {
+        struct expected_block image = { .type = 0x82, .size = rom_size, .hash = vgm_hash_buffer(rom, rom_size) };
+        merged[merged_count++] = image;
+        free(rom);
+    }
+    if (!ptr)
+    {
+        free(data);
+        return NULL;
+    }
+    *ptr++ = 0x62;
+    *ptr++ = 0x66;
+
+    *size = ptr - data;
+    put_u32(data + 0x04, (uint32_t)(*size - 4));
+    return data;
+}
+
+static bool write_vgm(const char* filename, const uint8_t* data, size_t size)
+{
+    FILE* file = fopen(filename, "wb");
+    bool result = file && fwrite(data, 1, size, file) == size;
+    if (file) result &= fclose(file) == 0;
+    return result;
+}
+
+static bool write_vgz(const char* filename, const uint8_t* data, size_t size, int level)
+{
+    char mode[4] = { 'w', 'b', (char)('0' + level), '\0' };
+    gzFile file = gzopen(filename, mode);
+    if (!file) return false;
+    bool result = true;
+    for (size_t offset = 0; result && offset < size; offset += GENERATE_CHUNK)
+    {
+        unsigned length = size - offset < GENERATE_CHUNK ? (unsigned)(size - offset) : GENERATE_CHUNK;
+        result = gzwrite(file, data + offset, length) == (int)length;
+    }
+    return (gzclose(file) == Z_OK) && result;
+}
+
+// Entry of the .zip being written
+struct zip_entry {
+    const char* name;
+    uint16_t method;
+    uint32_t crc;
+    uint32_t compressed_size;
+    uint32_t size;
+    uint32_t offset;
+};
+
+static size_t zip_entry_count = 0;
+
+// Local header, then the data stored or deflated, then its sizes and CRC written into the header
+static bool write_zip_entry(FILE* file, struct zip_entry* entry, const uint8_t* data, size_t size)
+{
+    uint8_t header[30] = { 'P', 'K', 3, 4, 20 };
+    long offset = ftell(file);
+    size_t name_length = strlen(entry->name);
+    if (offset < 0 || fwrite(header, 1, sizeof(header), file) != sizeof(header) ||
+        fwrite(entry->name, 1, name_length, file) != name_length)
+        return false;
+
+    entry->offset = (uint32_t)offset;
+    entry->size = (uint32_t)size;
+    entry->crc = (uint32_t)crc32(crc32(0, NULL, 0), data, (uInt)size);
+    size_t compressed_size = size;
+    if (entry->method == VGM_ZIP_STORED)
+    {
+        if (fwrite(data, 1, size, file) != size) return false;
+    }
+    else
+    {
+        z_stream stream = { 0 };
+        if (deflateInit2(&stream, 6, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) return false;
+        static uint8_t buffer[256 * 1024];
+        stream.next_in = (Bytef*)data;
+        stream.avail_in = (uInt)size;
+        int status = Z_OK;
+        compressed_size = 0;
+        while (status == Z_OK)
+        {
+            stream.next_out = buffer;
+            stream.avail_out = sizeof(buffer);
+            status = deflate(&stream, Z_FINISH);
+            size_t length = sizeof(buffer) - stream.avail_out;
+            if (status == Z_STREAM_ERROR || fwrite(buffer, 1, length, file) != length) status = Z_STREAM_ERROR;
+            compressed_size += length;
+        }
+        deflateEnd(&stream);
+        if (status != Z_STREAM_END) return false;
+    }
+    entry->compressed_size = (uint32_t)compressed_size;
+
+    put_u16(header + 8, entry->method);
+    put_u16(header + 12, 0x21); // 1980-01-01
+    put_u32(header + 14, entry->crc);
+    put_u32(header + 18, entry->compressed_size);
+    put_u32(header + 22, entry->size);
+    put_u16(header + 26, (uint16_t)name_length);
+    return fseek(file, offset, SEEK_SET) == 0 && fwrite(header, 1, sizeof(header), file) == sizeof(header) &&
+        fseek(file, 0, SEEK_END) == 0;
+}
+
+// A pack like the ones of vgmrips: the .vgm deflated, and the .vgz stored as it is. Entries are kept
+// under 4 GB, no ZIP64 is written.
+static bool write_zip(const char* filename, const uint8_t* data, size_t size, const char* vgz_name)
+{
+    struct zip_entry entries[2] = { { "bench.vgm", VGM_ZIP_DEFLATED }, { "bench.vgz", VGM_ZIP_STORED } };
+    zip_entry_count = 0;
+    uint8_t* vgz = NULL;
+    size_t vgz_size = 0;
+    FILE* file = NULL;
+    if (vgz_name)
+    {
+        if (!(file = fopen(vgz_name, "rb"))) return false;
+        struct stat st;
+        if (fstat(fileno(file), &st) == 0 && (vgz = (uint8_t*)malloc(st.st_size ? st.st_size : 1)))
+            vgz_size = fread(vgz, 1, st.st_size, file);
+        fclose(file);
+        if (!vgz) return false;
+    }
+
+    bool result = (file = fopen(filename, "wb")) && write_zip_entry(file, &entries[zip_entry_count++], data, size);
+    if (result && vgz) result = write_zip_entry(file, &entries[zip_entry_count++], vgz, vgz_size);
+    free(vgz);
+
+    long directory_offset = file ? ftell(file) : -1;
+    for (size_t i = 0; result && i < zip_entry_count; ++i)
+    {
+        const struct zip_entry* entry = &entries[i];
+        uint8_t header[46] = { 'P', 'K', 1, 2, 20, 0, 20 };
+        put_u16(header + 10, entry->method);
+        put_u16(header + 14, 0x21);
+        put_u32(header + 16, entry->crc);
+        put_u32(header + 20, entry->compressed_size);
+        put_u32(header + 24, entry->size);
+        put_u16(header + 28, (uint16_t)strlen(entry->name));
+        put_u32(header + 42, entry->offset);
+        result = fwrite(header, 1, sizeof(header), file) == sizeof(header) &&
+            fwrite(entry->name, 1, strlen(entry->name), file) == strlen(entry->name);
+    }
+    if (result)
+    {
+        uint8_t end[22] = { 'P', 'K', 5, 6 };
+        put_u16(end + 8, (uint16_t)zip_entry_count);
+        put_u16(end + 10, (uint16_t)zip_entry_count);
+        put_u32(end + 12, (uint32_t)(ftell(file) - directory_offset));
+        put_u32(end + 16, (uint32_t)directory_offset);
+        result = directory_offset >= 0 && fwrite(end, 1, sizeof(end), file) == sizeof(end);
+    }
+    if (file) result &= fclose(file) == 0;
+    return result;
+}
+
+//
+// Measurements
+//
+
+// Restart the peak resident set size of the process, where the kernel allows it
+static void reset_peak_rss(void)
+{
+#if defined(__linux__)
+    FILE* file = fopen("/proc/self/clear_refs", "w");
+    if (file)
+    {
+        fputs("5", file);
+        fclose(file);
+    }
+#endif
+}
+
+// Peak resident set size in MB since the last reset_peak_rss()
+static double get_peak_rss(void)
+{
+#if defined(__linux__)
+    FILE* file = fopen("/proc/self/status", "r");
+    if (file)
+    {
+        char line[256];
+        long kb = -1;
+        while (kb < 0 && fgets(line, sizeof(line), file))
+        {
+            if (strncmp(line, "VmHWM:", 6) == 0) kb = atol(line + 6);
+        }
+        fclose(file);
+        if (kb >= 0) return kb / 1024.0;
+    }
+#endif
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == -1) return 0;
+#if defined(__APPLE__)
+    return usage.ru_maxrss / (1024.0 * 1024.0);
+#else
+    return usage.ru_maxrss / 1024.0;
+#endif
+}
+
+// rm -r
+static void remove_tree(const char* path)
+{
+    DIR* dir = opendir(path);
+    if (dir)
+    {
+        struct dirent* entry;
+        while ((entry = readdir(dir)))
+        {
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+
+            char child[4096];
+            snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+            struct stat st;
+            if (lstat(child, &st) == 0 && S_ISDIR(st.st_mode))
+                remove_tree(child);
+            else
+                remove(child);
+        }
+        closedir(dir);
+    }
+    remove(path);
+}
+
+// Compare the blocks of the list with count generated blocks, repeated copies times (once per file read)
+static bool check_blocks(const struct VGMBlockList* list, const struct expected_block* want_blocks, size_t count,
+    size_t copies)
+{
+    if (list->count != count * copies)
+    {
+        fprintf(stderr, "  %zu blocks extracted, %zu expected\n", list->count, count * copies);
+        return false;
+    }
+    for (size_t i = 0; i < list->count; ++i)
+    {
+        const struct VGMDataBlock* block = &list->blocks[i];
+        const struct expected_block* want = &want_blocks[i % count];
+        if (block->type != want->type || block->size != want->size || block->hash != want->hash)
+        {
+            fprintf(stderr, "  block %zu: type %02x, %u bytes, hash %016llx, expected %02x, %u bytes, hash %016llx\n",
+                i, block->type, block->size, (unsigned long long)block->hash,
+                want->type, want->size, (unsigned long long)want->hash);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool inflate_file(const char* filename)
+{
+    gzFile file = gzopen(filename, "rb");
+    if (!file) return false;
+    gzbuffer(file, 256 * 1024);
+    static uint8_t buffer[256 * 1024];
+    size_t total = 0;
+    int length;
+    while ((length = gzread(file, buffer, sizeof(buffer))) > 0)
+        total += length;
+    gzclose(file);
+    return length == 0 && total == vgm_size;
+}
+
+//
+// Golden values
+//
+
+// A golden file holds, after # comments:
+//   options <generator options>            (the ones below, which change the generated file)
+//   file <size> <hash>                     (XXH64 of the generated .vgm, in hex)
+//   block <index> <type> <size> <hash>     (one per block in order, type and hash in hex)
+//   rom <type> <size> <hash>               (the image the ROM pieces merge into, if any)
+//   min <MB/s> <stage name>                (optional, for every stage to check the speed of)
+
+static uint64_t vgm_hash = 0;
+
+// The merged ROM image, the last of merged[], NULL without ROM pieces
+static const struct expected_block* get_rom_image(void)
+{
+    return merged_count > 0 && vgm_rom_is_dump(merged[merged_count - 1].type) ? &merged[merged_count - 1] : NULL;
+}
+
+static void format_generator_options(char* text, size_t size)
+{
+    static const char* distributions[] = { "fixed", "uniform", "exp" };
+    snprintf(text, size, "-s %g -n %zu -f %g -d %s -x %g -S %llu", options.size_mb, options.block_count,
+        options.block_percent, distributions[options.distribution], options.density, (unsigned long long)options.seed);
+}
+
+// Compare the generated file and expected[] with the golden file, and take its minimum rates for -t
+static bool check_golden(void)
+{
+    FILE* file = fopen(options.golden, "r");
+    if (!file)
+    {
+        fprintf(stderr, "%s: %s\n", options.golden, strerror(errno));
+        return false;
+    }
+
+    char generator_options[256];
+    format_generator_options(generator_options, sizeof(generator_options));
+    bool result = true;
+    bool has_options = false;
+    bool has_file = false;
+    size_t block_count = 0;
+    size_t blocks_differing = 0;
+    const struct expected_block* rom = get_rom_image();
+    bool has_rom = false;
+    char line[512];
+    for (int number = 1; result && fgets(line, sizeof(line), file); ++number)
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+        unsigned long long size, hash;
+        size_t index;
+        unsigned int type;
+        double mb_s;
+        int name_offset = 0;
+        if (line[0] == '#' || line[0] == '\0') continue;
+
+        if (strncmp(line, "options ", 8) == 0)
+        {
+            has_options = true;
+            if (strcmp(line + 8, generator_options) != 0)
+            {
+                fprintf(stderr, "%s: made with %s, not %s\n", options.golden, line + 8, generator_options);
+                result = false;
+            }
+        }
+        else if (sscanf(line, "file %llu %llx", &size, &hash) == 2)
+        {
+            has_file = true;
+            if (size != vgm_size || hash != vgm_hash)
+            {
+                fprintf(stderr, "%s: generated %zu bytes, hash %016llx, golden %llu bytes, hash %016llx\n",
+                    options.golden, vgm_size, (unsigned long long)vgm_hash, size, hash);
+                result = false;
+            }
+        }
+        else if (sscanf(line, "block %zu %x %llu %llx", &index, &type, &size, &hash) == 4 && index == block_count)
+        {
+            const struct expected_block* block = index < options.block_count ? &expected[index] : NULL;
+            if ((!block || block->type != type || block->size != size || block->hash != hash) && blocks_differing++ == 0)
+            {
+                fprintf(stderr, "%s: block %zu: golden type %02x, %llu bytes, hash %016llx\n", options.golden, index,
+                    type, size, hash);
+            }
+            block_count++;
+        }
+        else if (sscanf(line, "rom %x %llu %llx", &type, &size, &hash) == 3 && !has_rom)
+        {
+            has_rom = true;
+            if (!rom || rom->type != type || rom->size != size || rom->hash != hash)
+            {
+                fprintf(stderr, "%s: golden ROM image type %02x, %llu bytes, hash %016llx\n", options.golden, type,
+                    size, hash);
+                result = false;
+            }
+        }
+        else if (sscanf(line, "min %lf %n", &mb_s, &name_offset) == 1 && name_offset > 0 && line[name_offset])
+        {
+            if (options.check_speed && minimum_rate_count < MAX_STAGE_RATES)
+            {
+                struct stage_rate* rate = &minimum_rates[minimum_rate_count++];
+                snprintf(rate->name, sizeof(rate->name), "%s", line + name_offset);
+                rate->mb_s = mb_s;
+            }
+        }
+        else
+        {
+            fprintf(stderr, "%s:%d: malformed line\n", options.golden, number);
+            result = false;
+        }
+    }
+    fclose(file);
+
+    if (result && (!has_options || !has_file))
+    {
+        fprintf(stderr, "%s: no options or file line\n", options.golden);
+        result = false;
+    }
+    if (result && (blocks_differing > 0 || block_count != options.block_count))
+    {
+        fprintf(stderr, "%s: %zu of %zu golden blocks differ, %zu generated\n", options.golden, blocks_differing,
+            block_count, options.block_count);
+        result = false;
+    }
+    if (result && rom && !has_rom)
+    {
+        fprintf(stderr, "%s: no ROM image\n", options.golden);
+        result = false;
+    }
+    return result;
+}
+
+static struct stage_rate* find_rate(struct stage_rate* rates, size_t count, const char* name)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (strcmp(rates[i].name, name) == 0) return &rates[i];
+    }
+    return NULL;
+}
+
+// Keep the slowest rate of every stage name for -G, false if the stage is under its golden minimum
+static bool check_rate(const char* name, double mb_s)
+{
+    struct stage_rate* measured = find_rate(measured_rates, measured_rate_count, name);
+    if (!measured && measured_rate_count < MAX_STAGE_RATES)
+    {
+        measured = &measured_rates[measured_rate_count++];
+        snprintf(measured->name, sizeof(measured->name), "%s", name);
+        measured->mb_s = mb_s;
+    }
+    else if (measured && mb_s < measured->mb_s)
+    {
+        measured->mb_s = mb_s;
+    }
+    const struct stage_rate* minimum = find_rate(minimum_rates, minimum_rate_count, name);
+    return !minimum || mb_s >= minimum->mb_s;
+}
+
+static bool write_golden(void)
+{
+    FILE* file = fopen(options.new_golden, "w");
+    if (!file) return false;
+
+    char generator_options[256];
+    format_generator_options(generator_options, sizeof(generator_options));
+    fprintf(file, "# vgm-xtract-bench golden values, see -g\n");
+    fprintf(file, "options %s\n", generator_options);
+    fprintf(file, "file %zu %016llx\n", vgm_size, (unsigned long long)vgm_hash);
+    for (size_t i = 0; i < options.block_count; ++i)
+        fprintf(file, "block %zu %02x %u %016llx\n", i, expected[i].type, expected[i].size,
+            (unsigned long long)expected[i].hash);
+    const struct expected_block* rom = get_rom_image();
+    if (rom)
+        fprintf(file, "rom %02x %u %016llx\n", rom->type, rom->size, (unsigned long long)rom->hash);
+    // a tenth of what was measured, so only a clear regression fails on a slower machine or build
+    for (size_t i = 0; i < measured_rate_count; ++i)
+        fprintf(file, "min %.1f %s\n", measured_rates[i].mb_s / 10, measured_rates[i].name);
+
+    bool result = !ferror(file);
+    return (fclose(file) == 0) && result;
+}
+
+// One run of a stage, its duration in *elapsed. False if the blocks do not match.
+static bool run_once(enum stage_kind kind, const char* filename, double* elapsed)
+{
+    struct VGMBlockList list = { 0 };
+    list.in_memory = kind == STAGE_SCAN || kind == STAGE_RECOVERY || kind == STAGE_INDEX || kind == STAGE_BLOCKS ||
+        kind == STAGE_MERGE || kind == STAGE_ZIP;
+    list.merge_roms = kind == STAGE_MERGE;
+    list.recovery = kind == STAGE_RECOVERY;
+    list.gz_index = kind == STAGE_INDEX;
+    list.output_dir = blocks_dir;
+
+    // every run starts from empty outputs
+    if (kind == STAGE_FILES)
+    {
+        remove_tree(blocks_dir);
+        mkdir(blocks_dir, 0755);
+    }
+    else if (kind == STAGE_STORE)
+    {
+        remove_tree(store_dir);
+        mkdir(store_dir, 0755);
+        list.store_dir = store_dir;
+    }
+    else if (kind == STAGE_PACK && !(list.pack = vgm_pack_create(pack_name)))
+    {
+        fprintf(stderr, "  cannot create %s\n", pack_name);
+        return false;
+    }
+
+    double start = get_time_monotonic();
+    bool result = true;
+    if (kind == STAGE_INFLATE)
+    {
+        result = inflate_file(filename);
+    }
+    else if (kind == STAGE_BLOCKS)
+    {
+        for (size_t i = 0; result && i < options.block_count; ++i)
+        {
+            result = extract_vgz_block(&list, filename, i) && check_blocks(&list, &expected[i], 1, 1);
+            reset_block_list(&list);
+        }
+    }
+    else if (kind == STAGE_MERGE)
+    {
+        extract_file(&list, filename);
+        result = !list.error[0] && check_blocks(&list, merged, merged_count, 1);
+    }
+    else if (kind == STAGE_ZIP)
+    {
+        // every entry holds all the blocks
+        extract_file(&list, filename);
+        result = !list.error[0] && check_blocks(&list, expected, options.block_count, zip_entry_count);
+    }
+    else
+    {
+        extract_file(&list, filename);
+        result = sync_block_list(&list);
+        if (list.pack) result &= vgm_pack_finish(list.pack);
+        result = result && !list.error[0] && check_blocks(&list, expected, options.block_count, 1);
+    }
+    *elapsed = get_time_monotonic() - start;
+
+    if (list.error[0]) fprintf(stderr, "  %s", list.error);
+    free_block_list(&list);
+    return result;
+}
+
+static void run_stage(const char* name, enum stage_kind kind, const char* filename)
+{
+    double best = 0;
+    bool result = true;
+    reset_peak_rss();
+    for (int i = 0; i < options.repeats; ++i)
+    {
+        double elapsed;
+        result &= run_once(kind, filename, &elapsed);
+        if (i == 0 || elapsed < best) best = elapsed;
+    }
+    double peak_rss = get_peak_rss();
+    if (best <= 0) best = 1e-9;
+
+    double bytes = kind == STAGE_ZIP ? (double)vgm_size * zip_entry_count : vgm_size;
+    if (kind == STAGE_BLOCKS)
+    {
+        bytes = 0;
+        for (size_t i = 0; i < options.block_count; ++i) bytes += expected[i].size;
+    }
+    char blocks[32] = "-";
+    if (kind != STAGE_INFLATE)
+        snprintf(blocks, sizeof(blocks), "%.0f", options.block_count / best);
+
+    bool fast = check_rate(name, bytes / 1e6 / best);
+    printf("%-22s %9.3f %9.1f %11s %9.1f  %s\n", name, best, bytes / 1e6 / best, blocks, peak_rss,
+        !result ? "FAILED" : fast ? "ok" : "SLOW");
+    fflush(stdout);
+    checks_failed |= !result;
+    too_slow |= !fast;
+}
+
+// "67 66" search alone over the generated data. Pairs inside block data count too, so the
+// check is that every finder sees the same candidates, at least one per block.
+static void run_finder(const char* name, const uint8_t* data, bool vectorized)
+{
+    static size_t first_candidates = SIZE_MAX;
+    double best = 0;
+    bool result = true;
+    for (int i = 0; i < options.repeats; ++i)
+    {
+        double start = get_time_monotonic();
+        size_t candidates = count_data_block_candidates(data, vgm_size, vectorized);
+        double elapsed = get_time_monotonic() - start;
+        if (first_candidates == SIZE_MAX) first_candidates = candidates;
+        result &= candidates == first_candidates && candidates >= options.block_count;
+        if (i == 0 || elapsed < best) best = elapsed;
+    }
+    if (best <= 0) best = 1e-9;
+
+    bool fast = check_rate(name, vgm_size / 1e6 / best);
+    printf("%-22s %9.3f %9.1f %11.0f %9s  %s\n", name, best, vgm_size / 1e6 / best, options.block_count / best, "-",
+        !result ? "FAILED" : fast ? "ok" : "SLOW");
+    fflush(stdout);
+    checks_failed |= !result;
+    too_slow |= !fast;
+}
+
+int main(int argc, char** argv)
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "s:n:f:d:x:z:r:S:o:kg:tG:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 's': options.size_mb = atof(optarg); break;
+        case 'n': options.block_count = strtoul(optarg, NULL, 10); break;
+        case 'f': options.block_percent = atof(optarg); break;
+        case 'd':
+            if (strcmp(optarg, "fixed") == 0) options.distribution = SIZE_FIXED;
+            else if (strcmp(optarg, "uniform") == 0) options.distribution = SIZE_UNIFORM;
+            else if (strcmp(optarg, "exp") == 0) options.distribution = SIZE_EXPONENTIAL;
+            else opt = '?';
+            break;
+        case 'x': options.density = atof(optarg); break;
+        case 'z': if (!parse_gzip_levels(optarg)) opt = '?'; break;
+        case 'r': options.repeats = atoi(optarg); break;
+        case 'S': options.seed = strtoull(optarg, NULL, 10); break;
+        case 'o': options.work_dir = optarg; break;
+        case 'k': options.keep = true; break;
+        case 'g': options.golden = optarg; break;
+        case 't': options.check_speed = true; break;
+        case 'G': options.new_golden = optarg; break;
+        default: break;
+        }
+        if (opt == 'h' || opt == '?')
+        {
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (optind < argc || options.size_mb <= 0 || options.block_percent < 0 || options.block_percent > 100 ||
+        options.density < 0 || options.density > 1 || options.repeats <= 0 ||
+        (options.check_speed && !options.golden))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (mkdir(options.work_dir, 0755) == -1 && errno != EEXIST)
+    {
+        fprintf(stderr, "%s: %s\n", options.work_dir, strerror(errno));
+        return 1;
+    }
+    snprintf(blocks_dir, sizeof(blocks_dir), "%s/blocks", options.work_dir);
+    snprintf(store_dir, sizeof(store_dir), "%s/store", options.work_dir);
+    snprintf(pack_name, sizeof(pack_name), "%s/bench.pack", options.work_dir);
+    snprintf(zip_name, sizeof(zip_name), "%s/bench.zip", options.work_dir);
+
+    char vgm_name[4096];
+    char vgz_names[MAX_GZIP_LEVELS][4096];
+    snprintf(vgm_name, sizeof(vgm_name), "%s/bench.vgm", options.work_dir);
+
+    double start = get_time_monotonic();
+    uint8_t* data = generate(&vgm_size);
+    if (!data)
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 1;
+    }
+    size_t block_bytes = 0;
+    for (size_t i = 0; i < options.block_count; ++i) block_bytes += expected[i].size;
+    vgm_hash = vgm_hash_buffer(data, vgm_size);
+    bool golden_failed = options.golden && !check_golden();
+
+    bool result = write_vgm(vgm_name, data, vgm_size);
+    for (int i = 0; result && i < options.gzip_level_count; ++i)
+    {
+        snprintf(vgz_names[i], sizeof(vgz_names[i]), "%s/bench_%d.vgz", options.work_dir, options.gzip_levels[i]);
+        result = write_vgz(vgz_names[i], data, vgm_size, options.gzip_levels[i]);
+    }
+    bool zip = vgm_size <= UINT32_MAX;
+    if (result && zip)
+        result = write_zip(zip_name, data, vgm_size, options.gzip_level_count ? vgz_names[0] : NULL);
+    if (!result)
+    {
+        free(data);
+        fprintf(stderr, "cannot write the generated files to %s\n", options.work_dir);
+        return 1;
+    }
+
+    printf("Generated %.1f MB with %zu blocks (%.1f MB of block data) in %.3f s, search: %s\n",
+        vgm_size / 1e6, options.block_count, block_bytes / 1e6, get_time_monotonic() - start, find_data_block_isa());
+    printf("%-22s %9s %9s %11s %9s\n", "stage", "best s", "MB/s", "blocks/s", "peak MB");
+
+    run_finder("find blocks", data, true);
+    run_finder("find blocks scalar", data, false);
+    // the stages measure the memory they use themselves
+    free(data);
+
+    run_stage("scan .vgm", STAGE_SCAN, vgm_name);
+    run_stage("recovery scan .vgm", STAGE_RECOVERY, vgm_name);
+    run_stage("write block files", STAGE_FILES, vgm_name);
+    run_stage("write to store", STAGE_STORE, vgm_name);
+    run_stage("write pack file", STAGE_PACK, vgm_name);
+    run_stage("merge ROMs", STAGE_MERGE, vgm_name);
+    if (zip) run_stage("scan .zip", STAGE_ZIP, zip_name);
+    for (int i = 0; i < options.gzip_level_count; ++i)
+    {
+        struct stat st;
+        if (stat(vgz_names[i], &st) == 0)
+            printf("-- .vgz level %d: %.1f MB\n", options.gzip_levels[i], st.st_size / 1e6);
+        run_stage("inflate only", STAGE_INFLATE, vgz_names[i]);
+        run_stage("scan .vgz", STAGE_SCAN, vgz_names[i]);
+        run_stage("scan .vgz + index", STAGE_INDEX, vgz_names[i]);
+        run_stage("read single blocks", STAGE_BLOCKS, vgz_names[i]);
+    }
+
+    if (!options.keep)
+    {
+        remove_tree(blocks_dir);
+        remove_tree(store_dir);
+        remove(pack_name);
+        remove(zip_name);
+        remove(vgm_name);
+        for (int i = 0; i < options.gzip_level_count; ++i)
+        {
+            char index_name[4096];
+            vgm_gz_index_file_name(vgz_names[i], index_name, sizeof(index_name));
+            remove(index_name);
+            remove(vgz_names[i]);
+        }
+        rmdir(options.work_dir);
+    }
+    bool golden_written = !options.new_golden || write_golden();
+    if (!golden_written)
+        fprintf(stderr, "cannot write %s\n", options.new_golden);
+    free(expected);
+    free(merged);
+
+    if (checks_failed)
+        printf("Extracted blocks differ from the generated ones\n");
+    if (golden_failed)
+        printf("Generated file or blocks differ from %s\n", options.golden);
+    if (too_slow)
+        printf("Stages slower than their minimum in %s\n", options.golden);
+    return checks_failed || golden_failed || too_slow || !golden_written ? 1 : 0;
+}
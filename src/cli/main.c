@@ -0,0 +1,1637 @@
+#include <dirent.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "vgmcache.h"
+#include "vgmcatalog.h"
+#include "vgmextract.h"
+#include "vgmpack.h"
+#include "vgmpcm.h"
+#include "vgmscan.h"
+#include "vgmtag.h"
+#include "vgmwatch.h"
+#include "vgmzip.h"
+
+#define WATCH_DEBOUNCE_SECONDS 1.0  // -W: a burst of changes is over after this long without events
+#define WATCH_SWEEP_SECONDS    60.0 // -W: modification times are compared this often without inotify
+
+// What a worker found out about a queued file
+struct file_result {
+    char* manifest;     // -d: its lines of manifest.tsv
+    int64_t mtime;      // -W: modification time in ns and size before it was read
+    int64_t size;
+    bool failed;
+};
+
+// Files given on the command line or found in the given directories
+struct file_queue {
+    char** paths;
+    struct file_result* results;
+    size_t count;
+    size_t capacity;
+    atomic_size_t next; // next file to be taken by a worker
+};
+
+// -W: every file of the inputs as it was last processed, sorted by path
+struct library {
+    char** paths;
+    struct file_result* results;
+    size_t count;
+};
+
+// .zip archive among the inputs. Its .vgm and .vgz entries are queued as "<archive>/<entry name>", any
+// worker reads them straight from the mapped archive.
+struct archive {
+    char* path;
+    struct vgm_zip zip;
+};
+
+// A directory walked, whatever path led to it
+struct directory_id {
+    dev_t dev;
+    ino_t ino;
+};
+
+// Directories left to walk, read by all workers before the files are processed
+struct directory_stack {
+    char** paths;
+    size_t count;
+    size_t capacity;
+    size_t walking;     // directories being read, each one may add more
+    struct directory_id* walked; // open-addressing set, so a symlink back up the tree is not followed again
+    size_t walked_count;
+    size_t walked_capacity;
+    bool failed;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+};
+
+struct options {
+    const char* output_dir;
+    int jobs;
+    bool recovery;
+    bool dedup;
+    const char* pack_file;
+    bool gz_index;
+    long block;         // only extract this block of every file, -1 for all
+    const char* cache_file;
+    const char* stats_file;
+    const struct vgm_type_filter* filter; // only extract these block types, NULL for all
+    bool merge_roms;    // one image per ROM of every file instead of its pieces
+    bool wav;           // decode audio blocks to <output_dir>/block_N.wav
+    uint32_t rate;      // sample rate of the WAV files, 0 for the usual rate of each block type
+    const char* catalog_file; // -i: index the files into this catalog instead of extracting
+    const char* query_file;   // -q: list the files of this catalog matching the query
+    bool watch;         // -W: keep the outputs in sync with the inputs after the first run
+    char** inputs;      // files and directories given on the command line
+    int input_count;
+};
+
+static struct file_queue queue = { 0 };
+static struct directory_stack directories = { .lock = PTHREAD_MUTEX_INITIALIZER, .changed = PTHREAD_COND_INITIALIZER };
+static struct options options = { "output", 0, false, false, NULL, false, -1, NULL, NULL, NULL, false, false, 0, NULL,
+    NULL, false, NULL, 0 };
+static struct vgm_type_filter type_filter = { 0 };
+
+// Archives of the queued entries, sorted by path, open until the workers are done
+static struct archive* archives = NULL;
+static size_t archive_count = 0;
+
+// Content-addressed store of -d, manifest.tsv is written from the results of the workers once they are done
+static char store_dir[4096];
+
+// Single output file for all blocks
+static struct vgm_pack* pack = NULL;
+
+// Blocks of the files of earlier runs
+static struct vgm_cache* cache = NULL;
+
+// Catalog being built with -i, and the one it replaces, whose unchanged files are taken as they are
+static struct vgm_catalog* catalog = NULL;
+static struct vgm_catalog_reader previous_catalog = { 0 };
+
+// One JSON object per input file with the counters of its extraction
+static FILE* stats = NULL;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// -w: the blocks of a file stay in memory until every worker is done converting them
+struct wav_file {
+    struct VGMBlockList list;
+    const char* path;
+    char output_dir[4096];
+    size_t next;            // next block to convert, taken under wav_lock
+    atomic_size_t left;     // blocks not converted yet, the worker converting the last one frees the file
+    atomic_bool failed;
+    struct wav_file* next_file;
+};
+
+static struct wav_file* wav_files = NULL;
+static pthread_mutex_t wav_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static atomic_size_t files_done = 0;
+static atomic_size_t files_failed = 0;
+static atomic_size_t files_cached = 0;
+static atomic_size_t blocks_found = 0;
+static atomic_uint_least64_t bytes_in = 0;
+static atomic_uint_least64_t bytes_out = 0;
+static atomic_uint_least64_t bytes_reused = 0;
+static atomic_size_t blocks_converted = 0;
+
+// -W: directories are watched as they are walked. Changes are queued until a burst is over, then the
+// files new or changed since the library was processed are extracted again.
+static struct library library = { 0 };
+static struct vgm_watch* watch = NULL;
+static atomic_bool watch_full = false;  // a directory could not be watched, modification times are compared instead
+static bool events_lost = false;        // the whole library is compared to its files
+static bool updating = false;           // outputs left by the last extraction of a file are removed first
+static volatile sig_atomic_t stopping = 0;
+
+static void usage(const char* name)
+{
+    fprintf(stderr, "Usage: %s [-j jobs] [-o output_dir | -p pack_file] [-r] [-d] [-z] [-b block] [-c cache_file]\n"
+        "       [-s stats_file] [-t types] [-m] [-w [-R rate]] [-W] file|directory...\n"
+        "       %s [-j jobs] [-r] [-z] [-s stats_file] [-W] -i catalog_file file|directory...\n"
+        "       %s -q catalog_file [chip=name] [type=types] [game=text] [size=min-max]...\n"
+        "  -j  number of worker threads (default: number of cores)\n"
+        "  -o  output directory, one subdirectory per input file (default: output)\n"
+        "  -r  recovery scan: search every \"67 66\" pair instead of walking commands\n"
+        "  -d  write identical blocks once to output_dir/blocks/<hash>.raw and list\n"
+        "      the blocks of every file in output_dir/manifest.tsv\n"
+        "  -p  write all blocks to one indexed pack file instead (see vgmpack.h)\n"
+        "  -z  write a checkpoint index next to every .vgz file (<file>.idx)\n"
+        "  -b  only extract the given block of every file: a .vgz is inflated from the\n"
+        "      nearest checkpoint of the index written by an earlier run with -z, a .vgm\n"
+        "      or archive entry is scanned whole\n"
+        "  -c  remember the blocks of every file in cache_file: unchanged files are not\n"
+        "      scanned again, nor read at all with -d when their blocks are stored\n"
+        "  -s  write the time spent per phase, bytes, blocks and memory of every file\n"
+        "      to stats_file, one JSON object per line\n"
+        "  -t  only extract blocks of these types, hexadecimal types and ranges like\n"
+        "      80-93,c0-e1: other blocks are skipped unread (and the cache is not used)\n"
+        "  -m  merge the pieces of every ROM dump (types 80-bf) into one block per chip,\n"
+        "      written after the other blocks of the file (the cache is not used)\n"
+        "  -w  decode PCM and ADPCM blocks to 16-bit WAV files instead (block_N.wav),\n"
+        "      blocks of other types are not written\n"
+        "  -R  sample rate of the WAV files (default: usual rate of the chip)\n"
+        "  -i  index the header, GD3 tag and blocks of every file into catalog_file\n"
+        "      instead, files unchanged since the last run are taken from it\n"
+        "  -q  list the files of catalog_file with all these chips, a block of one of\n"
+        "      these types (and sizes, like 64k-1m), and a game name holding the text\n"
+        "  -W  keep watching the inputs after the first run (not with -p): files added,\n"
+        "      changed or removed are extracted again or have their outputs removed\n"
+        "  .zip inputs are read in place: their .vgm and .vgz entries are extracted like\n"
+        "      files named <archive>.zip/<entry>, in parallel and without temporary files\n",
+        name, name, name);
+}
+
+static bool is_archive(const char* path)
+{
+    const char* ext = strrchr(path, '.');
+    return ext && strcasecmp(ext, ".zip") == 0;
+}
+
+static bool is_vgm_file(const char* path)
+{
+    const char* ext = strrchr(path, '.');
+    return ext && (strcasecmp(ext, ".vgm") == 0 || strcasecmp(ext, ".vgz") == 0 || is_archive(path));
+}
+
+static bool is_vgz_file(const char* path)
+{
+    const char* ext = strrchr(path, '.');
+    return ext && strcasecmp(ext, ".vgz") == 0;
+}
+
+static bool queue_file(const char* path)
+{
+    if (queue.count == queue.capacity)
+    {
+        size_t capacity = queue.capacity ? queue.capacity * 2 : 256;
+        char** tmp = (char**)realloc(queue.paths, capacity * sizeof(char*));
+        if (!tmp) return false;
+        queue.paths = tmp;
+        queue.capacity = capacity;
+    }
+    if (!(queue.paths[queue.count] = strdup(path))) return false;
+    queue.count++;
+    return true;
+}
+
+static size_t hash_directory_id(const struct directory_id* id, size_t capacity)
+{
+    uint64_t key = ((uint64_t)id->dev << 32 ^ (uint64_t)id->ino) * 0x9e3779b97f4a7c15ULL;
+    return (size_t)(key >> 32) & (capacity - 1);
+}
+
+// Add a directory to the walked ones, *seen set if it was there already. False if memory ran out.
+static bool mark_walked(const struct directory_id* id, bool* seen)
+{
+    if (directories.walked_count * 2 >= directories.walked_capacity)
+    {
+        size_t capacity = directories.walked_capacity ? directories.walked_capacity * 2 : 256;
+        struct directory_id* walked = (struct directory_id*)malloc(capacity * sizeof(struct directory_id));
+        if (!walked) return false;
+        // ino 0 marks a free slot, no directory has it
+        memset(walked, 0, capacity * sizeof(struct directory_id));
+        for (size_t i = 0; i < directories.walked_capacity; ++i)
+        {
+            const struct directory_id* old = &directories.walked[i];
+            if (old->ino == 0) continue;
+            size_t slot = hash_directory_id(old, capacity);
+            while (walked[slot].ino != 0) slot = (slot + 1) & (capacity - 1);
+            walked[slot] = *old;
+        }
+        free(directories.walked);
+        directories.walked = walked;
+        directories.walked_capacity = capacity;
+    }
+
+    size_t slot = hash_directory_id(id, directories.walked_capacity);
+    struct directory_id* entry;
+    while ((entry = &directories.walked[slot])->ino != 0)
+    {
+        if (entry->dev == id->dev && entry->ino == id->ino)
+        {
+            *seen = true;
+            return true;
+        }
+        slot = (slot + 1) & (directories.walked_capacity - 1);
+    }
+    *entry = *id;
+    directories.walked_count++;
+    *seen = false;
+    return true;
+}
+
+// Push a directory not walked yet. Links are followed, but a directory reached again, by a loop like
+// "ln -s .. up" or through another link, is left out and *seen set (if given).
+static bool push_directory(const char* path, const struct stat* st, bool* seen)
+{
+    bool walked = false;
+    if (st)
+    {
+        struct directory_id id = { st->st_dev, st->st_ino };
+        if (!mark_walked(&id, &walked)) return false;
+    }
+    if (seen) *seen = walked;
+    if (walked) return true;
+
+    if (directories.count == directories.capacity)
+    {
+        size_t capacity = directories.capacity ? directories.capacity * 2 : 64;
+        char** tmp = (char**)realloc(directories.paths, capacity * sizeof(char*));
+        if (!tmp) return false;
+        directories.paths = tmp;
+        directories.capacity = capacity;
+    }
+    if (!(directories.paths[directories.count] = strdup(path))) return false;
+    directories.count++;
+    return true;
+}
+
+// Queue the files of a directory and push its subdirectories for any walker to take
+static bool walk_directory(const char* path)
+{
+    // watched before it is read, so no file added meanwhile is missed
+    if (watch && !vgm_watch_add(watch, path)) atomic_store(&watch_full, true);
+
+    DIR* dir = opendir(path);
+    if (!dir)
+    {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    bool result = true;
+    struct dirent* entry;
+    while (result && (entry = readdir(dir)))
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+
+        char child[4096];
+        snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+        // the entry type saves a stat() per file, links and some file systems still need one
+        bool is_dir = entry->d_type == DT_DIR;
+        bool is_file = entry->d_type == DT_REG;
+        struct stat st;
+        bool has_stat = false;
+        if ((entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK) && stat(child, &st) == 0)
+        {
+            has_stat = true;
+            is_dir = S_ISDIR(st.st_mode);
+            is_file = S_ISREG(st.st_mode);
+        }
+        if (!is_dir && !(is_file && is_vgm_file(child))) continue;
+        if (is_dir && !has_stat) has_stat = fstatat(dirfd(dir), entry->d_name, &st, 0) == 0;
+
+        bool seen = false;
+        pthread_mutex_lock(&directories.lock);
+        result = is_dir ? push_directory(child, has_stat ? &st : NULL, &seen) : queue_file(child);
+        if (is_dir) pthread_cond_signal(&directories.changed);
+        pthread_mutex_unlock(&directories.lock);
+        if (seen && entry->d_type == DT_LNK)
+            fprintf(stderr, "%s: link to a directory already walked, skipped\n", child);
+    }
+
+    closedir(dir);
+    return result;
+}
+
+static void* walker(void* arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&directories.lock);
+    while (true)
+    {
+        // the walk is over once no directory is left and none is being read
+        while (directories.count == 0 && directories.walking > 0)
+            pthread_cond_wait(&directories.changed, &directories.lock);
+        if (directories.count == 0) break;
+
+        char* path = directories.paths[--directories.count];
+        directories.walking++;
+        pthread_mutex_unlock(&directories.lock);
+        bool result = walk_directory(path);
+        free(path);
+        pthread_mutex_lock(&directories.lock);
+        directories.failed |= !result;
+        directories.walking--;
+        pthread_cond_broadcast(&directories.changed);
+    }
+    pthread_mutex_unlock(&directories.lock);
+    return NULL;
+}
+
+static int compare_paths(const void* a, const void* b)
+{
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+// Walk the pushed directories with one walker per job: on a network share most of the time goes to
+// waiting for the server. The files are sorted, so runs do not depend on the order they were found in.
+static bool walk_directories(int jobs)
+{
+    pthread_t* threads = (pthread_t*)malloc(jobs * sizeof(pthread_t));
+    if (!threads) return false;
+    // all of them start: a walker waits for the subdirectories the others push, and they all stop
+    // together once none is left and none is being read
+    int started = 0;
+    for (; started < jobs; ++started)
+    {
+        if (pthread_create(&threads[started], NULL, walker, NULL) != 0) break;
+    }
+    if (started == 0) walker(NULL);
+    for (int i = 0; i < started; ++i)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    free(directories.paths);
+    directories.paths = NULL;
+    directories.capacity = 0;
+    free(directories.walked);
+    directories.walked = NULL;
+    directories.walked_count = directories.walked_capacity = 0;
+
+    if (queue.count > 1) qsort(queue.paths, queue.count, sizeof(char*), compare_paths);
+    bool result = !directories.failed;
+    directories.failed = false;
+    return result;
+}
+
+static int compare_archives(const void* a, const void* b)
+{
+    return strcmp(((const struct archive*)a)->path, ((const struct archive*)b)->path);
+}
+
+// Replace every queued archive by its .vgm and .vgz entries, read from its central directory. An archive that
+// cannot be read counts as a failed file. False if memory ran out.
+static bool expand_archives(void)
+{
+    size_t count = queue.count;
+    bool result = true, expanded = false;
+    for (size_t i = 0; result && i < count; ++i)
+    {
+        if (!is_archive(queue.paths[i])) continue;
+        expanded = true;
+
+        struct archive* tmp = (struct archive*)realloc(archives, (archive_count + 1) * sizeof(struct archive));
+        if (!tmp) return false;
+        archives = tmp;
+        struct archive* archive = &archives[archive_count];
+        if (!vgm_zip_open(&archive->zip, queue.paths[i]))
+        {
+            fprintf(stderr, "%s: cannot read the archive\n", queue.paths[i]);
+            atomic_fetch_add(&files_failed, 1);
+            free(queue.paths[i]);
+        }
+        else
+        {
+            archive->path = queue.paths[i];
+            archive_count++;
+            for (size_t j = 0; result && j < archive->zip.count; ++j)
+            {
+                const char* name = archive->zip.entries[j].name;
+                if (!is_vgm_file(name) || is_archive(name)) continue;
+                char path[4096];
+                snprintf(path, sizeof(path), "%s/%s", archive->path, name);
+                result = queue_file(path);
+            }
+        }
+        queue.paths[i] = NULL;
+    }
+    if (!expanded) return result;
+
+    size_t kept = 0;
+    for (size_t i = 0; i < queue.count; ++i)
+    {
+        if (queue.paths[i]) queue.paths[kept++] = queue.paths[i];
+    }
+    queue.count = kept;
+    if (queue.count > 1) qsort(queue.paths, queue.count, sizeof(char*), compare_paths);
+    if (archive_count > 1) qsort(archives, archive_count, sizeof(struct archive), compare_archives);
+    return result;
+}
+
+// The archive of a queued "<archive>/<entry name>" and the index of the entry, NULL for a file
+static struct archive* find_archive(const char* path, size_t* entry)
+{
+    for (const char* slash = strchr(path, '/'); slash && archive_count > 0; slash = strchr(slash + 1, '/'))
+    {
+        if (slash - path < 4 || strncasecmp(slash - 4, ".zip", 4) != 0) continue;
+
+        char prefix[4096];
+        snprintf(prefix, sizeof(prefix), "%.*s", (int)(slash - path), path);
+        struct archive key = { .path = prefix };
+        struct archive* archive = (struct archive*)bsearch(&key, archives, archive_count, sizeof(struct archive),
+            compare_archives);
+        if (archive && (*entry = vgm_zip_find(&archive->zip, slash + 1)) != SIZE_MAX) return archive;
+    }
+    return NULL;
+}
+
+static void close_archives(void)
+{
+    for (size_t i = 0; i < archive_count; ++i)
+    {
+        free(archives[i].path);
+        vgm_zip_close(&archives[i].zip);
+    }
+    free(archives);
+    archives = NULL;
+    archive_count = 0;
+}
+
+// mkdir -p
+static bool make_directories(char* path)
+{
+    for (char* p = path + 1; *p; ++p)
+    {
+        if (*p != '/') continue;
+        *p = '\0';
+        if (mkdir(path, 0755) == -1 && errno != EEXIST)
+        {
+            *p = '/';
+            return false;
+        }
+        *p = '/';
+    }
+    return mkdir(path, 0755) == 0 || errno == EEXIST;
+}
+
+// <output_dir>/<input path>, extension kept so a.vgm and a.vgz do not share (and -W remove) their blocks
+static void get_output_dir(const char* input, char* output, size_t size)
+{
+    while (*input == '/' || (input[0] == '.' && input[1] == '/')) input += *input == '/' ? 1 : 2;
+
+    snprintf(output, size, "%s/%s", options.output_dir, input);
+
+    // keep ".." from escaping the output directory
+    for (char* p = output; (p = strstr(p, "..")); p += 2) p[0] = p[1] = '_';
+}
+
+// -W: the blocks written for a file, before it is extracted again or once it is gone
+static void remove_outputs(const char* output_dir)
+{
+    DIR* dir = opendir(output_dir);
+    if (!dir) return;
+    struct dirent* entry;
+    while ((entry = readdir(dir)))
+    {
+        if (strncmp(entry->d_name, "block_", 6) != 0) continue;
+        char filename[4096 + 256];
+        snprintf(filename, sizeof(filename), "%s/%s", output_dir, entry->d_name);
+        remove(filename);
+    }
+    closedir(dir);
+}
+
+static int64_t get_mtime(const struct stat* st)
+{
+#if defined(__APPLE__)
+    return st->st_mtimespec.tv_sec * 1000000000ll + st->st_mtimespec.tv_nsec;
+#else
+    return st->st_mtim.tv_sec * 1000000000ll + st->st_mtim.tv_nsec;
+#endif
+}
+
+// One line per block: input file, block index, type, size, hash. NULL for a file without blocks.
+static bool format_manifest(const char* path, const struct VGMBlockList* list, char** text)
+{
+    *text = NULL;
+    if (list->count == 0) return true;
+    size_t line_size = strlen(path) + 64;
+    if (!(*text = (char*)malloc(list->count * line_size + 1))) return false;
+    size_t length = 0;
+    for (size_t i = 0; i < list->count; ++i)
+    {
+        const struct VGMDataBlock* block = &list->blocks[i];
+        length += snprintf(*text + length, line_size, "%s\t%zu\t%02x\t%u\t%016llx\n", path, i, block->type,
+            block->size, (unsigned long long)block->hash);
+    }
+    return true;
+}
+
+// The manifest lines of all files in path order, replaced at once so a reader never sees half of it
+static bool write_manifest(const struct file_result* results, size_t count)
+{
+    char filename[4096], temp_name[4096 + 8];
+    snprintf(filename, sizeof(filename), "%s/manifest.tsv", options.output_dir);
+    snprintf(temp_name, sizeof(temp_name), "%s.tmp", filename);
+    FILE* file = fopen(temp_name, "w");
+    bool result = file != NULL;
+    for (size_t i = 0; result && i < count; ++i)
+    {
+        if (results[i].manifest) result = fputs(results[i].manifest, file) >= 0;
+    }
+    if (file) result &= fclose(file) == 0;
+    result = result && rename(temp_name, filename) == 0;
+    if (!result)
+    {
+        remove(temp_name);
+        fprintf(stderr, "%s: error writing the manifest\n", filename);
+    }
+    return result;
+}
+
+// The hash at the end of every manifest line, only counted without hashes
+static size_t read_manifest_hashes(const char* manifest, uint64_t* hashes)
+{
+    size_t count = 0;
+    for (const char* end; manifest && (end = strchr(manifest, '\n')); manifest = end + 1)
+    {
+        if (hashes) hashes[count] = strtoull(end - 16, NULL, 16);
+        count++;
+    }
+    return count;
+}
+
+static int compare_hashes(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+static void free_results(struct file_result* results, size_t count)
+{
+    for (size_t i = 0; results && i < count; ++i)
+    {
+        free(results[i].manifest);
+    }
+    free(results);
+}
+
+static void write_json_string(FILE* file, const char* text)
+{
+    fputc('"', file);
+    for (const unsigned char* p = (const unsigned char*)text; *p; ++p)
+    {
+        if (*p == '"' || *p == '\\')
+            fprintf(file, "\\%c", *p);
+        else if (*p < 0x20)
+            fprintf(file, "\\u%04x", *p);
+        else
+            fputc(*p, file);
+    }
+    fputc('"', file);
+}
+
+static void write_stats(const char* path, const struct VGMBlockList* list, bool failed, bool cached, double seconds)
+{
+    pthread_mutex_lock(&stats_lock);
+    fputs("{\"file\":", stats);
+    write_json_string(stats, path);
+    fprintf(stats, ",\"ok\":%s,\"cached\":%s,\"blocks\":%zu,\"bytes_in\":%llu,\"bytes_out\":%llu,\"bytes_reused\":%llu",
+        failed ? "false" : "true", cached ? "true" : "false", list->count, (unsigned long long)list->bytes_in,
+        (unsigned long long)list->bytes_out, (unsigned long long)list->bytes_reused);
+    fprintf(stats, ",\"seconds\":{\"total\":%.6f", seconds);
+    for (int i = 0; i < VGM_PHASE_COUNT; ++i)
+    {
+        fprintf(stats, ",\"%s\":%.6f", get_phase_name(i), list->stats.seconds[i]);
+    }
+    fprintf(stats, "},\"allocations\":%zu,\"peak_heap\":%zu}\n", list->stats.allocations, list->stats.peak_heap);
+    pthread_mutex_unlock(&stats_lock);
+}
+
+// -b: the block is kept in memory, then written as <output_dir>/block_N.raw
+static void write_single_block(struct VGMBlockList* list, const char* output_dir)
+{
+    size_t size;
+    const uint8_t* data = list->count > 0 ? get_block_data(list, 0, &size) : NULL;
+    if (!data) return;
+
+    char filename[4096 + 32];
+    snprintf(filename, sizeof(filename), "%s/block_%ld.raw", output_dir, options.block);
+    FILE* file = fopen(filename, "wb");
+    bool result = file && fwrite(data, 1, size, file) == size;
+    if (file) result &= fclose(file) == 0;
+    if (!result)
+        snprintf(list->error, sizeof(list->error), "Error writing block_%ld.raw\n", options.block);
+    list->bytes_out = result ? size : 0;
+}
+
+// -b on a file without an index: the list holds every block of the file, block N becomes its only one.
+// Nothing is kept from a file that failed.
+static bool keep_single_block(struct VGMBlockList* list, const char* path, bool extracted)
+{
+    if (extracted && (size_t)options.block >= list->count)
+        snprintf(list->error, sizeof(list->error), "\"%s\" has no block %ld\n", path, options.block);
+    if (!extracted || list->error[0])
+    {
+        list->count = 0;
+        list->bytes_out = 0;
+        return false;
+    }
+    list->blocks[0] = list->blocks[options.block];
+    list->count = 1;
+    return true;
+}
+
+static void init_list(struct VGMBlockList* list, const char* output_dir)
+{
+    list->recovery = options.recovery;
+    list->output_dir = output_dir;
+    if (options.dedup) list->store_dir = store_dir;
+    list->pack = pack;
+    list->gz_index = options.gz_index;
+    list->in_memory = options.block >= 0 || options.wav;
+    list->cache = cache;
+    list->filter = options.filter;
+    list->merge_roms = options.merge_roms;
+    list->list_only = catalog != NULL;
+}
+
+// -i: the header, tag and blocks of a file just scanned go into the catalog
+static bool add_to_catalog(const char* path, const struct vgm_cache_key* key, const struct VGMBlockList* list)
+{
+    struct vgm_catalog_block* blocks = (struct vgm_catalog_block*)malloc((list->count ? list->count : 1) *
+        sizeof(struct vgm_catalog_block));
+    if (!blocks) return false;
+    for (size_t i = 0; i < list->count; ++i)
+    {
+        blocks[i].hash = list->blocks[i].hash;
+        blocks[i].size = list->blocks[i].size;
+        blocks[i].type = (uint8_t)list->blocks[i].type;
+    }
+    bool result = vgm_catalog_add(catalog, path, key, list->tag, blocks, list->count);
+    free(blocks);
+    return result;
+}
+
+static void write_wav_block(struct wav_file* file, size_t index)
+{
+    struct VGMBlockList* list = &file->list;
+    uint8_t type = list->blocks[index].type;
+    size_t size;
+    const uint8_t* data = get_block_data(list, index, &size);
+    if (!data || vgm_pcm_get_format(type) == VGM_PCM_NONE) return;
+
+    char filename[4096 + 32];
+    snprintf(filename, sizeof(filename), "%s/block_%zu.wav", file->output_dir, index);
+    FILE* output = fopen(filename, "wb");
+    bool result = output && vgm_pcm_write_wav(output, type, data, size, options.rate ? options.rate : vgm_pcm_get_rate(type));
+    if (output) result &= fclose(output) == 0;
+    if (!result)
+    {
+        fprintf(stderr, "%s: error writing %s\n", file->path, filename);
+        if (!atomic_exchange(&file->failed, true)) atomic_fetch_add(&files_failed, 1);
+        return;
+    }
+    atomic_fetch_add(&blocks_converted, 1);
+    atomic_fetch_add(&bytes_out, VGM_PCM_WAV_HEADER_SIZE + vgm_pcm_get_sample_count(vgm_pcm_get_format(type), size) * 2);
+}
+
+// Convert a block of any file waiting for it, false if there is none
+static bool convert_next_block(void)
+{
+    pthread_mutex_lock(&wav_lock);
+    struct wav_file* file = wav_files;
+    while (file && file->next == file->list.count) file = file->next_file;
+    size_t index = file ? file->next++ : 0;
+    pthread_mutex_unlock(&wav_lock);
+    if (!file) return false;
+
+    write_wav_block(file, index);
+    if (atomic_fetch_sub(&file->left, 1) > 1) return true;
+
+    pthread_mutex_lock(&wav_lock);
+    struct wav_file** link = &wav_files;
+    while (*link != file) link = &(*link)->next_file;
+    *link = file->next_file;
+    pthread_mutex_unlock(&wav_lock);
+    free_block_list(&file->list);
+    free(file);
+    return true;
+}
+
+// Hand the blocks of a file over to every worker, the list is replaced by an empty one
+static bool queue_wav_file(struct VGMBlockList* list, const char* path, const char* output_dir)
+{
+    struct wav_file* file = (struct wav_file*)calloc(1, sizeof(struct wav_file));
+    if (!file) return false;
+    file->list = *list;
+    file->path = path;
+    snprintf(file->output_dir, sizeof(file->output_dir), "%s", output_dir);
+    atomic_init(&file->left, list->count);
+    atomic_init(&file->failed, false);
+
+    const char* list_output_dir = list->output_dir;
+    memset(list, 0, sizeof(*list));
+    init_list(list, list_output_dir);
+
+    pthread_mutex_lock(&wav_lock);
+    file->next_file = wav_files;
+    wav_files = file;
+    pthread_mutex_unlock(&wav_lock);
+    return true;
+}
+
+// One line per warning, prefixed like errors. The lines go out in one write so workers do not mix them.
+static void print_warnings(const char* path, const struct VGMBlockList* list)
+{
+    char text[4096];
+    size_t length = 0;
+    size_t shown = 0;
+    for (const char* line = list->warnings; *line && length < sizeof(text); ++shown)
+    {
+        const char* end = strchr(line, '\n');
+        length += snprintf(text + length, sizeof(text) - length, "%s: %.*s\n", path, (int)(end - line), line);
+        line = end + 1;
+    }
+    if (shown < list->warning_count && length < sizeof(text))
+        snprintf(text + length, sizeof(text) - length, "%s: %zu more warnings\n", path, list->warning_count - shown);
+    fputs(text, stderr);
+}
+
+static void* worker(void* arg)
+{
+    struct VGMBlockList list = { 0 };
+    char output_dir[4096] = "";
+    init_list(&list, output_dir);
+    if (catalog && !(list.tag = (struct vgm_tag*)malloc(sizeof(struct vgm_tag))))
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        atomic_fetch_add(&files_failed, 1);
+        return NULL;
+    }
+
+    // blocks waiting for a conversion come first, so no more files are held than there are workers
+    while (true)
+    {
+        if (options.wav && convert_next_block()) continue;
+        size_t i = atomic_fetch_add(&queue.next, 1);
+        if (i >= queue.count) break;
+
+        const char* path = queue.paths[i];
+        struct file_result* result = &queue.results[i];
+        size_t entry = 0;
+        struct archive* archive = find_archive(path, &entry);
+        get_output_dir(path, output_dir, sizeof(output_dir));
+        if (!options.dedup && !pack && !catalog && !make_directories(output_dir))
+        {
+            fprintf(stderr, "%s: cannot create directory %s\n", path, output_dir);
+            atomic_fetch_add(&files_failed, 1);
+            continue;
+        }
+
+        // taken before the file is read, a change made while it is read is seen next time. The entries of an
+        // archive all change with it.
+        struct stat st;
+        if (options.watch && stat(archive ? archive->path : path, &st) == 0)
+        {
+            result->mtime = get_mtime(&st);
+            result->size = st.st_size;
+        }
+        if (updating && !options.dedup && !catalog) remove_outputs(output_dir);
+
+        list.bytes_in = list.bytes_out = list.bytes_reused = 0;
+        list.cache_hits = 0;
+        clear_block_list_stats(&list);
+        double start = get_time_monotonic();
+        struct vgm_cache_key key;
+        if (catalog && archive)
+            vgm_cache_get_entry_key(&archive->zip.entries[entry], options.recovery, &key);
+        if (catalog && !archive && !vgm_cache_get_key(path, options.recovery, &key))
+        {
+            snprintf(list.error, sizeof(list.error), "Error opening file \"%s\"\n", path);
+        }
+        else if (catalog && vgm_catalog_add_unchanged(catalog, path, &key))
+        {
+            list.cache_hits++;
+        }
+        else if (options.block >= 0 && (archive || !is_vgz_file(path)))
+        {
+            // no index to start from: the whole file is scanned in memory, only block N is kept
+            bool extracted = archive ? extract_zip_entry(&list, &archive->zip, entry, path) : extract_file(&list, path);
+            if (keep_single_block(&list, path, extracted))
+                write_single_block(&list, output_dir);
+        }
+        else if (options.block >= 0)
+        {
+            if (extract_vgz_block(&list, path, options.block))
+                write_single_block(&list, output_dir);
+        }
+        else
+        {
+            if (archive)
+                extract_zip_entry(&list, &archive->zip, entry, path);
+            else
+                extract_file(&list, path);
+            if (catalog && !list.error[0] && !add_to_catalog(path, &key, &list))
+                snprintf(list.error, sizeof(list.error), "Memory allocation failed\n");
+        }
+        sync_block_list(&list);
+        double seconds = get_time_monotonic() - start;
+        bool failed = list.error[0] != '\0';
+        if (failed)
+        {
+            fprintf(stderr, "%s: %s", path, list.error);
+            if (list.error[strlen(list.error) - 1] != '\n') fputc('\n', stderr);
+            clear_block_list_error(&list);
+            atomic_fetch_add(&files_failed, 1);
+            result->failed = true;
+        }
+        if (list.warning_count)
+        {
+            print_warnings(path, &list);
+            clear_block_list_warnings(&list);
+        }
+
+        atomic_fetch_add(&files_done, 1);
+        atomic_fetch_add(&files_cached, list.cache_hits);
+        atomic_fetch_add(&blocks_found, list.count);
+        atomic_fetch_add(&bytes_in, list.bytes_in);
+        atomic_fetch_add(&bytes_out, list.bytes_out);
+        atomic_fetch_add(&bytes_reused, list.bytes_reused);
+        if (options.dedup && !format_manifest(path, &list, &result->manifest))
+        {
+            fprintf(stderr, "%s: Memory allocation failed\n", path);
+            atomic_fetch_add(&files_failed, 1);
+        }
+        if (stats) write_stats(path, &list, failed, list.cache_hits > 0, seconds);
+        if (options.wav && list.count > 0 && !queue_wav_file(&list, path, output_dir))
+        {
+            fprintf(stderr, "%s: Memory allocation failed\n", path);
+            atomic_fetch_add(&files_failed, 1);
+        }
+        reset_block_list(&list);
+    }
+
+    free_block_list(&list);
+    free(list.tag);
+    return NULL;
+}
+
+// Process the queued files with up to one worker per job, the number of threads started, -1 if memory ran out
+static int run_workers(void)
+{
+    if (!(queue.results = (struct file_result*)calloc(queue.count ? queue.count : 1, sizeof(struct file_result))))
+        return -1;
+    atomic_store(&queue.next, 0);
+
+    int jobs = (size_t)options.jobs > queue.count ? (int)queue.count : options.jobs;
+    pthread_t* threads = (pthread_t*)malloc((jobs ? jobs : 1) * sizeof(pthread_t));
+    if (!threads) return -1;
+    int started = 0;
+    for (; started < jobs; ++started)
+    {
+        if (pthread_create(&threads[started], NULL, worker, NULL) != 0) break;
+    }
+    if (started == 0) worker(NULL);
+    for (int i = 0; i < started; ++i)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    return started;
+}
+
+// -q: the files of the catalog matching every term, one per line with their game and track
+static int run_query(int count, char** terms)
+{
+    struct vgm_catalog_query query = { 0 };
+    for (int i = 0; i < count; ++i)
+    {
+        if (!vgm_catalog_parse_query(&query, terms[i]))
+        {
+            fprintf(stderr, "invalid query term: %s\n", terms[i]);
+            return 1;
+        }
+    }
+
+    struct vgm_catalog_reader reader;
+    if (!vgm_catalog_open(&reader, options.query_file))
+    {
+        fprintf(stderr, "cannot read catalog %s\n", options.query_file);
+        return 1;
+    }
+    double start = get_time_monotonic();
+    size_t* matches;
+    size_t match_count;
+    if (!vgm_catalog_query(&reader, &query, &matches, &match_count))
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        vgm_catalog_close(&reader);
+        return 1;
+    }
+    double elapsed = get_time_monotonic() - start;
+
+    for (size_t i = 0; i < match_count; ++i)
+    {
+        struct vgm_catalog_file file;
+        if (vgm_catalog_get(&reader, matches[i], &file))
+            printf("%s\t%s\t%s\n", file.path, file.gd3[VGM_GD3_GAME], file.gd3[VGM_GD3_TRACK]);
+    }
+    fprintf(stderr, "%zu of %zu files match, %.3f ms\n", match_count, vgm_catalog_count(&reader), elapsed * 1e3);
+    free(matches);
+    vgm_catalog_close(&reader);
+    return 0;
+}
+
+// Index of the first path not sorted before this one
+static size_t find_path(char* const* paths, size_t count, const char* path)
+{
+    size_t low = 0, high = count;
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        if (strcmp(paths[middle], path) < 0)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+// -W: a file given on the command line, or a VGM file somewhere under a directory given
+static bool is_input(const char* path)
+{
+    for (int i = 0; i < options.input_count; ++i)
+    {
+        const char* input = options.inputs[i];
+        size_t length = strlen(input);
+        if (strncmp(path, input, length) != 0) continue;
+        if (path[length] == '\0') return true;
+        if ((path[length] == '/' || input[length - 1] == '/') && is_vgm_file(path)) return true;
+    }
+    return false;
+}
+
+static void on_change(void* user, enum vgm_watch_event event, const char* path)
+{
+    (void)user;
+    if (event == VGM_WATCH_LOST)
+    {
+        events_lost = true;
+        return;
+    }
+    // a file given without a directory is watched through "."
+    for (int i = 0; strncmp(path, "./", 2) == 0 && i < options.input_count; ++i)
+    {
+        if (strcmp(path + 2, options.inputs[i]) == 0) path += 2;
+    }
+
+    bool result = true;
+    struct stat st;
+    if (event == VGM_WATCH_DIRECTORY)
+        result = push_directory(path, stat(path, &st) == 0 ? &st : NULL, NULL);
+    else if (event == VGM_WATCH_REMOVED || is_vgm_file(path) || is_input(path))
+        result = queue_file(path); // a path removed may be a directory holding files of the library
+    // a change that cannot be queued is found by comparing every file
+    if (!result) events_lost = true;
+}
+
+// -W: watch the directory of every file given, the directories given are watched as they are walked
+static void watch_input_files(void)
+{
+    for (int i = 0; watch && i < options.input_count; ++i)
+    {
+        struct stat st;
+        if (stat(options.inputs[i], &st) == -1 || S_ISDIR(st.st_mode)) continue;
+
+        char parent[4096];
+        snprintf(parent, sizeof(parent), "%s", options.inputs[i]);
+        char* slash = strrchr(parent, '/');
+        if (slash)
+            slash[slash == parent] = '\0';
+        else
+            strcpy(parent, ".");
+        if (!vgm_watch_add(watch, parent)) atomic_store(&watch_full, true);
+    }
+}
+
+// -W: queue every input and every file of the library, whose modification times show what changed
+static bool sweep(void)
+{
+    bool result = true;
+    for (int i = 0; result && i < options.input_count; ++i)
+    {
+        struct stat st;
+        if (stat(options.inputs[i], &st) == 0)
+            result = S_ISDIR(st.st_mode) ? push_directory(options.inputs[i], &st, NULL) :
+                queue_file(options.inputs[i]);
+    }
+    for (size_t i = 0; result && i < library.count; ++i)
+    {
+        // the entries of an archive are compared through it, those of an archive that is gone by themselves
+        char path[4096];
+        snprintf(path, sizeof(path), "%s", library.paths[i]);
+        struct stat st;
+        for (char* slash = strchr(path, '/'); slash; slash = strchr(slash + 1, '/'))
+        {
+            *slash = '\0';
+            if (is_archive(path) && stat(path, &st) == 0 && S_ISREG(st.st_mode)) break;
+            *slash = '/';
+        }
+        result = queue_file(path);
+    }
+    return walk_directories(options.jobs) && result;
+}
+
+// -W: the outputs of a file that is gone
+static void remove_file(const char* path)
+{
+    if (!options.dedup && !options.catalog_file)
+    {
+        char output_dir[4096];
+        get_output_dir(path, output_dir, sizeof(output_dir));
+        remove_outputs(output_dir);
+        // directories left empty go too, up to the output directory
+        size_t root_length = strlen(options.output_dir);
+        for (char* slash; rmdir(output_dir) == 0 && (slash = strrchr(output_dir, '/')) &&
+            (size_t)(slash - output_dir) > root_length;)
+            *slash = '\0';
+    }
+    if (options.gz_index)
+    {
+        char index_name[4096 + 8];
+        snprintf(index_name, sizeof(index_name), "%s.idx", path);
+        remove(index_name);
+    }
+    if (cache) vgm_cache_remove(cache, path);
+}
+
+// -W -d: the stored blocks of files extracted again or gone that no file lists anymore
+static void remove_unused_blocks(char** manifests, size_t manifest_count)
+{
+    size_t count = 0, unused_count = 0;
+    for (size_t i = 0; i < library.count; ++i)
+    {
+        count += read_manifest_hashes(library.results[i].manifest, NULL);
+    }
+    for (size_t i = 0; i < manifest_count; ++i)
+    {
+        unused_count += read_manifest_hashes(manifests[i], NULL);
+    }
+    // without memory the blocks stay, they only take space
+    uint64_t* hashes = (uint64_t*)malloc((count ? count : 1) * sizeof(uint64_t));
+    uint64_t* unused = (uint64_t*)malloc((unused_count ? unused_count : 1) * sizeof(uint64_t));
+    if (hashes && unused)
+    {
+        count = 0;
+        for (size_t i = 0; i < library.count; ++i)
+        {
+            count += read_manifest_hashes(library.results[i].manifest, hashes + count);
+        }
+        unused_count = 0;
+        for (size_t i = 0; i < manifest_count; ++i)
+        {
+            unused_count += read_manifest_hashes(manifests[i], unused + unused_count);
+        }
+        qsort(hashes, count, sizeof(uint64_t), compare_hashes);
+        for (size_t i = 0; i < unused_count; ++i)
+        {
+            if (bsearch(&unused[i], hashes, count, sizeof(uint64_t), compare_hashes)) continue;
+            char filename[4096 + 32];
+            snprintf(filename, sizeof(filename), "%s/%016llx.raw", store_dir, (unsigned long long)unused[i]);
+            remove(filename);
+        }
+    }
+    free(hashes);
+    free(unused);
+}
+
+// -W: an archive new or changed since its entries were extracted. Those entries are marked removed, the ones
+// still in it once it is expanded again are extracted instead.
+static bool is_archive_changed(const char* path, const struct stat* st, bool* removed, size_t* removed_count)
+{
+    char prefix[4096];
+    snprintf(prefix, sizeof(prefix), "%s/", path);
+    size_t length = strlen(prefix);
+    size_t first = find_path(library.paths, library.count, prefix), end = first;
+    while (end < library.count && strncmp(library.paths[end], prefix, length) == 0) end++;
+    if (end == first ? !is_input(path) :
+        library.results[first].mtime == get_mtime(st) && library.results[first].size == st->st_size)
+        return false;
+
+    for (size_t i = first; i < end; ++i)
+    {
+        if (!removed[i]) (*removed_count)++;
+        removed[i] = true;
+    }
+    return true;
+}
+
+// -W: extract the queued files that are new or changed since they were processed, remove the outputs of
+// those that are gone and of the library files under a directory or in an archive that is gone
+static void update_library(void)
+{
+    double start = get_time_monotonic();
+    files_done = files_failed = files_cached = blocks_found = blocks_converted = 0;
+    bytes_in = bytes_out = bytes_reused = 0;
+
+    // a path with several events is looked at once
+    if (queue.count > 1) qsort(queue.paths, queue.count, sizeof(char*), compare_paths);
+    size_t kept = 0;
+    for (size_t i = 0; i < queue.count; ++i)
+    {
+        if (kept > 0 && strcmp(queue.paths[kept - 1], queue.paths[i]) == 0)
+            free(queue.paths[i]);
+        else
+            queue.paths[kept++] = queue.paths[i];
+    }
+    queue.count = kept;
+
+    bool* removed = (bool*)calloc(library.count ? library.count : 1, sizeof(bool));
+    size_t removed_count = 0;
+    kept = 0;
+    for (size_t i = 0; removed && i < queue.count; ++i)
+    {
+        char* path = queue.paths[i];
+        size_t index = find_path(library.paths, library.count, path);
+        bool known = index < library.count && strcmp(library.paths[index], path) == 0;
+        struct stat st;
+        if (stat(path, &st) == 0)
+        {
+            bool changed = S_ISREG(st.st_mode) && is_archive(path) ?
+                is_archive_changed(path, &st, removed, &removed_count) :
+                S_ISREG(st.st_mode) && (known ? library.results[index].mtime != get_mtime(&st) ||
+                library.results[index].size != st.st_size : is_input(path));
+            if (changed)
+            {
+                queue.paths[kept++] = path;
+                continue;
+            }
+        }
+        else
+        {
+            size_t length = strlen(path);
+            for (size_t j = index; j < library.count && strncmp(library.paths[j], path, length) == 0; ++j)
+            {
+                char next = library.paths[j][length];
+                if ((next == '\0' || next == '/') && !removed[j])
+                {
+                    removed[j] = true;
+                    removed_count++;
+                }
+            }
+        }
+        free(path);
+    }
+    queue.count = kept;
+
+    // entries still in a changed archive are extracted again rather than removed
+    if (removed && !expand_archives())
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        events_lost = true;
+    }
+    for (size_t i = 0; removed && i < library.count; ++i)
+    {
+        size_t index = find_path(queue.paths, queue.count, library.paths[i]);
+        if (removed[i] && index < queue.count && strcmp(queue.paths[index], library.paths[i]) == 0)
+        {
+            removed[i] = false;
+            removed_count--;
+        }
+    }
+    if (removed && queue.count == 0 && removed_count == 0)
+    {
+        close_archives();
+        free(removed);
+        return;
+    }
+
+    // the merged library is allocated first, so a failure leaves the old one as it was
+    size_t capacity = library.count + queue.count;
+    char** paths = removed ? (char**)malloc((capacity ? capacity : 1) * sizeof(char*)) : NULL;
+    struct file_result* results = paths ?
+        (struct file_result*)malloc((capacity ? capacity : 1) * sizeof(struct file_result)) : NULL;
+    char** dropped = results ? (char**)malloc((library.count ? library.count : 1) * sizeof(char*)) : NULL;
+    if (!dropped || (options.catalog_file && !(catalog = vgm_catalog_create(&previous_catalog))))
+    {
+        // every file is compared again once memory is back
+        fprintf(stderr, "Memory allocation failed\n");
+        for (size_t i = 0; i < queue.count; ++i)
+        {
+            free(queue.paths[i]);
+        }
+        queue.count = 0;
+        close_archives();
+        free(dropped);
+        free(results);
+        free(paths);
+        free(removed);
+        events_lost = true;
+        return;
+    }
+
+    // files left alone are taken from the catalog as they are, any missing from it are indexed again
+    // unless they failed to be
+    size_t changed_count = queue.count;
+    for (size_t i = 0; catalog && i < library.count; ++i)
+    {
+        size_t index = find_path(queue.paths, changed_count, library.paths[i]);
+        if (removed[i] || library.results[i].failed ||
+            (index < changed_count && strcmp(queue.paths[index], library.paths[i]) == 0))
+            continue;
+        if (!vgm_catalog_add_unchanged(catalog, library.paths[i], NULL) && !queue_file(library.paths[i]))
+            fprintf(stderr, "%s: Memory allocation failed\n", library.paths[i]);
+    }
+    if (queue.count > 1) qsort(queue.paths, queue.count, sizeof(char*), compare_paths);
+
+    updating = true;
+    if (run_workers() < 0)
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        files_failed = queue.count;
+    }
+    close_archives();
+
+    for (size_t i = 0; i < library.count; ++i)
+    {
+        if (removed[i]) remove_file(library.paths[i]);
+    }
+    if (catalog)
+    {
+        if (!vgm_catalog_finish(catalog, options.catalog_file))
+        {
+            fprintf(stderr, "%s: error writing the catalog\n", options.catalog_file);
+            files_failed++;
+        }
+        catalog = NULL;
+        vgm_catalog_close(&previous_catalog);
+        vgm_catalog_open(&previous_catalog, options.catalog_file);
+    }
+
+    // a file extracted again replaces its entry, a file that is gone leaves
+    size_t count = 0, dropped_count = 0, i = 0, j = 0;
+    while (i < library.count || j < queue.count)
+    {
+        int order = i == library.count ? 1 : j == queue.count ? -1 : strcmp(library.paths[i], queue.paths[j]);
+        if (order <= 0)
+        {
+            if (order == 0 || removed[i])
+            {
+                free(library.paths[i]);
+                dropped[dropped_count++] = library.results[i].manifest;
+            }
+            else
+            {
+                paths[count] = library.paths[i];
+                results[count++] = library.results[i];
+            }
+            i++;
+        }
+        if (order >= 0)
+        {
+            paths[count] = queue.paths[j];
+            results[count++] = queue.results ? queue.results[j] : (struct file_result){ 0 };
+            j++;
+        }
+    }
+    free(library.paths);
+    free(library.results);
+    library.paths = paths;
+    library.results = results;
+    library.count = count;
+    free(queue.results);
+    queue.results = NULL;
+    queue.count = 0;
+    free(removed);
+
+    if (options.dedup && !write_manifest(library.results, library.count))
+        files_failed++;
+    if (options.dedup) remove_unused_blocks(dropped, dropped_count);
+    for (i = 0; i < dropped_count; ++i)
+    {
+        free(dropped[i]);
+    }
+    free(dropped);
+    if (cache && !vgm_cache_save(cache))
+        fprintf(stderr, "%s: error writing the cache\n", options.cache_file);
+    if (stats) fflush(stats);
+
+    printf("%zu files updated (%zu failed), %zu removed, %zu blocks, %.3f s\n", (size_t)files_done,
+        (size_t)files_failed, removed_count, (size_t)blocks_found, get_time_monotonic() - start);
+    fflush(stdout);
+}
+
+static void stop_watching(int signal)
+{
+    (void)signal;
+    stopping = 1;
+}
+
+// Fall back to comparing modification times
+static void close_watch(const char* reason)
+{
+    fprintf(stderr, "%s, comparing modification times every %.0f s instead\n", reason, WATCH_SWEEP_SECONDS);
+    vgm_watch_destroy(watch);
+    watch = NULL;
+}
+
+// -W: update the library after every burst of changes until interrupted
+static void watch_library(void)
+{
+    if (!watch) close_watch("inotify is not available");
+    printf("watching for changes, Ctrl+C to stop\n");
+    fflush(stdout);
+
+    double last_change = get_time_monotonic();
+    double next_sweep = last_change + WATCH_SWEEP_SECONDS;
+    bool sweep_due = false;
+    while (!stopping)
+    {
+        if (watch && atomic_load(&watch_full))
+        {
+            close_watch("out of inotify watches (see fs.inotify.max_user_watches)");
+            sweep_due = true;
+        }
+        if (events_lost)
+        {
+            fprintf(stderr, "changes were lost, comparing modification times\n");
+            events_lost = false;
+            sweep_due = true;
+        }
+
+        double now = get_time_monotonic();
+        if (!watch && now >= next_sweep)
+        {
+            sweep_due = true;
+            next_sweep = now + WATCH_SWEEP_SECONDS;
+        }
+        bool pending = queue.count > 0 || sweep_due;
+        if (pending && now - last_change >= WATCH_DEBOUNCE_SECONDS)
+        {
+            if (sweep_due) sweep();
+            sweep_due = false;
+            update_library();
+            continue;
+        }
+
+        double until = pending ? last_change + WATCH_DEBOUNCE_SECONDS : next_sweep;
+        int timeout = pending || !watch ? (int)((until - now) * 1000) + 1 : -1;
+        if (!watch)
+        {
+            poll(NULL, 0, timeout);
+            continue;
+        }
+        int events = vgm_watch_read(watch, timeout, on_change, NULL);
+        if (events < 0)
+        {
+            close_watch("error reading inotify events");
+            sweep_due = true;
+        }
+        if (events > 0) last_change = get_time_monotonic();
+        // new directories are walked at once, their files are queued and the directories watched
+        if (directories.count > 0) walk_directories(options.jobs);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "j:o:p:b:c:s:t:R:i:q:rdzmwWh")) != -1)
+    {
+        switch (opt)
+        {
+        case 'j': options.jobs = atoi(optarg); break;
+        case 'o': options.output_dir = optarg; break;
+        case 'r': options.recovery = true; break;
+        case 'd': options.dedup = true; break;
+        case 'p': options.pack_file = optarg; break;
+        case 'z': options.gz_index = true; break;
+        case 'b': options.block = atol(optarg); break;
+        case 'c': options.cache_file = optarg; break;
+        case 's': options.stats_file = optarg; break;
+        case 't':
+            if (!vgm_type_filter_parse(&type_filter, optarg))
+            {
+                fprintf(stderr, "invalid block types: %s\n", optarg);
+                return 1;
+            }
+            options.filter = &type_filter;
+            break;
+        case 'm': options.merge_roms = true; break;
+        case 'w': options.wav = true; break;
+        case 'R': options.rate = (uint32_t)atol(optarg); break;
+        case 'i': options.catalog_file = optarg; break;
+        case 'q': options.query_file = optarg; break;
+        case 'W': options.watch = true; break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (options.query_file)
+        return run_query(argc - optind, argv + optind);
+
+    if (optind >= argc || (options.dedup && options.pack_file) ||
+        (options.block >= 0 &&
+            (options.dedup || options.pack_file || options.gz_index || options.filter || options.merge_roms)) ||
+        (options.wav && (options.dedup || options.pack_file || options.block >= 0)) ||
+        (options.catalog_file && (options.dedup || options.pack_file || options.block >= 0 || options.cache_file ||
+            options.filter || options.merge_roms || options.wav)) ||
+        (options.watch && options.pack_file))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    options.inputs = argv + optind;
+    options.input_count = argc - optind;
+    if (options.watch)
+    {
+        // an interrupted update is finished before stopping
+        struct sigaction action = { 0 };
+        action.sa_handler = stop_watching;
+        sigaction(SIGINT, &action, NULL);
+        sigaction(SIGTERM, &action, NULL);
+        watch = vgm_watch_create();
+        watch_input_files();
+    }
+
+    for (int i = optind; i < argc; ++i)
+    {
+        struct stat st;
+        if (stat(argv[i], &st) == -1)
+        {
+            fprintf(stderr, "%s: %s\n", argv[i], strerror(errno));
+            return 1;
+        }
+        if (!(S_ISDIR(st.st_mode) ? push_directory(argv[i], &st, NULL) : queue_file(argv[i])))
+            return 1;
+    }
+
+    if (options.jobs <= 0)
+        options.jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (options.jobs <= 0)
+        options.jobs = 1;
+    if (!walk_directories(options.jobs))
+        return 1;
+    if (!expand_archives())
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 1;
+    }
+
+    if (options.dedup)
+    {
+        snprintf(store_dir, sizeof(store_dir), "%s/blocks", options.output_dir);
+        if (!make_directories(store_dir))
+        {
+            fprintf(stderr, "cannot create %s\n", store_dir);
+            return 1;
+        }
+    }
+
+    if (options.pack_file && !(pack = vgm_pack_create(options.pack_file)))
+    {
+        fprintf(stderr, "cannot create %s\n", options.pack_file);
+        return 1;
+    }
+
+    if (options.cache_file && !(cache = vgm_cache_open(options.cache_file)))
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 1;
+    }
+
+    // a missing or damaged catalog is built from scratch
+    if (options.catalog_file)
+    {
+        vgm_catalog_open(&previous_catalog, options.catalog_file);
+        if (!(catalog = vgm_catalog_create(&previous_catalog)))
+        {
+            fprintf(stderr, "Memory allocation failed\n");
+            return 1;
+        }
+    }
+
+    if (options.stats_file && !(stats = fopen(options.stats_file, "w")))
+    {
+        fprintf(stderr, "cannot create %s\n", options.stats_file);
+        return 1;
+    }
+
+    double start = get_time_monotonic();
+
+    int started = run_workers();
+    if (started < 0)
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        return 1;
+    }
+
+    double elapsed = get_time_monotonic() - start;
+    if (elapsed <= 0) elapsed = 1e-9;
+    close_archives();
+
+    if (options.dedup && !write_manifest(queue.results, queue.count))
+        files_failed++;
+    if (stats) fflush(stats);
+    if (cache && !vgm_cache_save(cache))
+        fprintf(stderr, "%s: error writing the cache\n", options.cache_file);
+    if (pack && !vgm_pack_finish(pack))
+    {
+        fprintf(stderr, "%s: error writing the pack index\n", options.pack_file);
+        files_failed++;
+    }
+    if (catalog && !vgm_catalog_finish(catalog, options.catalog_file))
+    {
+        fprintf(stderr, "%s: error writing the catalog\n", options.catalog_file);
+        files_failed++;
+    }
+    catalog = NULL;
+
+    printf("%zu files (%zu failed), %zu blocks, %.1f MB in, %.1f MB out\n",
+        (size_t)files_done, (size_t)files_failed, (size_t)blocks_found, bytes_in / 1e6, bytes_out / 1e6);
+    if (options.dedup)
+        printf("%.1f MB of duplicate blocks not stored again\n", bytes_reused / 1e6);
+    if (cache)
+        printf("%zu unchanged files taken from the cache\n", (size_t)files_cached);
+    if (options.catalog_file)
+        printf("%zu unchanged files taken from the catalog\n", (size_t)files_cached);
+    if (options.wav)
+        printf("%zu blocks decoded to WAV\n", (size_t)blocks_converted);
+    printf("%.3f s with %d threads: %.1f files/s, %.1f MB/s\n",
+        elapsed, started ? started : 1, files_done / elapsed, bytes_in / 1e6 / elapsed);
+    int status = files_failed ? 1 : 0;
+
+    // the files processed become the library, changes to it are processed from now on
+    if (options.watch)
+    {
+        fflush(stdout);
+        library.paths = queue.paths;
+        library.results = queue.results;
+        library.count = queue.count;
+        memset(&queue, 0, sizeof(queue));
+        if (options.catalog_file)
+        {
+            vgm_catalog_close(&previous_catalog);
+            vgm_catalog_open(&previous_catalog, options.catalog_file);
+        }
+        watch_library();
+        vgm_watch_destroy(watch);
+        // changes still waiting for their burst to end are dropped
+        for (size_t i = 0; i < queue.count; ++i)
+        {
+            free(queue.paths[i]);
+        }
+        free(queue.paths);
+        queue = (struct file_queue){ .paths = library.paths, .results = library.results, .count = library.count };
+        status = 0;
+    }
+
+    if (stats) fclose(stats);
+    vgm_cache_close(cache);
+    vgm_catalog_close(&previous_catalog);
+    for (size_t i = 0; i < queue.count; ++i)
+    {
+        free(queue.paths[i]);
+    }
+    free(queue.paths);
+    free_results(queue.results, queue.count);
+
+    return status;
+}
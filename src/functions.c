@@ -7,16 +7,21 @@
 #endif
 
 #include "functions.h"
+#include "vgmwave.h"
 
 #include <string.h>
 #define GUI_FILE_DIALOGS_IMPLEMENTATION
 #include "gui_file_dialogs.h"               // GUI: File Dialogs
 
+#include <math.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 
 #define MAX_ERRORS 5
+#define LIST_ROW_HEIGHT 24
+#define WAVE_LABEL_HEIGHT 20
+#define WAVE_MIN_SCALE (1.0 / 16)          // samples per pixel, fully zoomed in
 
 // control status
 static int timeout = 0;
@@ -114,6 +119,17 @@ int show_button(Rectangle bounds, const char *text)
 	return GuiButton(bounds, text);
 }
 
+int show_check_box(Rectangle bounds, const char *text, bool *checked)
+{
+	disable_gui_if(has_error() || gui_status_not(P_DEFAULT));
+	return GuiCheckBox(bounds, text, checked);
+}
+
+int show_progress_bar(Rectangle bounds, float* progress)
+{
+	return GuiProgressBar(bounds, NULL, TextFormat("%i%%", (int)(*progress * 100)), progress, 0.0f, 1.0f);
+}
+
 int show_error(char* message)
 {
 	set_gui_lock(P_ERR_DIALOG);
@@ -169,7 +185,7 @@ int show_load_dialog(const char* title, FilePathList* files)
 		*files = LoadDroppedFiles();
 		for (int i = 0; i < files->count; ++i)
 		{
-			if (!IsFileExtension(files->paths[i], ".vgm;.vgz"))
+			if (!IsFileExtension(files->paths[i], ".vgm;.vgz;.zip"))
 			{
 				append_error_message("Wrong file type: %s", get_file_name(files->paths[i]));
 			}
@@ -187,7 +203,7 @@ int show_load_dialog(const char* title, FilePathList* files)
 		result = 0;
 	}
 #else
-	int result = GuiFileDialog(DIALOG_OPEN_FILE, title, _filename, "*.vgm;*.vgz", "VGM files (*.vgm, *.vgz)");
+	int result = GuiFileDialog(DIALOG_OPEN_FILE, title, _filename, "*.vgm;*.vgz;*.zip", "VGM files (*.vgm, *.vgz, *.zip)");
 	if (result > 0) {
 		_files.paths = _paths;
 		_files.paths[0] = _filename;
@@ -207,6 +223,106 @@ int show_drop_down(Rectangle bounds, char* options, int* index, bool status)
 	return result;
 }
 
+int show_value_box(Rectangle bounds, int* value, int min_value, int max_value, bool edit_mode)
+{
+	disable_gui_if(has_error() || gui_status_not(P_DEFAULT));
+	return GuiValueBox(bounds, NULL, value, min_value, max_value, edit_mode);
+}
+
+// List that only formats and draws the visible rows, returns 1 when a row is selected
+int show_list_view(Rectangle bounds, int count, const char* (*get_item)(size_t), int* scroll, int* active)
+{
+	disable_gui_if(has_error() || gui_status_not(P_DEFAULT));
+	int result = 0;
+	int rows = (int)((bounds.height - 2) / LIST_ROW_HEIGHT);
+
+	if (!GuiIsLocked() && CheckCollisionPointRec(GetMousePosition(), bounds))
+	{
+		*scroll -= (int)GetMouseWheelMove() * 3;
+		if (IsKeyPressed(KEY_PAGE_DOWN)) *scroll += rows;
+		if (IsKeyPressed(KEY_PAGE_UP)) *scroll -= rows;
+		if (IsKeyPressed(KEY_HOME)) *scroll = 0;
+		if (IsKeyPressed(KEY_END)) *scroll = count;
+	}
+	if (*scroll > count - rows) *scroll = count - rows;
+	if (*scroll < 0) *scroll = 0;
+
+	GuiPanel(bounds, NULL);
+	if (count == 0)
+	{
+		GuiLabel((Rectangle){ bounds.x + 8, bounds.y + 1, bounds.width - 16, LIST_ROW_HEIGHT }, "#113#no blocks found");
+		return 0;
+	}
+
+	int alignment = GuiGetStyle(TOGGLE, TEXT_ALIGNMENT);
+	GuiSetStyle(TOGGLE, TEXT_ALIGNMENT, TEXT_ALIGN_LEFT);
+	for (int i = 0; i < rows && *scroll + i < count; ++i)
+	{
+		int item = *scroll + i;
+		bool selected = item == *active;
+		Rectangle row = { bounds.x + 1, bounds.y + 1 + i * LIST_ROW_HEIGHT, bounds.width - 2, LIST_ROW_HEIGHT };
+		GuiToggle(row, get_item(item), &selected);
+		if (selected && item != *active)
+		{
+			*active = item;
+			result = 1;
+		}
+	}
+	GuiSetStyle(TOGGLE, TEXT_ALIGNMENT, alignment);
+
+	return result;
+}
+
+int show_waveform(Rectangle bounds, const struct vgm_wave* wave, double* first, double* scale)
+{
+	GuiPanel(bounds, NULL);
+	if (!wave)
+	{
+		GuiLabel((Rectangle){ bounds.x + 8, bounds.y + 1, bounds.width - 16, WAVE_LABEL_HEIGHT }, "#113#no preview");
+		return 0;
+	}
+
+	Rectangle area = { bounds.x + 1, bounds.y + WAVE_LABEL_HEIGHT, bounds.width - 2, bounds.height - WAVE_LABEL_HEIGHT - 1 };
+	int width = (int)area.width;
+	double fit = (double)wave->sample_count / width;
+	if (*scale <= 0 || *scale > fit) *scale = fit;
+
+	// wheel zooms around the pointer, dragging pans
+	if (!GuiIsLocked() && CheckCollisionPointRec(GetMousePosition(), area))
+	{
+		float wheel = GetMouseWheelMove();
+		if (wheel != 0)
+		{
+			double x = GetMousePosition().x - area.x;
+			double position = *first + x * *scale;
+			*scale *= pow(1.25, -wheel);
+			if (*scale > fit) *scale = fit;
+			if (*scale < WAVE_MIN_SCALE) *scale = WAVE_MIN_SCALE;
+			*first = position - x * *scale;
+		}
+		if (IsMouseButtonDown(MOUSE_BUTTON_LEFT)) *first -= GetMouseDelta().x * *scale;
+	}
+	if (*first > wave->sample_count - width * *scale) *first = wave->sample_count - width * *scale;
+	if (*first < 0) *first = 0;
+
+	GuiLabel((Rectangle){ bounds.x + 8, bounds.y + 1, bounds.width - 16, WAVE_LABEL_HEIGHT },
+		TextFormat("%s, %zu samples, %.0f to %.0f", vgm_pcm_get_format_name(wave->format), wave->sample_count,
+			*first, *first + width * *scale));
+
+	// one column per pixel from the pyramid, the same cost at any zoom
+	Color color = GetColor(GuiGetStyle(DEFAULT, TEXT_COLOR_NORMAL));
+	float middle = area.y + area.height / 2;
+	float height = (area.height - 2) / 256;
+	DrawLine(area.x, middle, area.x + width, middle, Fade(color, 0.3f));
+	for (int x = 0; x < width; ++x)
+	{
+		int8_t min, max;
+		if (!vgm_wave_get_range(wave, *first + x * *scale, *first + (x + 1) * *scale, &min, &max)) break;
+		DrawRectangle(area.x + x, middle - (max + 1) * height, 1, (max - min + 1) * height + 1, color);
+	}
+	return 0;
+}
+
 char* get_file_name(char* path)
 {
 	char *s;
@@ -1,6 +1,10 @@
 #ifndef _FUNCTIONS_H_
 #define _FUNCTIONS_H_
 
+#include <stddef.h>
+
+struct vgm_wave;
+
 char* get_file_name(char* path);
 
 void unload_dropped_files(void);
@@ -11,6 +15,8 @@ void unload_dropped_files(void);
 
 int show_button(Rectangle bounds, const char *text);
 
+int show_check_box(Rectangle bounds, const char *text, bool *checked);
+
 int show_about_box(void);
 
 int show_message(char* title, char* message);
@@ -19,6 +25,15 @@ int show_load_dialog(const char* title, FilePathList* files);
 
 int show_drop_down(Rectangle bounds, char* options, int* index, bool status);
 
+int show_progress_bar(Rectangle bounds, float* progress);
+
+int show_value_box(Rectangle bounds, int* value, int min_value, int max_value, bool edit_mode);
+
+int show_list_view(Rectangle bounds, int count, const char* (*get_item)(size_t), int* scroll, int* active);
+
+// first sample shown and samples per pixel, a scale of 0 fits the whole block
+int show_waveform(Rectangle bounds, const struct vgm_wave* wave, double* first, double* scale);
+
 //
 // priority handling
 //
@@ -37,8 +37,17 @@ int main()
 	FilePathList files;
 	bool request_load_dialog = false;
 	bool request_about_box = false;
-	int cb_index = 0;
-	bool cb_edit_mode = false;
+	int list_scroll = 0;
+	int list_active = -1;
+	int goto_index = 0;
+	bool goto_edit_mode = false;
+	bool recovery_scan = false;
+	bool merge_roms = false;
+	int block_filter = BLOCKS_ALL;
+	bool block_filter_edit = false;
+	int wave_block = -1;
+	double wave_first = 0;
+	double wave_scale = 0;
 
 	while (!WindowShouldClose())
 	{
@@ -59,6 +68,8 @@ int main()
 			if (result > 0)
 			{
 				load_files(&files);
+				list_scroll = 0;
+				list_active = -1;
 #if defined(CUSTOM_MODAL_DIALOGS) 
 				SetWindowTitle(TextFormat("%s v%s | File: %s", tool_name, tool_version, GetFileName(files.paths[0])));
 #endif
@@ -76,16 +87,61 @@ int main()
 			request_about_box = false;
 		}
 
-		// Dropdown at last
-		if (show_drop_down((Rectangle){ 200, 24, 576, 30 }, get_data_blocks(), &cb_index, cb_edit_mode))
+		show_check_box((Rectangle){ 24, 116, 20, 20 }, "Recovery scan", &recovery_scan);
+		set_scan_mode(recovery_scan ? SCAN_RECOVERY : SCAN_COMMANDS);
+		show_check_box((Rectangle){ 24, 142, 20, 20 }, "Merge ROM pieces", &merge_roms);
+		set_rom_merging(merge_roms);
+
+		int block_count = (int)get_block_count();
+		GuiLabel((Rectangle){ 24, 172, 120, 20 }, "Go to block:");
+		if (show_value_box((Rectangle){ 24, 194, 120, 30 }, &goto_index, 0, block_count > 0 ? block_count - 1 : 0, goto_edit_mode))
 		{
-			if (cb_edit_mode && cb_index > 0)
+			goto_edit_mode = !goto_edit_mode;
+			if (!goto_edit_mode && goto_index < block_count)
 			{
-				download_block(cb_index - 1);
+				list_active = goto_index;
+				list_scroll = goto_index;
 			}
-			cb_edit_mode = !cb_edit_mode;
 		}
 
+		float load_progress;
+		if (is_loading(&load_progress))
+		{
+			GuiLabel((Rectangle){ 24, 300, 160, 20 }, "Loading...");
+			show_progress_bar((Rectangle){ 24, 322, 120, 20 }, &load_progress);
+		}
+		else if (is_writing_blocks())
+		{
+			GuiLabel((Rectangle){ 24, 300, 160, 20 }, "Writing blocks...");
+		}
+
+		if (show_list_view((Rectangle){ 200, 24, 576, 338 }, block_count, get_block_label, &list_scroll, &list_active))
+		{
+			download_block(list_active);
+		}
+
+		// a newly selected block is shown whole
+		if (list_active != wave_block)
+		{
+			wave_block = list_active;
+			wave_first = 0;
+			wave_scale = 0;
+		}
+		show_waveform((Rectangle){ 200, 376, 576, 180 }, get_block_wave(list_active), &wave_first, &wave_scale);
+
+		// drawn last, the open list covers the controls below it
+		GuiLabel((Rectangle){ 24, 236, 160, 20 }, "Block types:");
+		if (show_drop_down((Rectangle){ 24, 258, 160, 30 }, "All blocks;PCM streams;ROM dumps;RAM writes", &block_filter, block_filter_edit))
+		{
+			block_filter_edit = !block_filter_edit;
+			if (block_filter_edit) set_gui_lock(P_DROP_DOWN); else reset_gui_lock(P_DROP_DOWN);
+		}
+		set_block_filter(block_filter);
+
+		const char* load_status = get_load_status();
+		if (load_status[0])
+			GuiStatusBar((Rectangle){ 0, GetScreenHeight() - 24, GetScreenWidth(), 24 }, load_status);
+
 		EndDrawing();
 	}
 
@@ -0,0 +1,21 @@
+// Service worker that serves the page with the COOP/COEP headers the pthreads build needs
+// (SharedArrayBuffer is only given to cross-origin isolated pages), for servers that cannot
+// send them, like GitHub Pages. shell.html registers it and reloads once it is active.
+self.addEventListener("install", () => self.skipWaiting());
+self.addEventListener("activate", (event) => event.waitUntil(self.clients.claim()));
+
+self.addEventListener("fetch", (event) => {
+    const request = event.request;
+    if (request.cache === "only-if-cached" && request.mode !== "same-origin") return;
+
+    event.respondWith(fetch(request).then((response) => {
+        // opaque responses of other origins can not be changed, they need their own CORP header
+        if (response.status === 0) return response;
+
+        const headers = new Headers(response.headers);
+        headers.set("Cross-Origin-Opener-Policy", "same-origin");
+        headers.set("Cross-Origin-Embedder-Policy", "require-corp");
+        headers.set("Cross-Origin-Resource-Policy", "cross-origin");
+        return new Response(response.body, { status: response.status, statusText: response.statusText, headers });
+    }));
+});
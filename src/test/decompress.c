@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vgmdecompress.h"
+
+// Known vectors for the data block decompressor. Every vector is decoded in one piece and
+// again one byte at a time, as the extractor may hand the block over in any split.
+
+struct vector {
+    const char* name;
+    const uint8_t* table;   // 0x7F block data, or NULL
+    size_t table_size;
+    const uint8_t* block;   // compression header and packed data
+    size_t block_size;
+    const uint8_t* expected;
+    size_t expected_size;
+};
+
+// cc ss ss ss ss dd cc tt aa aa: 12 bits copied, field 0xABC
+static const uint8_t copy12[] = { 0x00, 0x02, 0x00, 0x00, 0x00, 12, 12, 0x00, 0x00, 0x00, 0xAB, 0xC0 };
+static const uint8_t copy12_out[] = { 0xBC, 0x0A };
+
+// 16 bits copied, field 0xABCD
+static const uint8_t copy16[] = { 0x00, 0x02, 0x00, 0x00, 0x00, 16, 16, 0x00, 0x00, 0x00, 0xAB, 0xCD };
+static const uint8_t copy16_out[] = { 0xCD, 0xAB };
+
+// 12 bits shifted up to 16 plus 1, fields 0xABC and 0x123
+static const uint8_t shift12[] = { 0x00, 0x04, 0x00, 0x00, 0x00, 16, 12, 0x01, 0x01, 0x00, 0xAB, 0xC1, 0x23 };
+static const uint8_t shift12_out[] = { 0xC1, 0xAB, 0x31, 0x12 };
+
+// 2 bit DPCM deltas from the table, starting at 0x10, fields 0 1 2 3
+static const uint8_t dpcm_table[] = { 0x01, 0x00, 8, 2, 0x04, 0x00, 1, 2, 3, 4 };
+static const uint8_t dpcm[] = { 0x01, 0x04, 0x00, 0x00, 0x00, 8, 2, 0x00, 0x10, 0x00, 0x1B };
+static const uint8_t dpcm_out[] = { 0x11, 0x13, 0x16, 0x1A };
+
+static const struct vector vectors[] = {
+    { "12 bit copy", NULL, 0, copy12, sizeof(copy12), copy12_out, sizeof(copy12_out) },
+    { "16 bit copy", NULL, 0, copy16, sizeof(copy16), copy16_out, sizeof(copy16_out) },
+    { "12 bit shift", NULL, 0, shift12, sizeof(shift12), shift12_out, sizeof(shift12_out) },
+    { "DPCM table", dpcm_table, sizeof(dpcm_table), dpcm, sizeof(dpcm), dpcm_out, sizeof(dpcm_out) },
+};
+
+struct output {
+    uint8_t data[64];
+    size_t size;
+};
+
+static bool write_output(void* user, const uint8_t* data, size_t size)
+{
+    struct output* output = (struct output*)user;
+    if (output->size + size > sizeof(output->data)) return false;
+    memcpy(output->data + output->size, data, size);
+    output->size += size;
+    return true;
+}
+
+static bool run(const struct vector* vector, size_t piece)
+{
+    static struct vgm_decompression_table table;
+    if (vector->table && !vgm_read_decompression_table(&table, vector->table, vector->table_size))
+    {
+        fprintf(stderr, "%s: table not read\n", vector->name);
+        return false;
+    }
+
+    struct output output = { .size = 0 };
+    struct vgm_decompressor decompressor;
+    vgm_decompressor_init(&decompressor, vector->table ? &table : NULL, write_output, &output);
+    bool ok = true;
+    for (size_t offset = 0; ok && offset < vector->block_size; offset += piece)
+    {
+        size_t size = vector->block_size - offset < piece ? vector->block_size - offset : piece;
+        ok = vgm_decompressor_feed(&decompressor, vector->block + offset, size);
+    }
+    ok = ok && vgm_decompressor_finish(&decompressor);
+    vgm_decompressor_free(&decompressor);
+
+    if (!ok || decompressor.error[0])
+    {
+        fprintf(stderr, "%s (%zu byte pieces): %s\n", vector->name, piece,
+            decompressor.error[0] ? decompressor.error : "write failed");
+        return false;
+    }
+    if (output.size != vector->expected_size || memcmp(output.data, vector->expected, output.size) != 0)
+    {
+        fprintf(stderr, "%s (%zu byte pieces): got", vector->name, piece);
+        for (size_t i = 0; i < output.size; ++i) fprintf(stderr, " %02x", output.data[i]);
+        fprintf(stderr, ", expected");
+        for (size_t i = 0; i < vector->expected_size; ++i) fprintf(stderr, " %02x", vector->expected[i]);
+        fprintf(stderr, "\n");
+        return false;
+    }
+    return true;
+}
+
+int main(void)
+{
+    size_t failed = 0;
+    size_t count = sizeof(vectors) / sizeof(vectors[0]);
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (!run(&vectors[i], vectors[i].block_size)) ++failed;
+        if (!run(&vectors[i], 1)) ++failed;
+    }
+    printf("%zu of %zu decompression runs passed\n", 2 * count - failed, 2 * count);
+    return failed ? 1 : 0;
+}
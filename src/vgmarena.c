@@ -0,0 +1,178 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "vgmarena.h"
+
+struct vgm_arena_chunk
+{
+    struct vgm_arena_chunk* next;
+    uint8_t* data;      // aligned, inside the same allocation
+    size_t size;
+    bool single;        // holds one large allocation
+};
+
+static inline size_t align(size_t size)
+{
+    return (size + VGM_ARENA_ALIGNMENT - 1) & ~(size_t)(VGM_ARENA_ALIGNMENT - 1);
+}
+
+static struct vgm_arena_chunk* create_chunk(struct vgm_arena* arena, size_t size)
+{
+    if (size > SIZE_MAX - sizeof(struct vgm_arena_chunk) - VGM_ARENA_ALIGNMENT) return NULL;
+
+    // malloc() only aligns to 16 bytes
+    size_t total = sizeof(struct vgm_arena_chunk) + VGM_ARENA_ALIGNMENT + size;
+    struct vgm_arena_chunk* chunk = (struct vgm_arena_chunk*)malloc(total);
+    if (!chunk) return NULL;
+    chunk->next = NULL;
+    chunk->data = (uint8_t*)align((uintptr_t)(chunk + 1));
+    chunk->size = size;
+    chunk->single = false;
+    arena->size += total;
+    return chunk;
+}
+
+static void free_chunk(struct vgm_arena* arena, struct vgm_arena_chunk* chunk)
+{
+    arena->size -= sizeof(struct vgm_arena_chunk) + VGM_ARENA_ALIGNMENT + chunk->size;
+    free(chunk);
+}
+
+void* vgm_arena_alloc(struct vgm_arena* arena, size_t size)
+{
+    struct vgm_arena_chunk* current = arena->chunks;
+    if (size > SIZE_MAX - VGM_ARENA_ALIGNMENT) return NULL;
+    size = align(size ? size : 1);
+
+    if (current && size <= current->size - arena->used)
+    {
+        arena->last = current->data + arena->used;
+        arena->used += size;
+        return arena->last;
+    }
+
+    // a large allocation goes behind the current chunk, whose room is still used for the next ones
+    size_t chunk_size = arena->size < VGM_ARENA_MIN_CHUNK_SIZE ? VGM_ARENA_MIN_CHUNK_SIZE :
+        arena->size > VGM_ARENA_CHUNK_SIZE ? VGM_ARENA_CHUNK_SIZE : align(arena->size);
+    bool single = size > chunk_size / 4;
+    struct vgm_arena_chunk* chunk = create_chunk(arena, single ? size : chunk_size);
+    if (!chunk) return NULL;
+    chunk->single = single;
+    if (single && current)
+    {
+        chunk->next = current->next;
+        current->next = chunk;
+    }
+    else
+    {
+        chunk->next = current;
+        arena->chunks = chunk;
+        arena->used = size;
+    }
+    arena->last = chunk->data;
+    return arena->last;
+}
+
+void* vgm_arena_resize(struct vgm_arena* arena, void* ptr, size_t old_size, size_t size)
+{
+    if (!ptr) return vgm_arena_alloc(arena, size);
+
+    struct vgm_arena_chunk* current = arena->chunks;
+    uint8_t* data = (uint8_t*)ptr;
+    bool last = data == arena->last && current;
+    bool in_current = last && data >= current->data && data < current->data + current->size;
+    size_t offset = in_current ? (size_t)(data - current->data) : 0;
+    if (in_current && size <= SIZE_MAX - VGM_ARENA_ALIGNMENT && align(size ? size : 1) <= current->size - offset)
+    {
+        arena->used = offset + align(size ? size : 1);
+        return ptr;
+    }
+    if (size <= old_size) return ptr;
+
+    struct vgm_arena_chunk* single = last && !in_current && current->next && current->next->data == data ?
+        current->next : NULL;
+    uint8_t* moved = (uint8_t*)vgm_arena_alloc(arena, size);
+    if (!moved) return NULL;
+    memcpy(moved, ptr, old_size);
+
+    // the old bytes are given back when nothing came after them
+    if (in_current && arena->chunks == current)
+    {
+        arena->used = offset;
+    }
+    else if (single)
+    {
+        struct vgm_arena_chunk* previous = arena->chunks;
+        while (previous->next != single) previous = previous->next;
+        previous->next = single->next;
+        free_chunk(arena, single);
+    }
+    return moved;
+}
+
+bool vgm_arena_release(struct vgm_arena* arena, void* ptr)
+{
+    struct vgm_arena_chunk** link = &arena->chunks;
+    while (*link && (*link)->data != ptr) link = &(*link)->next;
+    struct vgm_arena_chunk* chunk = *link;
+    if (!chunk || !chunk->single) return false;
+
+    // a single chunk is only current when it came first, the next one then counts as full
+    if (chunk == arena->chunks)
+        arena->used = chunk->next ? chunk->next->size : 0;
+    if (arena->last == chunk->data)
+        arena->last = NULL;
+    *link = chunk->next;
+    free_chunk(arena, chunk);
+    return true;
+}
+
+void vgm_arena_reset(struct vgm_arena* arena)
+{
+    // the current chunk is a regular one, unless a single allocation came first
+    struct vgm_arena_chunk* kept = arena->chunks;
+    if (kept && kept->size > VGM_ARENA_CHUNK_SIZE) kept = NULL;
+    struct vgm_arena_chunk* chunk = arena->chunks;
+    while (chunk)
+    {
+        struct vgm_arena_chunk* next = chunk->next;
+        if (chunk != kept) free_chunk(arena, chunk);
+        chunk = next;
+    }
+    if (kept)
+    {
+        // a small single chunk kept takes any allocations from now on
+        kept->next = NULL;
+        kept->single = false;
+    }
+    arena->chunks = kept;
+    arena->used = 0;
+    arena->last = NULL;
+}
+
+void vgm_arena_free(struct vgm_arena* arena)
+{
+    vgm_arena_reset(arena);
+    if (arena->chunks) free_chunk(arena, arena->chunks);
+    arena->chunks = NULL;
+}
+
+void vgm_arena_merge(struct vgm_arena* dst, struct vgm_arena* src)
+{
+    if (!src->chunks) return;
+
+    if (!dst->chunks)
+    {
+        *dst = *src;
+    }
+    else
+    {
+        // behind the current chunk of dst, which keeps taking allocations
+        struct vgm_arena_chunk* tail = src->chunks;
+        while (tail->next) tail = tail->next;
+        tail->next = dst->chunks->next;
+        dst->chunks->next = src->chunks;
+        dst->size += src->size;
+    }
+    memset(src, 0, sizeof(*src));
+}
@@ -0,0 +1,44 @@
+#ifndef _VGMARENA_H_
+#define _VGMARENA_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Memory handed out from large chunks and given back all at once. Allocations are aligned for
+// SIMD loads and never freed alone, so a fixed heap (web) is not left full of holes. Chunks grow
+// with the arena, a list holding a few small blocks does not take a large one.
+#define VGM_ARENA_MIN_CHUNK_SIZE (64 * 1024)
+#define VGM_ARENA_CHUNK_SIZE     (4 * 1024 * 1024)
+#define VGM_ARENA_ALIGNMENT      64
+
+struct vgm_arena_chunk;
+
+struct vgm_arena
+{
+    struct vgm_arena_chunk* chunks; // the current chunk first, then older and single-allocation chunks
+    size_t used;                    // bytes taken in the current chunk
+    uint8_t* last;                  // most recent allocation, the only one that can grow in place
+    size_t size;                    // bytes taken from the system
+};
+
+// NULL if memory ran out. Allocations larger than a quarter of the next chunk get a chunk of their own.
+void* vgm_arena_alloc(struct vgm_arena* arena, size_t size);
+
+// Grow or shrink an allocation of old_size bytes, in place when it is the most recent one and fits.
+// Otherwise it is copied and the old bytes are lost until the arena is reset. NULL if memory ran out.
+void* vgm_arena_resize(struct vgm_arena* arena, void* ptr, size_t old_size, size_t size);
+
+// Give back an allocation that got a chunk of its own right away, true if it did. Others stay until the
+// arena is reset.
+bool vgm_arena_release(struct vgm_arena* arena, void* ptr);
+
+// Release everything but the current chunk, kept for the next allocations
+void vgm_arena_reset(struct vgm_arena* arena);
+
+void vgm_arena_free(struct vgm_arena* arena);
+
+// Hand all memory of src over to dst, its allocations stay valid. src is left empty.
+void vgm_arena_merge(struct vgm_arena* dst, struct vgm_arena* src);
+
+#endif // _VGMARENA_H_
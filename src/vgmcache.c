@@ -0,0 +1,365 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#if defined(VGM_THREADS)
+    #include <pthread.h>
+#endif
+
+#include "vgmcache.h"
+#include "vgmhash.h"
+#include "vgmzip.h"
+
+_Static_assert(sizeof(struct vgm_cache_header) == 32, "cache header must be 32 bytes");
+_Static_assert(sizeof(struct vgm_cache_record) == 40, "cache records must be 40 bytes");
+_Static_assert(sizeof(struct vgm_cache_block) == 24, "cache blocks must be 24 bytes");
+
+struct vgm_cache_entry
+{
+    char* path;
+    uint64_t path_hash;
+    struct vgm_cache_key key;
+    struct vgm_cache_block* blocks;
+    uint32_t count;
+};
+
+struct vgm_cache
+{
+    char* filename;
+    struct vgm_cache_entry* entries;
+    size_t count;
+    size_t capacity;
+    size_t* slots;          // open addressing on the path hash: entry index + 1, 0 when free
+    size_t slot_count;      // power of two, at most half full
+    bool dirty;
+#if defined(VGM_THREADS)
+    pthread_mutex_t lock;
+#endif
+};
+
+static void lock(struct vgm_cache* cache)
+{
+#if defined(VGM_THREADS)
+    pthread_mutex_lock(&cache->lock);
+#else
+    (void)cache;
+#endif
+}
+
+static void unlock(struct vgm_cache* cache)
+{
+#if defined(VGM_THREADS)
+    pthread_mutex_unlock(&cache->lock);
+#else
+    (void)cache;
+#endif
+}
+
+// Entry of the path, or NULL and the free slot where it would go
+static struct vgm_cache_entry* find_entry(struct vgm_cache* cache, const char* path, uint64_t path_hash, size_t* slot)
+{
+    size_t mask = cache->slot_count - 1;
+    size_t i = path_hash & mask;
+    for (; cache->slots[i]; i = (i + 1) & mask)
+    {
+        struct vgm_cache_entry* entry = &cache->entries[cache->slots[i] - 1];
+        if (entry->path_hash == path_hash && strcmp(entry->path, path) == 0)
+            return entry;
+    }
+    *slot = i;
+    return NULL;
+}
+
+static void fill_slots(struct vgm_cache* cache)
+{
+    size_t mask = cache->slot_count - 1;
+    memset(cache->slots, 0, cache->slot_count * sizeof(size_t));
+    for (size_t i = 0; i < cache->count; ++i)
+    {
+        size_t slot = cache->entries[i].path_hash & mask;
+        while (cache->slots[slot]) slot = (slot + 1) & mask;
+        cache->slots[slot] = i + 1;
+    }
+}
+
+static bool grow_slots(struct vgm_cache* cache)
+{
+    size_t slot_count = cache->slot_count ? cache->slot_count * 2 : 256;
+    size_t* slots = (size_t*)calloc(slot_count, sizeof(size_t));
+    if (!slots) return false;
+
+    free(cache->slots);
+    cache->slots = slots;
+    cache->slot_count = slot_count;
+    fill_slots(cache);
+    return true;
+}
+
+// Add an entry for a path not in the cache yet, taking over path and blocks
+static bool add_entry(struct vgm_cache* cache, char* path, const struct vgm_cache_key* key,
+    struct vgm_cache_block* blocks, uint32_t count)
+{
+    if ((cache->count + 1) * 2 > cache->slot_count && !grow_slots(cache))
+        return false;
+    if (cache->count == cache->capacity)
+    {
+        size_t capacity = cache->capacity ? cache->capacity * 2 : 256;
+        struct vgm_cache_entry* tmp = (struct vgm_cache_entry*)realloc(cache->entries, capacity * sizeof(struct vgm_cache_entry));
+        if (!tmp) return false;
+        cache->entries = tmp;
+        cache->capacity = capacity;
+    }
+
+    uint64_t path_hash = vgm_hash_buffer((const uint8_t*)path, strlen(path));
+    size_t slot;
+    if (find_entry(cache, path, path_hash, &slot))
+        return false;
+    struct vgm_cache_entry* entry = &cache->entries[cache->count];
+    entry->path = path;
+    entry->path_hash = path_hash;
+    entry->key = *key;
+    entry->blocks = blocks;
+    entry->count = count;
+    cache->slots[slot] = ++cache->count;
+    return true;
+}
+
+// Read the records of a cache file, false if it is damaged
+static bool read_cache(struct vgm_cache* cache, FILE* file)
+{
+    struct vgm_cache_header header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, VGM_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != VGM_CACHE_VERSION)
+        return false;
+
+    for (uint64_t i = 0; i < header.file_count; ++i)
+    {
+        struct vgm_cache_record record;
+        if (fread(&record, sizeof(record), 1, file) != 1 || record.path_size == 0 || record.path_size > 4096 ||
+            record.block_count > header.block_count)
+            return false;
+
+        char* path = (char*)malloc(record.path_size + 1);
+        struct vgm_cache_block* blocks = (struct vgm_cache_block*)malloc((record.block_count ? record.block_count : 1) * sizeof(struct vgm_cache_block));
+        bool result = path && blocks && fread(path, 1, record.path_size, file) == record.path_size &&
+            fread(blocks, sizeof(struct vgm_cache_block), record.block_count, file) == record.block_count;
+        if (result)
+        {
+            // a path twice means the file is damaged, add_entry() refuses it
+            path[record.path_size] = '\0';
+            result = strlen(path) == record.path_size && add_entry(cache, path, &record.key, blocks, record.block_count);
+        }
+        if (!result)
+        {
+            free(path);
+            free(blocks);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void free_entries(struct vgm_cache* cache)
+{
+    for (size_t i = 0; i < cache->count; ++i)
+    {
+        free(cache->entries[i].path);
+        free(cache->entries[i].blocks);
+    }
+    free(cache->entries);
+    free(cache->slots);
+    cache->entries = NULL;
+    cache->slots = NULL;
+    cache->count = cache->capacity = cache->slot_count = 0;
+}
+
+struct vgm_cache* vgm_cache_open(const char* filename)
+{
+    struct vgm_cache* cache = (struct vgm_cache*)calloc(1, sizeof(struct vgm_cache));
+    if (!cache) return NULL;
+    if (!(cache->filename = strdup(filename)))
+    {
+        free(cache);
+        return NULL;
+    }
+
+    // a damaged cache is started over
+    FILE* file = fopen(filename, "rb");
+    if (file)
+    {
+        if (!read_cache(cache, file))
+            free_entries(cache);
+        fclose(file);
+    }
+    if (!cache->slots && !grow_slots(cache))
+    {
+        free(cache->filename);
+        free(cache);
+        return NULL;
+    }
+#if defined(VGM_THREADS)
+    pthread_mutex_init(&cache->lock, NULL);
+#endif
+    return cache;
+}
+
+bool vgm_cache_save(struct vgm_cache* cache)
+{
+    lock(cache);
+    if (!cache->dirty)
+    {
+        unlock(cache);
+        return true;
+    }
+
+    // a crash while saving leaves the previous cache in place
+    char temp_name[4096];
+    snprintf(temp_name, sizeof(temp_name), "%s.tmp", cache->filename);
+    FILE* file = fopen(temp_name, "wb");
+    bool result = file != NULL;
+
+    struct vgm_cache_header header = { VGM_CACHE_MAGIC, VGM_CACHE_VERSION };
+    header.file_count = cache->count;
+    for (size_t i = 0; i < cache->count; ++i)
+    {
+        header.block_count += cache->entries[i].count;
+    }
+    result = result && fwrite(&header, sizeof(header), 1, file) == 1;
+    for (size_t i = 0; result && i < cache->count; ++i)
+    {
+        const struct vgm_cache_entry* entry = &cache->entries[i];
+        struct vgm_cache_record record = { entry->key, (uint32_t)strlen(entry->path), entry->count };
+        result = fwrite(&record, sizeof(record), 1, file) == 1 &&
+            fwrite(entry->path, 1, record.path_size, file) == record.path_size &&
+            fwrite(entry->blocks, sizeof(struct vgm_cache_block), entry->count, file) == entry->count;
+    }
+    if (file) result &= fclose(file) == 0;
+
+#if defined(_WIN32)
+    // rename() does not replace files there
+    if (result) remove(cache->filename);
+#endif
+    result = result && rename(temp_name, cache->filename) == 0;
+    if (!result) remove(temp_name);
+    cache->dirty = !result;
+    unlock(cache);
+    return result;
+}
+
+void vgm_cache_close(struct vgm_cache* cache)
+{
+    if (!cache) return;
+
+    free_entries(cache);
+#if defined(VGM_THREADS)
+    pthread_mutex_destroy(&cache->lock);
+#endif
+    free(cache->filename);
+    free(cache);
+}
+
+bool vgm_cache_get_key(const char* path, bool recovery, struct vgm_cache_key* key)
+{
+    struct stat st;
+    if (stat(path, &st) == -1) return false;
+
+    FILE* file = fopen(path, "rb");
+    if (!file) return false;
+    uint8_t header[VGM_CACHE_HEADER_BYTES];
+    size_t length = fread(header, 1, sizeof(header), file);
+    fclose(file);
+
+    memset(key, 0, sizeof(*key));
+    key->size = st.st_size;
+    key->mtime = st.st_mtime;
+    key->header_hash = vgm_hash_buffer(header, length);
+    key->recovery = recovery;
+    return true;
+}
+
+void vgm_cache_get_entry_key(const struct vgm_zip_entry* entry, bool recovery, struct vgm_cache_key* key)
+{
+    memset(key, 0, sizeof(*key));
+    key->size = entry->size;
+    key->mtime = entry->mtime;
+    key->header_hash = entry->crc;
+    key->recovery = recovery;
+}
+
+bool vgm_cache_lookup(struct vgm_cache* cache, const char* path, const struct vgm_cache_key* key,
+    struct vgm_cache_block** blocks, size_t* count)
+{
+    uint64_t path_hash = vgm_hash_buffer((const uint8_t*)path, strlen(path));
+    size_t slot;
+    bool result = false;
+
+    lock(cache);
+    const struct vgm_cache_entry* entry = find_entry(cache, path, path_hash, &slot);
+    if (entry && memcmp(&entry->key, key, sizeof(*key)) == 0)
+    {
+        *blocks = (struct vgm_cache_block*)malloc((entry->count ? entry->count : 1) * sizeof(struct vgm_cache_block));
+        if (*blocks)
+        {
+            memcpy(*blocks, entry->blocks, entry->count * sizeof(struct vgm_cache_block));
+            *count = entry->count;
+            result = true;
+        }
+    }
+    unlock(cache);
+    return result;
+}
+
+bool vgm_cache_store(struct vgm_cache* cache, const char* path, const struct vgm_cache_key* key,
+    const struct vgm_cache_block* blocks, size_t count)
+{
+    struct vgm_cache_block* copy = (struct vgm_cache_block*)malloc((count ? count : 1) * sizeof(struct vgm_cache_block));
+    if (!copy) return false;
+    memcpy(copy, blocks, count * sizeof(struct vgm_cache_block));
+
+    uint64_t path_hash = vgm_hash_buffer((const uint8_t*)path, strlen(path));
+    size_t slot;
+    bool result = true;
+
+    lock(cache);
+    struct vgm_cache_entry* entry = find_entry(cache, path, path_hash, &slot);
+    if (entry)
+    {
+        free(entry->blocks);
+        entry->key = *key;
+        entry->blocks = copy;
+        entry->count = (uint32_t)count;
+    }
+    else
+    {
+        char* path_copy = strdup(path);
+        result = path_copy && add_entry(cache, path_copy, key, copy, (uint32_t)count);
+        if (!result)
+        {
+            free(path_copy);
+            free(copy);
+        }
+    }
+    cache->dirty |= result;
+    unlock(cache);
+    return result;
+}
+
+void vgm_cache_remove(struct vgm_cache* cache, const char* path)
+{
+    uint64_t path_hash = vgm_hash_buffer((const uint8_t*)path, strlen(path));
+    size_t slot;
+
+    lock(cache);
+    struct vgm_cache_entry* entry = find_entry(cache, path, path_hash, &slot);
+    if (entry)
+    {
+        // the last entry takes its place, open addressing leaves no way to free one slot alone
+        free(entry->path);
+        free(entry->blocks);
+        *entry = cache->entries[--cache->count];
+        fill_slots(cache);
+        cache->dirty = true;
+    }
+    unlock(cache);
+}
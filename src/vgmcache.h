@@ -0,0 +1,83 @@
+#ifndef _VGMCACHE_H_
+#define _VGMCACHE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Scan results of files seen before, so an unchanged file is not read and scanned again.
+// Stored as one file, all integers little-endian:
+//   header              32 bytes at offset 0
+//   file_count records  struct vgm_cache_record, the path (not NUL-terminated),
+//                       then block_count entries of struct vgm_cache_block
+#define VGM_CACHE_MAGIC        "VGMSCAN"
+#define VGM_CACHE_VERSION      1
+#define VGM_CACHE_HEADER_BYTES 4096 // bytes at the start of a file that are hashed into its key
+
+#define VGM_CACHE_VIEW 0x01 // block data is stored as is at offset in the file, no inflating or decompression
+
+struct vgm_cache_header
+{
+    char magic[8];          // VGM_CACHE_MAGIC
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t file_count;
+    uint64_t block_count;
+};
+
+// Identity of a file: any change makes its cached blocks stale
+struct vgm_cache_key
+{
+    uint64_t size;
+    int64_t mtime;
+    uint64_t header_hash;   // XXH64 of the first VGM_CACHE_HEADER_BYTES bytes
+    uint32_t recovery;      // scan mode, results differ between the two
+    uint32_t reserved;
+};
+
+struct vgm_cache_record
+{
+    struct vgm_cache_key key;
+    uint32_t path_size;
+    uint32_t block_count;
+};
+
+struct vgm_cache_block
+{
+    uint64_t offset;        // data offset in the (inflated) file
+    uint64_t hash;          // XXH64 of the extracted data
+    uint32_t size;          // size of the extracted data
+    uint8_t type;           // data block type, after decompression
+    uint8_t flags;          // VGM_CACHE_*
+    uint8_t reserved[2];
+};
+
+// Cache shared by lists, safe to use from several threads
+struct vgm_cache;
+
+// Read the cache file, an empty cache if it does not exist or cannot be read
+struct vgm_cache* vgm_cache_open(const char* filename);
+
+// Write the cache file if entries were added since it was read
+bool vgm_cache_save(struct vgm_cache* cache);
+
+void vgm_cache_close(struct vgm_cache* cache);
+
+bool vgm_cache_get_key(const char* path, bool recovery, struct vgm_cache_key* key);
+
+// Key of a .zip entry, its path being "<archive>/<name>": the CRC-32 of the entry stands in for the header hash
+struct vgm_zip_entry;
+void vgm_cache_get_entry_key(const struct vgm_zip_entry* entry, bool recovery, struct vgm_cache_key* key);
+
+// Blocks of an unchanged file, a copy to be freed by the caller. False if the file is not cached.
+bool vgm_cache_lookup(struct vgm_cache* cache, const char* path, const struct vgm_cache_key* key,
+    struct vgm_cache_block** blocks, size_t* count);
+
+// Replace the blocks cached for a file
+bool vgm_cache_store(struct vgm_cache* cache, const char* path, const struct vgm_cache_key* key,
+    const struct vgm_cache_block* blocks, size_t count);
+
+// Forget a file that is gone
+void vgm_cache_remove(struct vgm_cache* cache, const char* path);
+
+#endif // _VGMCACHE_H_
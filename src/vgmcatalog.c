@@ -0,0 +1,767 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#if !defined(_WIN32)
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#if defined(VGM_THREADS)
+    #include <pthread.h>
+#endif
+
+#include "vgmcatalog.h"
+#include "vgmhash.h"
+
+_Static_assert(VGM_CHIP_COUNT <= 64, "chips must fit in the chip mask");
+
+// Bytes per entry of every column
+static size_t get_column_size(int column)
+{
+    switch (column)
+    {
+    case VGM_CATALOG_KEYS: return sizeof(struct vgm_cache_key);
+    case VGM_CATALOG_CHIPS: return sizeof(uint64_t);
+    case VGM_CATALOG_BLOCK_TYPES: return sizeof(struct vgm_type_filter);
+    case VGM_CATALOG_TYPES: return sizeof(uint8_t);
+    case VGM_CATALOG_HASHES: return sizeof(uint64_t);
+    default: return sizeof(uint32_t);
+    }
+}
+
+static uint64_t get_column_count(const struct vgm_catalog_header* header, int column)
+{
+    if (column >= VGM_CATALOG_TYPES) return header->block_count;
+    if (column == VGM_CATALOG_CLOCKS) return header->clock_count;
+    return header->file_count;
+}
+
+static uint64_t align(uint64_t offset)
+{
+    return (offset + VGM_CATALOG_ALIGNMENT - 1) & ~(uint64_t)(VGM_CATALOG_ALIGNMENT - 1);
+}
+
+static int count_chips(uint64_t chips)
+{
+    int count = 0;
+    for (; chips; chips &= chips - 1) count++;
+    return count;
+}
+
+//
+// Reading
+//
+
+bool vgm_catalog_open(struct vgm_catalog_reader* reader, const char* filename)
+{
+    memset(reader, 0, sizeof(*reader));
+
+#if !defined(_WIN32)
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) return false;
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof(struct vgm_catalog_header))
+    {
+        close(fd);
+        return false;
+    }
+    reader->base = (uint8_t*)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (reader->base == MAP_FAILED)
+    {
+        reader->base = NULL;
+        return false;
+    }
+    reader->size = st.st_size;
+    reader->mapped = true;
+#else
+    FILE* file = fopen(filename, "rb");
+    if (!file) return false;
+    _fseeki64(file, 0, SEEK_END);
+    reader->size = _ftelli64(file);
+    _fseeki64(file, 0, SEEK_SET);
+    if (reader->size < sizeof(struct vgm_catalog_header) || !(reader->base = (uint8_t*)malloc(reader->size)) ||
+        fread(reader->base, 1, reader->size, file) != reader->size)
+    {
+        fclose(file);
+        vgm_catalog_close(reader);
+        return false;
+    }
+    fclose(file);
+#endif
+
+    const struct vgm_catalog_header* header = (const struct vgm_catalog_header*)reader->base;
+    bool valid = memcmp(header->magic, VGM_CATALOG_MAGIC, sizeof(header->magic)) == 0 &&
+        header->version == VGM_CATALOG_VERSION && header->column_count == VGM_CATALOG_COLUMN_COUNT &&
+        header->file_count <= UINT32_MAX && header->clock_count <= UINT32_MAX && header->block_count <= UINT32_MAX &&
+        header->strings_offset <= reader->size && header->strings_size > 0 &&
+        header->strings_size <= reader->size - header->strings_offset &&
+        reader->base[header->strings_offset + header->strings_size - 1] == '\0' && header->strings_size <= UINT32_MAX;
+    for (int i = 0; valid && i < VGM_CATALOG_COLUMN_COUNT; ++i)
+    {
+        // counts are below 2^32 and entries at most 32 bytes, no overflow
+        uint64_t size = get_column_count(header, i) * get_column_size(i);
+        valid = header->columns[i] % VGM_CATALOG_ALIGNMENT == 0 && header->columns[i] <= reader->size &&
+            size <= reader->size - header->columns[i];
+        if (valid) reader->columns[i] = reader->base + header->columns[i];
+    }
+    if (!valid)
+    {
+        vgm_catalog_close(reader);
+        return false;
+    }
+
+    reader->header = header;
+    reader->strings = (const char*)reader->base + header->strings_offset;
+    return true;
+}
+
+size_t vgm_catalog_count(const struct vgm_catalog_reader* reader)
+{
+    return reader->header ? reader->header->file_count : 0;
+}
+
+static const uint32_t* get_uint32_column(const struct vgm_catalog_reader* reader, int column)
+{
+    return (const uint32_t*)reader->columns[column];
+}
+
+static const char* get_string(const struct vgm_catalog_reader* reader, uint32_t offset)
+{
+    return offset < reader->header->strings_size ? reader->strings + offset : "";
+}
+
+bool vgm_catalog_get(const struct vgm_catalog_reader* reader, size_t i, struct vgm_catalog_file* file)
+{
+    if (i >= vgm_catalog_count(reader)) return false;
+
+    const struct vgm_catalog_header* header = reader->header;
+    uint64_t chips = ((const uint64_t*)reader->columns[VGM_CATALOG_CHIPS])[i];
+    uint32_t first_clock = get_uint32_column(reader, VGM_CATALOG_FIRST_CLOCKS)[i];
+    uint32_t first_block = get_uint32_column(reader, VGM_CATALOG_FIRST_BLOCKS)[i];
+    uint32_t block_count = get_uint32_column(reader, VGM_CATALOG_BLOCK_COUNTS)[i];
+    if (first_clock > header->clock_count || (uint64_t)count_chips(chips) > header->clock_count - first_clock ||
+        first_block > header->block_count || block_count > header->block_count - first_block)
+        return false;
+
+    file->path = get_string(reader, get_uint32_column(reader, VGM_CATALOG_PATHS)[i]);
+    file->key = &((const struct vgm_cache_key*)reader->columns[VGM_CATALOG_KEYS])[i];
+    file->version = get_uint32_column(reader, VGM_CATALOG_VERSIONS)[i];
+    file->total_samples = get_uint32_column(reader, VGM_CATALOG_TOTAL_SAMPLES)[i];
+    file->loop_offset = get_uint32_column(reader, VGM_CATALOG_LOOP_OFFSETS)[i];
+    file->loop_samples = get_uint32_column(reader, VGM_CATALOG_LOOP_SAMPLES)[i];
+    file->rate = get_uint32_column(reader, VGM_CATALOG_RATES)[i];
+    file->gd3_offset = get_uint32_column(reader, VGM_CATALOG_GD3_OFFSETS)[i];
+    file->chips = chips;
+    file->clocks = get_uint32_column(reader, VGM_CATALOG_CLOCKS) + first_clock;
+    for (int field = 0; field < VGM_GD3_FIELD_COUNT; ++field)
+    {
+        file->gd3[field] = get_string(reader, get_uint32_column(reader, VGM_CATALOG_GD3 + field)[i]);
+    }
+    file->types = (const uint8_t*)reader->columns[VGM_CATALOG_TYPES] + first_block;
+    file->sizes = get_uint32_column(reader, VGM_CATALOG_SIZES) + first_block;
+    file->hashes = (const uint64_t*)reader->columns[VGM_CATALOG_HASHES] + first_block;
+    file->block_count = block_count;
+    return true;
+}
+
+size_t vgm_catalog_find(const struct vgm_catalog_reader* reader, const char* path)
+{
+    const uint32_t* paths = reader->header ? get_uint32_column(reader, VGM_CATALOG_PATHS) : NULL;
+    size_t low = 0, high = vgm_catalog_count(reader);
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        int order = strcmp(get_string(reader, paths[middle]), path);
+        if (order == 0) return middle;
+        if (order < 0) low = middle + 1;
+        else high = middle;
+    }
+    return SIZE_MAX;
+}
+
+void vgm_catalog_close(struct vgm_catalog_reader* reader)
+{
+#if !defined(_WIN32)
+    if (reader->mapped && reader->base)
+        munmap(reader->base, reader->size);
+    else
+#endif
+        free(reader->base);
+    memset(reader, 0, sizeof(*reader));
+}
+
+//
+// Queries
+//
+
+// Sizes in bytes, with an optional k, m or g suffix
+static bool parse_size(const char* text, const char* end, uint64_t* size)
+{
+    char* next;
+    *size = strtoull(text, &next, 10);
+    if (next == text) return false;
+    static const char suffixes[] = "kmg";
+    const char* suffix = next < end && *next ? strchr(suffixes, *next | 0x20) : NULL;
+    if (suffix)
+    {
+        *size <<= 10 * (suffix - suffixes + 1);
+        next++;
+    }
+    return next == end;
+}
+
+// Hexadecimal types and ranges, unlike vgm_type_filter_parse() nothing else is taken along
+static bool parse_types(struct vgm_type_filter* types, const char* text)
+{
+    while (*text)
+    {
+        char* next;
+        unsigned long first = strtoul(text, &next, 16);
+        unsigned long last = first;
+        if (next == text || first > 0xff) return false;
+        if (*next == '-')
+        {
+            text = next + 1;
+            last = strtoul(text, &next, 16);
+            if (next == text || last > 0xff || last < first) return false;
+        }
+        for (unsigned long type = first; type <= last; ++type)
+            types->bits[type >> 6] |= 1ull << (type & 63);
+        if (*next == ',') next++;
+        else if (*next) return false;
+        text = next;
+    }
+    return true;
+}
+
+bool vgm_catalog_parse_query(struct vgm_catalog_query* query, const char* term)
+{
+    const char* value = strchr(term, '=');
+    if (!value || !*++value) return false;
+    size_t name_length = value - 1 - term;
+
+    if (name_length == 4 && strncasecmp(term, "chip", 4) == 0)
+    {
+        enum vgm_chip chip;
+        if (!vgm_find_chip(value, &chip)) return false;
+        query->chips |= 1ull << chip;
+        return true;
+    }
+    if (name_length == 4 && strncasecmp(term, "type", 4) == 0)
+    {
+        query->has_types = true;
+        return parse_types(&query->types, value);
+    }
+    if (name_length == 4 && strncasecmp(term, "game", 4) == 0)
+    {
+        if (strlen(value) >= sizeof(query->game)) return false;
+        strcpy(query->game, value);
+        return true;
+    }
+    if (name_length == 4 && strncasecmp(term, "size", 4) == 0)
+    {
+        // MIN-MAX with either end left out, or one exact size
+        const char* end = value + strlen(value);
+        const char* dash = strchr(value, '-');
+        if (!dash)
+            return parse_size(value, end, &query->min_size) && parse_size(value, end, &query->max_size);
+        query->min_size = 0;
+        query->max_size = 0;
+        return (dash == value || parse_size(value, dash, &query->min_size)) &&
+            (dash + 1 == end || parse_size(dash + 1, end, &query->max_size));
+    }
+    return false;
+}
+
+// ASCII case-insensitive strstr()
+static bool contains_text(const char* text, const char* part)
+{
+    size_t length = strlen(part);
+    for (; *text; ++text)
+    {
+        if (strncasecmp(text, part, length) == 0) return true;
+    }
+    return length == 0;
+}
+
+static bool has_any_type(const struct vgm_type_filter* a, const struct vgm_type_filter* b)
+{
+    return (a->bits[0] & b->bits[0]) | (a->bits[1] & b->bits[1]) | (a->bits[2] & b->bits[2]) |
+        (a->bits[3] & b->bits[3]);
+}
+
+// Tracks of a game are next to each other in path order and share its name string
+struct game_match
+{
+    uint32_t name;
+    bool result;
+    bool known;
+};
+
+static bool match_game(const struct vgm_catalog_reader* reader, struct game_match* match, uint32_t name,
+    const char* game)
+{
+    if (!match->known || match->name != name)
+    {
+        match->name = name;
+        match->result = contains_text(get_string(reader, name), game);
+        match->known = true;
+    }
+    return match->result;
+}
+
+bool vgm_catalog_query(const struct vgm_catalog_reader* reader, const struct vgm_catalog_query* query,
+    size_t** matches, size_t* count)
+{
+    size_t file_count = vgm_catalog_count(reader);
+    *count = 0;
+    if (!(*matches = (size_t*)malloc((file_count ? file_count : 1) * sizeof(size_t)))) return false;
+    if (file_count == 0) return true;
+
+    const uint64_t* chips = (const uint64_t*)reader->columns[VGM_CATALOG_CHIPS];
+    const struct vgm_type_filter* block_types = (const struct vgm_type_filter*)reader->columns[VGM_CATALOG_BLOCK_TYPES];
+    const uint32_t* games = get_uint32_column(reader, VGM_CATALOG_GD3 + VGM_GD3_GAME);
+    const uint32_t* games_jp = get_uint32_column(reader, VGM_CATALOG_GD3 + VGM_GD3_GAME_JP);
+    const uint32_t* first_blocks = get_uint32_column(reader, VGM_CATALOG_FIRST_BLOCKS);
+    const uint32_t* block_counts = get_uint32_column(reader, VGM_CATALOG_BLOCK_COUNTS);
+    const uint8_t* types = (const uint8_t*)reader->columns[VGM_CATALOG_TYPES];
+    const uint32_t* sizes = get_uint32_column(reader, VGM_CATALOG_SIZES);
+    uint64_t block_total = reader->header->block_count;
+    bool sized = query->min_size > 0 || query->max_size > 0;
+    uint64_t max_size = query->max_size ? query->max_size : UINT64_MAX;
+    struct game_match game = { 0 }, game_jp = { 0 };
+
+    for (size_t i = 0; i < file_count; ++i)
+    {
+        if ((chips[i] & query->chips) != query->chips) continue;
+        if (query->has_types && !has_any_type(&block_types[i], &query->types)) continue;
+        if (query->game[0] && !match_game(reader, &game, games[i], query->game) &&
+            !match_game(reader, &game_jp, games_jp[i], query->game))
+            continue;
+        if (sized)
+        {
+            // only the blocks of the files left are read
+            uint64_t first = first_blocks[i], end = first + block_counts[i];
+            if (end > block_total) continue;
+            uint64_t j = first;
+            for (; j < end; ++j)
+            {
+                if (sizes[j] >= query->min_size && sizes[j] <= max_size &&
+                    (!query->has_types || vgm_type_filter_has(&query->types, types[j])))
+                    break;
+            }
+            if (j == end) continue;
+        }
+        (*matches)[(*count)++] = i;
+    }
+    return true;
+}
+
+//
+// Building
+//
+
+struct catalog_file
+{
+    uint32_t path;
+    struct vgm_cache_key key;
+    uint32_t fields[VGM_CATALOG_CHIPS - VGM_CATALOG_VERSIONS]; // version to GD3 offset
+    uint64_t chips;
+    uint32_t first_clock;
+    struct vgm_type_filter types;
+    uint32_t first_block;
+    uint32_t block_count;
+    uint32_t gd3[VGM_GD3_FIELD_COUNT];
+};
+
+struct vgm_catalog
+{
+    const struct vgm_catalog_reader* previous;
+    struct catalog_file* files;
+    size_t count;
+    size_t capacity;
+    uint32_t* clocks;
+    size_t clock_count;
+    size_t clock_capacity;
+    struct vgm_catalog_block* blocks;
+    size_t block_count;
+    size_t block_capacity;
+    char* strings;
+    size_t strings_size;
+    size_t strings_capacity;
+    uint32_t* slots;        // open addressing on the string hash: string offset + 1, 0 when free
+    size_t slot_count;      // power of two, at most half full
+    size_t string_count;
+    bool failed;
+#if defined(VGM_THREADS)
+    pthread_mutex_t lock;
+#endif
+};
+
+static void lock(struct vgm_catalog* catalog)
+{
+#if defined(VGM_THREADS)
+    pthread_mutex_lock(&catalog->lock);
+#else
+    (void)catalog;
+#endif
+}
+
+static void unlock(struct vgm_catalog* catalog)
+{
+#if defined(VGM_THREADS)
+    pthread_mutex_unlock(&catalog->lock);
+#else
+    (void)catalog;
+#endif
+}
+
+// Make room for count more elements of size bytes
+static bool reserve(void** array, size_t* capacity, size_t used, size_t count, size_t size)
+{
+    if (used + count <= *capacity) return true;
+
+    size_t new_capacity = *capacity ? *capacity * 2 : 1024;
+    while (new_capacity < used + count) new_capacity *= 2;
+    void* tmp = realloc(*array, new_capacity * size);
+    if (!tmp) return false;
+    *array = tmp;
+    *capacity = new_capacity;
+    return true;
+}
+
+static bool grow_slots(struct vgm_catalog* catalog)
+{
+    size_t slot_count = catalog->slot_count ? catalog->slot_count * 2 : 4096;
+    uint32_t* slots = (uint32_t*)calloc(slot_count, sizeof(uint32_t));
+    if (!slots) return false;
+
+    // rehash every string from the table itself
+    for (size_t offset = 0; offset < catalog->strings_size; offset += strlen(catalog->strings + offset) + 1)
+    {
+        const char* text = catalog->strings + offset;
+        size_t slot = vgm_hash_buffer((const uint8_t*)text, strlen(text)) & (slot_count - 1);
+        while (slots[slot]) slot = (slot + 1) & (slot_count - 1);
+        slots[slot] = (uint32_t)offset + 1;
+    }
+    free(catalog->slots);
+    catalog->slots = slots;
+    catalog->slot_count = slot_count;
+    return true;
+}
+
+// Offset of a string in the table, added if it is not there yet
+static bool add_string(struct vgm_catalog* catalog, const char* text, uint32_t* offset)
+{
+    size_t length = strlen(text);
+    if ((catalog->string_count + 1) * 2 > catalog->slot_count && !grow_slots(catalog))
+        return false;
+
+    size_t mask = catalog->slot_count - 1;
+    size_t slot = vgm_hash_buffer((const uint8_t*)text, length) & mask;
+    for (; catalog->slots[slot]; slot = (slot + 1) & mask)
+    {
+        if (strcmp(catalog->strings + catalog->slots[slot] - 1, text) == 0)
+        {
+            *offset = catalog->slots[slot] - 1;
+            return true;
+        }
+    }
+
+    if (catalog->strings_size + length + 1 > UINT32_MAX - 1 ||
+        !reserve((void**)&catalog->strings, &catalog->strings_capacity, catalog->strings_size, length + 1, 1))
+        return false;
+    *offset = (uint32_t)catalog->strings_size;
+    memcpy(catalog->strings + catalog->strings_size, text, length + 1);
+    catalog->strings_size += length + 1;
+    catalog->slots[slot] = *offset + 1;
+    catalog->string_count++;
+    return true;
+}
+
+struct vgm_catalog* vgm_catalog_create(const struct vgm_catalog_reader* previous)
+{
+    struct vgm_catalog* catalog = (struct vgm_catalog*)calloc(1, sizeof(struct vgm_catalog));
+    if (!catalog) return NULL;
+
+    // "" first, at offset 0
+    uint32_t empty;
+    if (!add_string(catalog, "", &empty))
+    {
+        free(catalog->slots);
+        free(catalog->strings);
+        free(catalog);
+        return NULL;
+    }
+    catalog->previous = previous && previous->header ? previous : NULL;
+#if defined(VGM_THREADS)
+    pthread_mutex_init(&catalog->lock, NULL);
+#endif
+    return catalog;
+}
+
+// Room for one more file with its clocks and blocks, the caller holds the lock
+static struct catalog_file* add_file(struct vgm_catalog* catalog, const char* path, const struct vgm_cache_key* key,
+    size_t clock_count, size_t block_count)
+{
+    if (catalog->clock_count + clock_count > UINT32_MAX || catalog->block_count + block_count > UINT32_MAX ||
+        !reserve((void**)&catalog->files, &catalog->capacity, catalog->count, 1, sizeof(struct catalog_file)) ||
+        !reserve((void**)&catalog->clocks, &catalog->clock_capacity, catalog->clock_count, clock_count,
+            sizeof(uint32_t)) ||
+        !reserve((void**)&catalog->blocks, &catalog->block_capacity, catalog->block_count, block_count,
+            sizeof(struct vgm_catalog_block)))
+        return NULL;
+
+    struct catalog_file* file = &catalog->files[catalog->count];
+    memset(file, 0, sizeof(*file));
+    if (!add_string(catalog, path, &file->path)) return NULL;
+    file->key = *key;
+    file->first_clock = (uint32_t)catalog->clock_count;
+    file->first_block = (uint32_t)catalog->block_count;
+    file->block_count = (uint32_t)block_count;
+    return file;
+}
+
+bool vgm_catalog_add_unchanged(struct vgm_catalog* catalog, const char* path, const struct vgm_cache_key* key)
+{
+    struct vgm_catalog_file old;
+    size_t index = catalog->previous ? vgm_catalog_find(catalog->previous, path) : SIZE_MAX;
+    if (index == SIZE_MAX || !vgm_catalog_get(catalog->previous, index, &old) ||
+        (key && memcmp(old.key, key, sizeof(*key)) != 0))
+        return false;
+
+    lock(catalog);
+    int clock_count = count_chips(old.chips);
+    struct catalog_file* file = add_file(catalog, path, key ? key : old.key, clock_count, old.block_count);
+    bool result = file != NULL;
+    for (int i = 0; result && i < VGM_GD3_FIELD_COUNT; ++i)
+    {
+        result = add_string(catalog, old.gd3[i], &file->gd3[i]);
+    }
+    if (result)
+    {
+        uint32_t values[] = { old.version, old.total_samples, old.loop_offset, old.loop_samples, old.rate,
+            old.gd3_offset };
+        _Static_assert(sizeof(values) == sizeof(file->fields), "one value per field");
+        memcpy(file->fields, values, sizeof(values));
+        file->chips = old.chips;
+        memcpy(catalog->clocks + catalog->clock_count, old.clocks, clock_count * sizeof(uint32_t));
+        catalog->clock_count += clock_count;
+        for (uint32_t i = 0; i < old.block_count; ++i)
+        {
+            struct vgm_catalog_block* block = &catalog->blocks[catalog->block_count++];
+            block->hash = old.hashes[i];
+            block->size = old.sizes[i];
+            block->type = old.types[i];
+            file->types.bits[block->type >> 6] |= 1ull << (block->type & 63);
+        }
+        catalog->count++;
+    }
+    // an unchanged file that could not be taken is indexed again, the catalog is not damaged
+    unlock(catalog);
+    return result;
+}
+
+bool vgm_catalog_add(struct vgm_catalog* catalog, const char* path, const struct vgm_cache_key* key,
+    const struct vgm_tag* tag, const struct vgm_catalog_block* blocks, size_t count)
+{
+    uint64_t chips = 0;
+    for (int i = 0; i < VGM_CHIP_COUNT; ++i)
+    {
+        if (tag->clocks[i]) chips |= 1ull << i;
+    }
+
+    lock(catalog);
+    struct catalog_file* file = add_file(catalog, path, key, count_chips(chips), count);
+    bool result = file != NULL;
+    for (int i = 0; result && i < VGM_GD3_FIELD_COUNT; ++i)
+    {
+        result = add_string(catalog, vgm_tag_get_field(tag, (enum vgm_gd3_field)i), &file->gd3[i]);
+    }
+    if (result)
+    {
+        uint32_t values[] = { tag->version, tag->total_samples, tag->loop_offset, tag->loop_samples, tag->rate,
+            tag->gd3_offset };
+        memcpy(file->fields, values, sizeof(values));
+        file->chips = chips;
+        for (int i = 0; i < VGM_CHIP_COUNT; ++i)
+        {
+            if (tag->clocks[i]) catalog->clocks[catalog->clock_count++] = tag->clocks[i];
+        }
+        memcpy(catalog->blocks + catalog->block_count, blocks, count * sizeof(struct vgm_catalog_block));
+        catalog->block_count += count;
+        for (size_t i = 0; i < count; ++i)
+        {
+            file->types.bits[blocks[i].type >> 6] |= 1ull << (blocks[i].type & 63);
+        }
+        catalog->count++;
+    }
+    else
+    {
+        catalog->failed = true; // the file would be missing
+    }
+    unlock(catalog);
+    return result;
+}
+
+struct sorted_file
+{
+    const char* path;
+    const struct catalog_file* file;
+};
+
+static int compare_paths(const void* a, const void* b)
+{
+    return strcmp(((const struct sorted_file*)a)->path, ((const struct sorted_file*)b)->path);
+}
+
+// Value of a file column
+static const void* get_file_value(const struct catalog_file* file, int column, uint32_t* value)
+{
+    switch (column)
+    {
+    case VGM_CATALOG_PATHS: *value = file->path; break;
+    case VGM_CATALOG_KEYS: return &file->key;
+    case VGM_CATALOG_CHIPS: return &file->chips;
+    case VGM_CATALOG_FIRST_CLOCKS: *value = file->first_clock; break;
+    case VGM_CATALOG_BLOCK_TYPES: return &file->types;
+    case VGM_CATALOG_FIRST_BLOCKS: *value = file->first_block; break;
+    case VGM_CATALOG_BLOCK_COUNTS: *value = file->block_count; break;
+    default:
+        *value = column >= VGM_CATALOG_GD3 ? file->gd3[column - VGM_CATALOG_GD3] :
+            file->fields[column - VGM_CATALOG_VERSIONS];
+        break;
+    }
+    return value;
+}
+
+// Gather one column in path order and write it at the current offset. File columns come from the
+// renumbered files, clocks and blocks are found with the numbers they were added with.
+static bool write_column(FILE* file, const struct vgm_catalog* catalog, const struct sorted_file* sorted,
+    const struct catalog_file* renumbered, size_t count, int column, uint8_t* buffer)
+{
+    size_t size = get_column_size(column);
+    uint8_t* p = buffer;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const struct catalog_file* entry = sorted[i].file;
+        if (column < VGM_CATALOG_CLOCKS)
+        {
+            uint32_t value;
+            memcpy(p, get_file_value(&renumbered[i], column, &value), size);
+            p += size;
+        }
+        else if (column == VGM_CATALOG_CLOCKS)
+        {
+            size_t clock_count = count_chips(entry->chips);
+            memcpy(p, catalog->clocks + entry->first_clock, clock_count * size);
+            p += clock_count * size;
+        }
+        else
+        {
+            for (uint32_t j = 0; j < entry->block_count; ++j, p += size)
+            {
+                const struct vgm_catalog_block* block = &catalog->blocks[entry->first_block + j];
+                if (column == VGM_CATALOG_TYPES) *p = block->type;
+                else if (column == VGM_CATALOG_SIZES) memcpy(p, &block->size, size);
+                else memcpy(p, &block->hash, size);
+            }
+        }
+    }
+    return fwrite(buffer, 1, p - buffer, file) == (size_t)(p - buffer);
+}
+
+static bool write_catalog(FILE* file, const struct vgm_catalog* catalog, const struct sorted_file* sorted, size_t count)
+{
+    // clocks and blocks follow the files, renumbered in path order
+    struct vgm_catalog_header header = { VGM_CATALOG_MAGIC, VGM_CATALOG_VERSION, VGM_CATALOG_COLUMN_COUNT };
+    header.file_count = count;
+    struct catalog_file* renumbered = (struct catalog_file*)malloc((count ? count : 1) * sizeof(struct catalog_file));
+    if (!renumbered) return false;
+    for (size_t i = 0; i < count; ++i)
+    {
+        renumbered[i] = *sorted[i].file;
+        renumbered[i].first_clock = (uint32_t)header.clock_count;
+        renumbered[i].first_block = (uint32_t)header.block_count;
+        header.clock_count += count_chips(renumbered[i].chips);
+        header.block_count += renumbered[i].block_count;
+    }
+
+    size_t buffer_size = 0;
+    for (int i = 0; i < VGM_CATALOG_COLUMN_COUNT; ++i)
+    {
+        size_t size = get_column_count(&header, i) * get_column_size(i);
+        if (size > buffer_size) buffer_size = size;
+    }
+    uint8_t* buffer = (uint8_t*)malloc(buffer_size ? buffer_size : 1);
+    bool result = buffer && fwrite(&header, sizeof(header), 1, file) == 1;
+
+    uint64_t offset = sizeof(header);
+    static const uint8_t zeros[VGM_CATALOG_ALIGNMENT];
+    for (int i = 0; result && i < VGM_CATALOG_COLUMN_COUNT; ++i)
+    {
+        header.columns[i] = align(offset);
+        result = fwrite(zeros, 1, header.columns[i] - offset, file) == header.columns[i] - offset &&
+            write_column(file, catalog, sorted, renumbered, count, i, buffer);
+        offset = header.columns[i] + get_column_count(&header, i) * get_column_size(i);
+    }
+    header.strings_offset = offset;
+    header.strings_size = catalog->strings_size;
+    result = result && fwrite(catalog->strings, 1, catalog->strings_size, file) == catalog->strings_size &&
+        fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+    free(buffer);
+    free(renumbered);
+    return result;
+}
+
+bool vgm_catalog_finish(struct vgm_catalog* catalog, const char* filename)
+{
+    bool result = !catalog->failed;
+    struct sorted_file* sorted = (struct sorted_file*)malloc((catalog->count ? catalog->count : 1) * sizeof(struct sorted_file));
+    size_t count = 0;
+    if (sorted)
+    {
+        for (size_t i = 0; i < catalog->count; ++i)
+        {
+            sorted[i].path = catalog->strings + catalog->files[i].path;
+            sorted[i].file = &catalog->files[i];
+        }
+        qsort(sorted, catalog->count, sizeof(struct sorted_file), compare_paths);
+
+        // a file given twice is kept once
+        for (size_t i = 0; i < catalog->count; ++i)
+        {
+            if (count == 0 || strcmp(sorted[count - 1].path, sorted[i].path) != 0) sorted[count++] = sorted[i];
+        }
+    }
+
+    // a crash while writing leaves the previous catalog in place
+    char temp_name[4096];
+    snprintf(temp_name, sizeof(temp_name), "%s.tmp", filename);
+    FILE* file = sorted && result ? fopen(temp_name, "wb") : NULL;
+    result = file && write_catalog(file, catalog, sorted, count);
+    if (file) result &= fclose(file) == 0;
+#if defined(_WIN32)
+    // rename() does not replace files there
+    if (result) remove(filename);
+#endif
+    result = result && rename(temp_name, filename) == 0;
+    if (!result && file) remove(temp_name);
+
+#if defined(VGM_THREADS)
+    pthread_mutex_destroy(&catalog->lock);
+#endif
+    free(sorted);
+    free(catalog->files);
+    free(catalog->clocks);
+    free(catalog->blocks);
+    free(catalog->strings);
+    free(catalog->slots);
+    free(catalog);
+    return result;
+}
@@ -0,0 +1,145 @@
+#ifndef _VGMCATALOG_H_
+#define _VGMCATALOG_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vgmcache.h"
+#include "vgmscan.h"
+#include "vgmtag.h"
+
+// Catalog of a library: header fields, GD3 tag and blocks of every file, sorted by path. Each field is
+// stored as a column of its own, so a query reads only the columns it tests. All integers are little-endian.
+//   header              struct vgm_catalog_header at offset 0
+//   columns             each one starting at a multiple of VGM_CATALOG_ALIGNMENT, at columns[] of the header
+//   strings             NUL-terminated UTF-8 at strings_offset, each distinct string once, "" first
+#define VGM_CATALOG_MAGIC     "VGMCATL"
+#define VGM_CATALOG_VERSION   1
+#define VGM_CATALOG_ALIGNMENT 64
+
+enum vgm_catalog_column
+{
+    // file_count entries
+    VGM_CATALOG_PATHS,          // uint32_t string offset
+    VGM_CATALOG_KEYS,           // struct vgm_cache_key, the file is indexed again when it changes
+    VGM_CATALOG_VERSIONS,       // uint32_t, BCD
+    VGM_CATALOG_TOTAL_SAMPLES,  // uint32_t
+    VGM_CATALOG_LOOP_OFFSETS,   // uint32_t, 0 if the track does not loop
+    VGM_CATALOG_LOOP_SAMPLES,   // uint32_t
+    VGM_CATALOG_RATES,          // uint32_t
+    VGM_CATALOG_GD3_OFFSETS,    // uint32_t, 0 if the file has no tag
+    VGM_CATALOG_CHIPS,          // uint64_t, bit 1 << enum vgm_chip for every chip with a clock
+    VGM_CATALOG_FIRST_CLOCKS,   // uint32_t, index of the first clock of the file, one per bit of its chips
+    VGM_CATALOG_BLOCK_TYPES,    // struct vgm_type_filter of the types of its blocks
+    VGM_CATALOG_FIRST_BLOCKS,   // uint32_t, index of its first block
+    VGM_CATALOG_BLOCK_COUNTS,   // uint32_t
+    VGM_CATALOG_GD3,            // VGM_GD3_FIELD_COUNT columns of uint32_t string offsets, see enum vgm_gd3_field
+    // clock_count entries
+    VGM_CATALOG_CLOCKS = VGM_CATALOG_GD3 + VGM_GD3_FIELD_COUNT, // uint32_t, header clock fields
+    // block_count entries, in file order
+    VGM_CATALOG_TYPES,          // uint8_t, after decompression
+    VGM_CATALOG_SIZES,          // uint32_t
+    VGM_CATALOG_HASHES,         // uint64_t, XXH64 of the extracted data
+    VGM_CATALOG_COLUMN_COUNT
+};
+
+struct vgm_catalog_header
+{
+    char magic[8];              // VGM_CATALOG_MAGIC
+    uint32_t version;
+    uint32_t column_count;      // VGM_CATALOG_COLUMN_COUNT
+    uint64_t file_count;
+    uint64_t clock_count;
+    uint64_t block_count;
+    uint64_t strings_offset;
+    uint64_t strings_size;
+    uint64_t columns[VGM_CATALOG_COLUMN_COUNT];
+};
+
+// Block of a file being added
+struct vgm_catalog_block
+{
+    uint64_t hash;
+    uint32_t size;
+    uint8_t type;
+};
+
+// Catalog mapped for reading
+struct vgm_catalog_reader
+{
+    uint8_t* base;
+    size_t size;
+    bool mapped;
+    const struct vgm_catalog_header* header;
+    const void* columns[VGM_CATALOG_COLUMN_COUNT];
+    const char* strings;
+};
+
+// View of one file, pointing into the mapped catalog
+struct vgm_catalog_file
+{
+    const char* path;
+    const struct vgm_cache_key* key;
+    uint32_t version;
+    uint32_t total_samples;
+    uint32_t loop_offset;
+    uint32_t loop_samples;
+    uint32_t rate;
+    uint32_t gd3_offset;
+    uint64_t chips;
+    const uint32_t* clocks;     // one per bit of chips, lowest first
+    const char* gd3[VGM_GD3_FIELD_COUNT];
+    const uint8_t* types;       // of its blocks
+    const uint32_t* sizes;
+    const uint64_t* hashes;
+    uint32_t block_count;
+};
+
+bool vgm_catalog_open(struct vgm_catalog_reader* reader, const char* filename);
+
+size_t vgm_catalog_count(const struct vgm_catalog_reader* reader);
+
+// File i in O(1), false if its entry points out of the catalog
+bool vgm_catalog_get(const struct vgm_catalog_reader* reader, size_t i, struct vgm_catalog_file* file);
+
+// Index of the file with this path in O(log n), SIZE_MAX if there is none
+size_t vgm_catalog_find(const struct vgm_catalog_reader* reader, const char* path);
+
+void vgm_catalog_close(struct vgm_catalog_reader* reader);
+
+// Files matching all the conditions set
+struct vgm_catalog_query
+{
+    uint64_t chips;             // using all of these chips, bits 1 << enum vgm_chip
+    bool has_types;             // holding a block of one of these types
+    struct vgm_type_filter types;
+    uint64_t min_size;          // holding a block of min_size to max_size bytes, of one of the types if set
+    uint64_t max_size;
+    char game[128];             // of a game whose name holds this text, case-insensitive for ASCII
+};
+
+// Add a condition like "chip=YMF278B", "type=80-8f", "game=castlevania" or "size=64k-1m", false if malformed
+bool vgm_catalog_parse_query(struct vgm_catalog_query* query, const char* term);
+
+// Indexes of the matching files in path order, to be freed by the caller. False if memory ran out.
+bool vgm_catalog_query(const struct vgm_catalog_reader* reader, const struct vgm_catalog_query* query,
+    size_t** matches, size_t* count);
+
+// Catalog being built, safe to use from several threads
+struct vgm_catalog;
+
+// Unchanged files are taken from previous, which must stay open until the catalog is finished. May be NULL.
+struct vgm_catalog* vgm_catalog_create(const struct vgm_catalog_reader* previous);
+
+// Take the entry of a file from the previous catalog, false if the file is not in it or changed since.
+// Without a key the entry is taken as it is, for files known to be unchanged.
+bool vgm_catalog_add_unchanged(struct vgm_catalog* catalog, const char* path, const struct vgm_cache_key* key);
+
+bool vgm_catalog_add(struct vgm_catalog* catalog, const char* path, const struct vgm_cache_key* key,
+    const struct vgm_tag* tag, const struct vgm_catalog_block* blocks, size_t count);
+
+// Sort the files by path, write the catalog and free it. A crash while writing leaves the old file in place.
+bool vgm_catalog_finish(struct vgm_catalog* catalog, const char* filename);
+
+#endif // _VGMCATALOG_H_
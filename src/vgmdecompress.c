@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vgmdecompress.h"
+
+static inline uint16_t read_u16(const uint8_t* ptr)
+{
+    return (uint16_t)(ptr[0] | ptr[1] << 8);
+}
+
+static inline uint32_t read_u32(const uint8_t* ptr)
+{
+    return (uint32_t)ptr[0] | (uint32_t)ptr[1] << 8 | (uint32_t)ptr[2] << 16 | (uint32_t)ptr[3] << 24;
+}
+
+bool vgm_read_decompression_table(struct vgm_decompression_table* table, const uint8_t* data, size_t size)
+{
+    // tt (compression) ss (sub-type) dd (bits decompressed) cc (bits compressed) nn nn (count) values...
+    if (size < 6) return false;
+
+    table->compression = data[0];
+    table->sub_type = data[1];
+    table->bits_decompressed = data[2];
+    table->bits_compressed = data[3];
+    table->count = read_u16(data + 4);
+
+    size_t value_size = table->bits_decompressed > 8 ? 2 : 1;
+    if (table->bits_decompressed == 0 || table->bits_decompressed > 16 || size - 6 < table->count * value_size)
+        return false;
+
+    data += 6;
+    for (size_t i = 0; i < table->count; ++i)
+    {
+        table->values[i] = value_size == 2 ? read_u16(data + 2 * i) : data[i];
+    }
+    return true;
+}
+
+void vgm_decompressor_init(struct vgm_decompressor* decompressor, const struct vgm_decompression_table* table,
+    bool (*write)(void* user, const uint8_t* data, size_t size), void* user)
+{
+    decompressor->table = table;
+    decompressor->header_size = 0;
+    decompressor->raw = false;
+    decompressor->lut = NULL;
+    decompressor->bits = 0;
+    decompressor->bit_count = 0;
+    decompressor->output_size = 0;
+    decompressor->write = write;
+    decompressor->user = user;
+    decompressor->error[0] = '\0';
+}
+
+static bool flush(struct vgm_decompressor* decompressor)
+{
+    bool result = decompressor->output_size == 0 ||
+        decompressor->write(decompressor->user, decompressor->output, decompressor->output_size);
+    decompressor->output_size = 0;
+    return result;
+}
+
+// Give up on decoding and write the block as it is, starting with the header
+static bool pass_through(struct vgm_decompressor* decompressor, const char* reason)
+{
+    snprintf(decompressor->error, sizeof(decompressor->error), "%s", reason);
+    decompressor->raw = true;
+    return decompressor->write(decompressor->user, decompressor->header, decompressor->header_size);
+}
+
+static bool setup(struct vgm_decompressor* decompressor)
+{
+    const uint8_t* header = decompressor->header;
+    const struct vgm_decompression_table* table = decompressor->table;
+
+    // cc (compression) ss ss ss ss (decompressed size) dd (bits decompressed) cc (bits compressed) tt (sub-type) aa aa
+    decompressor->compression = header[0];
+    decompressor->output_left = read_u32(header + 1);
+    decompressor->bits_decompressed = header[5];
+    decompressor->bits_compressed = header[6];
+    decompressor->sub_type = header[7];
+    uint16_t add = read_u16(header + 8);
+
+    unsigned bits_compressed = decompressor->bits_compressed;
+    unsigned bits_decompressed = decompressor->bits_decompressed;
+    if (bits_compressed == 0 || bits_compressed > 16 || bits_decompressed == 0 || bits_decompressed > 16)
+        return pass_through(decompressor, "unsupported bit sizes");
+
+    bool nbit = decompressor->compression == VGM_COMPRESSION_NBIT;
+    if (!nbit && decompressor->compression != VGM_COMPRESSION_DPCM)
+        return pass_through(decompressor, "unknown compression type");
+    if (nbit && decompressor->sub_type > VGM_NBIT_TABLE)
+        return pass_through(decompressor, "unknown bit-packing sub-type");
+    if (nbit && decompressor->sub_type == VGM_NBIT_SHIFT && bits_decompressed < bits_compressed)
+        return pass_through(decompressor, "invalid shift");
+
+    bool use_table = !nbit || decompressor->sub_type == VGM_NBIT_TABLE;
+    if (use_table && !table)
+        return pass_through(decompressor, "no decompression table");
+    if (use_table && (table->compression != decompressor->compression || (nbit && table->sub_type != decompressor->sub_type) ||
+        table->bits_decompressed != bits_decompressed || table->bits_compressed != bits_compressed))
+        return pass_through(decompressor, "decompression table does not match");
+
+    size_t entries = (size_t)1 << bits_compressed;
+    decompressor->lut = (uint16_t*)malloc(entries * sizeof(uint16_t));
+    if (!decompressor->lut)
+        return pass_through(decompressor, "out of memory");
+
+    // Precompute every possible field, decoding is then one lookup per value
+    for (uint32_t field = 0; field < entries; ++field)
+    {
+        if (use_table)
+            decompressor->lut[field] = field < table->count ? table->values[field] : 0;
+        else if (decompressor->sub_type == VGM_NBIT_SHIFT)
+            decompressor->lut[field] = (field << (bits_decompressed - bits_compressed)) + add;
+        else
+            decompressor->lut[field] = field + add;
+    }
+
+    decompressor->value = add; // DPCM start value
+    decompressor->mask = (uint16_t)((1u << bits_decompressed) - 1);
+    return true;
+}
+
+bool vgm_decompressor_feed(struct vgm_decompressor* decompressor, const uint8_t* data, size_t size)
+{
+    const uint8_t* ptr = data;
+    const uint8_t* end = data + size;
+
+    if (decompressor->header_size < VGM_COMPRESSED_HEADER_SIZE)
+    {
+        size_t copy = VGM_COMPRESSED_HEADER_SIZE - decompressor->header_size;
+        if (copy > size) copy = size;
+        memcpy(decompressor->header + decompressor->header_size, ptr, copy);
+        decompressor->header_size += copy;
+        ptr += copy;
+        if (decompressor->header_size < VGM_COMPRESSED_HEADER_SIZE) return true;
+        if (!setup(decompressor)) return false;
+    }
+
+    if (decompressor->raw)
+        return ptr == end || decompressor->write(decompressor->user, ptr, end - ptr);
+
+    const uint16_t* lut = decompressor->lut;
+    const unsigned width = decompressor->bits_compressed;
+    const uint32_t field_mask = (1u << width) - 1;
+    const size_t value_size = decompressor->bits_decompressed > 8 ? 2 : 1;
+    const bool dpcm = decompressor->compression == VGM_COMPRESSION_DPCM;
+    uint64_t bits = decompressor->bits;
+    unsigned bit_count = decompressor->bit_count;
+
+    while (decompressor->output_left >= value_size)
+    {
+        // refill up to 56 bits at once, then decode every complete field
+        while (bit_count <= 56 && ptr < end)
+        {
+            bits = bits << 8 | *ptr++;
+            bit_count += 8;
+        }
+        if (bit_count < width) break;
+
+        uint8_t* out = decompressor->output + decompressor->output_size;
+        while (bit_count >= width && decompressor->output_left >= value_size &&
+            decompressor->output_size + value_size <= VGM_DECOMPRESS_BUFFER_SIZE)
+        {
+            bit_count -= width;
+            uint16_t value = lut[(bits >> bit_count) & field_mask];
+            if (dpcm)
+                value = decompressor->value = (decompressor->value + value) & decompressor->mask;
+            *out++ = (uint8_t)value;
+            if (value_size == 2) *out++ = (uint8_t)(value >> 8);
+            decompressor->output_size += value_size;
+            decompressor->output_left -= value_size;
+        }
+
+        if (decompressor->output_size + value_size > VGM_DECOMPRESS_BUFFER_SIZE && !flush(decompressor))
+            return false;
+    }
+
+    decompressor->bits = bits;
+    decompressor->bit_count = bit_count;
+    return true;
+}
+
+bool vgm_decompressor_finish(struct vgm_decompressor* decompressor)
+{
+    if (decompressor->header_size < VGM_COMPRESSED_HEADER_SIZE)
+        return pass_through(decompressor, "truncated compression header");
+    if (!decompressor->raw && decompressor->output_left > 0)
+        snprintf(decompressor->error, sizeof(decompressor->error), "%u bytes missing", decompressor->output_left);
+    return flush(decompressor);
+}
+
+void vgm_decompressor_free(struct vgm_decompressor* decompressor)
+{
+    free(decompressor->lut);
+    decompressor->lut = NULL;
+}
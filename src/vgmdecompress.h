@@ -0,0 +1,68 @@
+#ifndef _VGMDECOMPRESS_H_
+#define _VGMDECOMPRESS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define VGM_COMPRESSION_NBIT 0x00
+#define VGM_COMPRESSION_DPCM 0x01
+
+#define VGM_NBIT_COPY  0x00
+#define VGM_NBIT_SHIFT 0x01
+#define VGM_NBIT_TABLE 0x02
+
+#define VGM_COMPRESSED_HEADER_SIZE 10
+#define VGM_DECOMPRESS_BUFFER_SIZE 8192
+
+// Decompression table from a 0x7F data block
+struct vgm_decompression_table
+{
+    uint8_t compression;        // VGM_COMPRESSION_*
+    uint8_t sub_type;
+    uint8_t bits_decompressed;
+    uint8_t bits_compressed;
+    uint16_t count;
+    uint16_t values[65536];
+};
+
+// Streaming decoder for data blocks of type 0x40-0x7E
+struct vgm_decompressor
+{
+    const struct vgm_decompression_table* table;
+    uint8_t header[VGM_COMPRESSED_HEADER_SIZE];
+    size_t header_size;
+    bool raw;                   // parameters not supported: pass data through
+    uint8_t compression;
+    uint8_t sub_type;
+    uint8_t bits_decompressed;
+    uint8_t bits_compressed;
+    uint32_t output_left;       // bytes of decompressed data still expected
+    uint16_t value;             // last DPCM value
+    uint16_t mask;              // valid bits of a decompressed value
+    uint64_t bits;              // unread input bits, right-aligned
+    unsigned bit_count;
+    uint16_t* lut;              // compressed field (read MSB first) -> value or delta
+    uint8_t output[VGM_DECOMPRESS_BUFFER_SIZE];
+    size_t output_size;
+    bool (*write)(void* user, const uint8_t* data, size_t size);
+    void* user;
+    char error[128];
+};
+
+// Parse a 0x7F block, return false if it is malformed
+bool vgm_read_decompression_table(struct vgm_decompression_table* table, const uint8_t* data, size_t size);
+
+// table may be NULL when the stream has none yet
+void vgm_decompressor_init(struct vgm_decompressor* decompressor, const struct vgm_decompression_table* table,
+    bool (*write)(void* user, const uint8_t* data, size_t size), void* user);
+
+// Decode the next piece of block data and write the result
+bool vgm_decompressor_feed(struct vgm_decompressor* decompressor, const uint8_t* data, size_t size);
+
+// Flush pending output, return false if the block could not be decompressed
+bool vgm_decompressor_finish(struct vgm_decompressor* decompressor);
+
+void vgm_decompressor_free(struct vgm_decompressor* decompressor);
+
+#endif // _VGMDECOMPRESS_H_
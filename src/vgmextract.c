@@ -0,0 +1,1794 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <zlib.h>
+
+#if !defined(_WIN32)
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#include "vgmarena.h"
+#include "vgmcache.h"
+#include "vgmdecompress.h"
+#include "vgmextract.h"
+#include "vgmgzindex.h"
+#include "vgmhash.h"
+#include "vgmpack.h"
+#include "vgmrom.h"
+#include "vgmscan.h"
+#include "vgmtag.h"
+#include "vgmwriter.h"
+#include "vgmzip.h"
+
+#define VGM_HEADER_SIZE 0x40
+#define VGM_EOF_OFFSET  0x04
+#define VGM_DATA_OFFSET 0x34
+#define VGZ_CHUNK_SIZE  (256 * 1024)
+#define SCAN_SLICE_SIZE (4 * 1024 * 1024)   // mapped data is scanned in slices to report progress
+#define READ_CHUNK_SIZE (1024 * 1024)
+
+static const char* type_descriptions[] = {
+    "uncompressed streams",
+    "compressed streams",
+    "", // redundant
+    "ROM/RAM dumps",
+    "RAM writes (<= 64 KB)",
+    "RAM writes (> 64 KB)",
+};
+
+static const char* chip_type[256] = {
+    [0x00] = "YM2612 PCM data",
+    [0x01] = "RF5C68 PCM data",
+    [0x02] = "RF5C164 PCM data",
+    [0x03] = "PWM PCM data",
+    [0x04] = "OKIM6258 ADPCM data",
+    [0x05] = "HuC6280 PCM data",
+    [0x06] = "SCSP PCM data",
+    [0x07] = "NES APU DPCM",
+    [0x08] = "Mikey PCM data",
+    [0x09 ... 0x3F] = "uncompressed",
+    [0x40] = "YM2612 PCM data (compressed)",
+    [0x41] = "RF5C68 PCM data (compressed)",
+    [0x42] = "RF5C164 PCM data (compressed)",
+    [0x43] = "PWM PCM data (compressed)",
+    [0x44] = "OKIM6258 ADPCM data (compressed)",
+    [0x45] = "HuC6280 PCM data (compressed)",
+    [0x46] = "SCSP PCM data (compressed)",
+    [0x47] = "NES APU DPCM (compressed)",
+    [0x48] = "Mikey PCM data (compressed)",
+    [0x49 ... 0x7E] = "compressed",
+    [0x7F] = "decompression table",
+    [0x80] = "Sega PCM ROM data",
+    [0x81] = "YM2608 DELTA-T ROM data",
+    [0x82] = "YM2610 ADPCM ROM data",
+    [0x83] = "YM2610 DELTA-T ROM data",
+    [0x84] = "YMF278B ROM data",
+    [0x85] = "YMF271 ROM data",
+    [0x86] = "YMZ280B ROM data",
+    [0x87] = "YMF278B RAM data",
+    [0x88] = "Y8950 DELTA-T ROM data",
+    [0x89] = "MultiPCM ROM data",
+    [0x8A] = "uPD7759 ROM data",
+    [0x8B] = "OKIM6295 ROM data",
+    [0x8C] = "K054539 ROM data",
+    [0x8D] = "C140 ROM data",
+    [0x8E] = "K053260 ROM data",
+    [0x8F] = "Q-Sound ROM data",
+    [0x90] = "ES5505/ES5506 ROM data",
+    [0x91] = "X1-010 ROM data",
+    [0x92] = "C352 ROM data",
+    [0x93] = "GA20 ROM data",
+    [0xC0] = "RF5C68 RAM write",
+    [0xC1] = "RF5C164 RAM write",
+    [0xC2] = "NES APU RAM write",
+    [0xE0] = "SCSP RAM write",
+    [0xE1] = "ES5503 RAM write",
+};
+
+const char* get_chip_name(uint8_t type)
+{
+    return chip_type[type] ? chip_type[type] : "???";
+}
+
+const char* get_type_description(uint8_t type)
+{
+    if (type <= 0x3f)
+        return type_descriptions[0];
+    else if (type <= 0x7e)
+        return type_descriptions[1];
+    else if (type == 0x7f)
+        return type_descriptions[2];
+    else if (type <= 0xbf)
+        return type_descriptions[3];
+    else if (type <= 0xdf)
+        return type_descriptions[4];
+    return type_descriptions[5];
+}
+
+static void report_progress(struct VGMBlockList* list, uint64_t bytes)
+{
+    if (list->progress && bytes > 0)
+        list->progress(list->progress_user, bytes);
+}
+
+// Keep the first error, later ones are usually consequences of it
+static void set_error(struct VGMBlockList* list, const char* fmt, ...)
+{
+    if (list->error[0]) return;
+
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(list->error, sizeof(list->error), fmt, ap);
+    va_end(ap);
+}
+
+void clear_block_list_error(struct VGMBlockList* list)
+{
+    list->error[0] = '\0';
+}
+
+// Something the caller may want to show that did not stop the extraction
+static void add_warning(struct VGMBlockList* list, const char* fmt, ...)
+{
+    char line[256];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+
+    list->warning_count++;
+    size_t length = strlen(list->warnings);
+    if (length + strlen(line) + 1 < sizeof(list->warnings))
+        snprintf(list->warnings + length, sizeof(list->warnings) - length, "%s\n", line);
+}
+
+void clear_block_list_warnings(struct VGMBlockList* list)
+{
+    list->warnings[0] = '\0';
+    list->warning_count = 0;
+}
+
+static const char* phase_names[VGM_PHASE_COUNT] = { "read", "inflate", "scan", "copy", "write" };
+
+const char* get_phase_name(enum vgm_phase phase)
+{
+    return phase < VGM_PHASE_COUNT ? phase_names[phase] : "";
+}
+
+void clear_block_list_stats(struct VGMBlockList* list)
+{
+    memset(list->stats.seconds, 0, sizeof(list->stats.seconds));
+    list->stats.allocations = 0;
+    list->stats.peak_heap = list->stats.heap;
+}
+
+// Charge the time since the last switch to the phase that ran, then run another one, VGM_PHASE_COUNT for none.
+// Returns the phase that ran, to switch back to it. One clock read, so blocks cost two.
+static enum vgm_phase switch_phase(struct VGMBlockList* list, enum vgm_phase phase)
+{
+    struct VGMStats* stats = &list->stats;
+    enum vgm_phase previous = stats->phase_start > 0 ? stats->phase : VGM_PHASE_COUNT;
+    if (phase == previous) return previous;
+
+    double now = get_time_monotonic();
+    if (previous < VGM_PHASE_COUNT) stats->seconds[previous] += now - stats->phase_start;
+    stats->phase = phase;
+    stats->phase_start = phase < VGM_PHASE_COUNT ? now : 0;
+    return previous;
+}
+
+// Memory the list took over (bytes > 0) or released
+static void hold_heap(struct VGMBlockList* list, ptrdiff_t bytes)
+{
+    list->stats.heap += bytes;
+    if (list->stats.heap > list->stats.peak_heap) list->stats.peak_heap = list->stats.heap;
+}
+
+// Memory allocated or grown for the list
+static void count_allocation(struct VGMBlockList* list, size_t bytes)
+{
+    list->stats.allocations++;
+    hold_heap(list, bytes);
+}
+
+// Take memory from the arena of the list, or grow what was taken. Only chunks the arena gets from the
+// system count as allocations, it keeps them until the list is reset.
+static void* resize_allocation(struct VGMBlockList* list, void* ptr, size_t old_size, size_t size)
+{
+    size_t held = list->arena.size;
+    void* result = vgm_arena_resize(&list->arena, ptr, old_size, size);
+    if (list->arena.size > held)
+        count_allocation(list, list->arena.size - held);
+    else
+        hold_heap(list, -(ptrdiff_t)(held - list->arena.size));
+    if (!result)
+        set_error(list, "Memory allocation error");
+    return result;
+}
+
+// Make room for one more block in the index
+static bool reserve_block(struct VGMBlockList* list)
+{
+    if (list->count < list->capacity) return true;
+
+    size_t capacity = list->capacity ? list->capacity * 2 : 256;
+    struct VGMDataBlock* tmp = (struct VGMDataBlock*)resize_allocation(list, list->blocks,
+        list->capacity * sizeof(struct VGMDataBlock), capacity * sizeof(struct VGMDataBlock));
+    if (!tmp)
+        return false;
+    list->blocks = tmp;
+    list->capacity = capacity;
+    return true;
+}
+
+const uint8_t* get_block_data(const struct VGMBlockList* list, size_t index, size_t* size)
+{
+    const struct VGMDataBlock* block = &list->blocks[index];
+    if (block->source == NO_SOURCE) return NULL;
+
+    const struct VGMSource* source = &list->sources[block->source];
+    if (block->offset > source->size) return NULL;
+    *size = source->size - block->offset < block->size ? source->size - block->offset : block->size;
+    return source->base + block->offset;
+}
+
+static void get_store_file_name(const struct VGMBlockList* list, uint64_t hash, char* filename, size_t size)
+{
+    snprintf(filename, size, "%s/%016llx.raw", list->store_dir, (unsigned long long)hash);
+}
+
+void get_block_file_name(const struct VGMBlockList* list, size_t index, char* filename, size_t size)
+{
+    if (list->store_dir)
+        get_store_file_name(list, list->blocks[index].hash, filename, size);
+    else if (list->output_dir)
+        snprintf(filename, size, "%s/%sblock_%zu.raw", list->output_dir, list->name_prefix, index);
+    else
+        snprintf(filename, size, "%sblock_%zu.raw", list->name_prefix, index);
+}
+
+// Blocks go to the store under a name unique to the list until their hash is known
+static void get_temp_file_name(const struct VGMBlockList* list, char* filename, size_t size)
+{
+    snprintf(filename, size, "%s/.%p.tmp", list->store_dir, (const void*)list);
+}
+
+static bool file_exists(const char* filename)
+{
+    FILE* file = fopen(filename, "rb");
+    if (file) fclose(file);
+    return file != NULL;
+}
+
+// Writes the blocks found by the scanner to block_N.raw files, to the store or to the pack,
+// or only indexes them for an in-memory list
+struct block_writer {
+    struct VGMBlockList* list;
+    size_t source;   // source the scanned stream lives in, or NO_SOURCE
+    size_t base;     // offset of the stream inside the source
+    const char* filename;                   // file being scanned
+    size_t first_block;                     // index of its first block in the list
+    struct vgm_output* output;              // file of the current block, written in the background
+    uint32_t written;                       // bytes written for the current block
+    struct vgm_hash hash;                   // of the bytes written so far
+    bool hashed;                            // hash known before writing, entry->hash is set
+    bool stored;                            // block already in the store, nothing to write
+    struct vgm_decompression_table* table;  // most recent 0x7F block of the stream
+    uint8_t* table_data;                    // 0x7F block being collected
+    size_t table_size;
+    bool decompressing;
+    struct vgm_decompressor decompressor;
+    uint64_t pack_offset;                   // room reserved for the current block in the pack
+    bool buffered;                          // current block is gathered in buffer
+    uint8_t* buffer;                        // decompressed block for the pack, kept until its size is known,
+    size_t buffer_size;                     // or block of an in-memory list that is not in a source
+    size_t buffer_capacity;
+    struct vgm_pack_entry* entries;         // pack index of the blocks of the file
+    size_t entry_count;
+    size_t entry_capacity;
+    struct vgm_gz_index* gz_index;          // block table of the .vgz index being built
+    uint32_t gz_table;                      // index number of the decompression table in effect
+    bool gz_has_table;                      // a valid table, or one left out by the filter, is in effect
+    bool merge_roms;                        // ROM dump pieces go into images written after the other blocks
+    struct vgm_rom* roms;                   // images of the file, one per chip
+    size_t rom_count;
+    size_t rom_capacity;
+    struct vgm_rom* rom;                    // image the current block goes into, NULL for a block of its own
+    uint32_t rom_address;                   // where the next bytes of the current block go
+    enum vgm_phase block_phase;             // phase the current block interrupted, back to it at its end
+};
+
+static inline bool is_compressed(uint8_t type)
+{
+    return type >= 0x40 && type <= 0x7e;
+}
+
+#define NO_PACK_OFFSET UINT64_MAX
+
+static bool write_block_output(void* user, const uint8_t* data, size_t size);
+static bool add_source(struct VGMBlockList* list, const struct VGMSource* source);
+
+static bool get_writer(struct VGMBlockList* list)
+{
+    if (list->in_memory || list->list_only) return true; // nothing to write
+
+    if (!list->writer && !(list->writer = vgm_writer_create()))
+    {
+        set_error(list, "Memory allocation failed\n");
+        return false;
+    }
+    return true;
+}
+
+// The .vgz index numbers every block of the file, left out by the filter or not
+static bool index_block(struct block_writer* writer, const struct vgm_block_info* block)
+{
+    if (!writer->gz_index) return true;
+
+    if (!vgm_gz_index_add_block(writer->gz_index, writer->base + block->offset, block->size, block->type,
+        writer->gz_has_table ? writer->gz_table : VGM_GZ_NO_TABLE))
+    {
+        set_error(writer->list, "Memory allocation error");
+        return false;
+    }
+    return true;
+}
+
+// Memory held by a ROM image
+static size_t get_rom_size(const struct vgm_rom* rom)
+{
+    return rom->capacity + rom->range_capacity * sizeof(struct vgm_rom_range);
+}
+
+// A piece of a ROM dump goes into the image of its chip, the image is written at the end of the file
+static bool begin_rom_piece(struct block_writer* writer, const struct vgm_block_info* block)
+{
+    if (!index_block(writer, block))
+        return false;
+
+    struct vgm_rom* rom = NULL;
+    for (size_t i = 0; i < writer->rom_count && !rom; ++i)
+    {
+        if (writer->roms[i].type == block->type && writer->roms[i].chip == block->chip)
+            rom = &writer->roms[i];
+    }
+    if (!rom)
+    {
+        if (writer->rom_count == writer->rom_capacity)
+        {
+            size_t capacity = writer->rom_capacity ? writer->rom_capacity * 2 : 4;
+            struct vgm_rom* tmp = (struct vgm_rom*)realloc(writer->roms, capacity * sizeof(struct vgm_rom));
+            if (!tmp)
+            {
+                set_error(writer->list, "Memory allocation failed\n");
+                return false;
+            }
+            count_allocation(writer->list, (capacity - writer->rom_capacity) * sizeof(struct vgm_rom));
+            writer->roms = tmp;
+            writer->rom_capacity = capacity;
+        }
+        rom = &writer->roms[writer->rom_count++];
+        vgm_rom_init(rom, block->type, block->chip);
+    }
+    writer->rom = rom;
+    writer->rom_address = vgm_rom_begin_piece(rom, block->header, block->header_size);
+    return true;
+}
+
+static bool write_rom_piece(struct block_writer* writer, const uint8_t* data, size_t size)
+{
+    size_t held = get_rom_size(writer->rom);
+    if (!vgm_rom_write(writer->rom, writer->rom_address, data, size))
+    {
+        set_error(writer->list, "Memory allocation failed\n");
+        return false;
+    }
+    if (get_rom_size(writer->rom) > held)
+        count_allocation(writer->list, get_rom_size(writer->rom) - held);
+    writer->rom_address += size;
+    return true;
+}
+
+static bool begin_block(void* user, const struct vgm_block_info* block)
+{
+    struct block_writer* writer = (struct block_writer*)user;
+    struct VGMBlockList* list = writer->list;
+
+    // a block is copying from here to end_block(), calls to the writer excepted
+    writer->block_phase = switch_phase(list, VGM_PHASE_COPY);
+
+    if (writer->merge_roms && vgm_rom_is_dump(block->type))
+        return begin_rom_piece(writer, block);
+
+    if (!reserve_block(list))
+        return false;
+
+    struct VGMDataBlock* entry = &list->blocks[list->count];
+    entry->type = block->type;
+    entry->size = block->size;
+    entry->source = writer->source;
+    entry->offset = writer->base + block->offset;
+    writer->written = 0;
+    writer->hashed = false;
+    writer->stored = false;
+    writer->decompressing = is_compressed(block->type);
+    writer->buffer_size = 0;
+    if (list->in_memory)
+        writer->buffered = writer->source == NO_SOURCE || writer->decompressing;
+    else
+        writer->buffered = list->pack && writer->decompressing;
+    // a block gathered for an in-memory list goes to the arena, taken at once when its size is known
+    if (list->in_memory && writer->buffered)
+    {
+        writer->buffer = (uint8_t*)resize_allocation(list, NULL, 0, block->size);
+        writer->buffer_capacity = block->size;
+        if (!writer->buffer) return false;
+    }
+    vgm_hash_reset(&writer->hash);
+
+    if (!index_block(writer, block))
+        return false;
+
+    if (block->type == 0x7f)
+    {
+        free(writer->table_data);
+        writer->table_size = 0;
+        if (!(writer->table_data = (uint8_t*)malloc(block->size))) {
+            set_error(list, "Memory allocation error");
+            return false;
+        }
+    }
+
+    char filename[4096];
+    if (list->in_memory || list->list_only)
+    {
+        // views into the source need nothing more, listed blocks are only hashed
+    }
+    else if (list->pack)
+    {
+        // the size of decompressed data is known at the end of the block only
+        writer->pack_offset = writer->decompressing ? NO_PACK_OFFSET : vgm_pack_reserve(list->pack, block->size);
+    }
+    else if (list->store_dir)
+    {
+        // a block held whole in memory is hashed first, so a duplicate costs no write at all
+        const struct VGMSource* source = writer->source != NO_SOURCE ? &list->sources[writer->source] : NULL;
+        if (source && !writer->decompressing && entry->offset + block->size <= source->size)
+        {
+            entry->hash = vgm_hash_buffer(source->base + entry->offset, block->size);
+            writer->hashed = true;
+            get_block_file_name(list, list->count, filename, sizeof(filename));
+            writer->stored = file_exists(filename);
+        }
+        if (!writer->stored)
+            get_temp_file_name(list, filename, sizeof(filename));
+    }
+    else
+    {
+        get_block_file_name(list, list->count, filename, sizeof(filename));
+    }
+
+    // errors of the writer are collected by sync_block_list()
+    if (!list->in_memory && !list->list_only && !list->pack && !writer->stored)
+    {
+        enum vgm_phase phase = switch_phase(list, VGM_PHASE_WRITE);
+        writer->output = vgm_writer_open(list->writer, filename);
+        switch_phase(list, phase);
+        if (!writer->output) return false;
+    }
+
+    if (writer->decompressing)
+        vgm_decompressor_init(&writer->decompressor, writer->table, write_block_output, writer);
+    return true;
+}
+
+static bool append_buffer(struct block_writer* writer, const uint8_t* data, size_t size)
+{
+    if (writer->buffer_size + size > writer->buffer_capacity)
+    {
+        size_t capacity = writer->buffer_capacity ? writer->buffer_capacity * 2 : 64 * 1024;
+        while (capacity < writer->buffer_size + size) capacity *= 2;
+        uint8_t* tmp;
+        if (writer->list->in_memory)
+            tmp = (uint8_t*)resize_allocation(writer->list, writer->buffer, writer->buffer_capacity, capacity);
+        else if ((tmp = (uint8_t*)realloc(writer->buffer, capacity)))
+            count_allocation(writer->list, capacity - writer->buffer_capacity);
+        else
+            set_error(writer->list, "Memory allocation failed\n");
+        if (!tmp)
+            return false;
+        writer->buffer = tmp;
+        writer->buffer_capacity = capacity;
+    }
+    memcpy(writer->buffer + writer->buffer_size, data, size);
+    writer->buffer_size += size;
+    return true;
+}
+
+static bool write_block_output(void* user, const uint8_t* data, size_t size)
+{
+    struct block_writer* writer = (struct block_writer*)user;
+    struct VGMBlockList* list = writer->list;
+
+    if (writer->stored)
+    {
+        writer->written += size;
+        list->bytes_reused += size;
+        return true;
+    }
+
+    // blocks of a source in memory stay there until the list is synced, others are copied
+    bool copy = writer->source == NO_SOURCE || writer->decompressing;
+    bool result = true;
+    if (writer->buffered)
+    {
+        result = append_buffer(writer, data, size);
+    }
+    else if (!list->in_memory && !list->list_only)
+    {
+        // the writer blocks while its queue is full
+        enum vgm_phase phase = switch_phase(list, VGM_PHASE_WRITE);
+        if (list->pack)
+            result = vgm_writer_write_pack(list->writer, list->pack, writer->pack_offset + writer->written, data, size, copy);
+        else
+            result = vgm_writer_write(list->writer, writer->output, data, size, copy);
+        switch_phase(list, phase);
+#if defined(VGM_THREADS)
+        // copied for the writer thread
+        if (copy) list->stats.allocations++;
+#endif
+    }
+    if (!result)
+        return false;
+
+    if (!writer->hashed)
+        vgm_hash_update(&writer->hash, data, size);
+    writer->written += size;
+    if (!list->list_only) list->bytes_out += size;
+    return true;
+}
+
+static bool write_block_data(void* user, const uint8_t* data, size_t size)
+{
+    struct block_writer* writer = (struct block_writer*)user;
+
+    if (writer->rom)
+        return write_rom_piece(writer, data, size);
+    if (writer->table_data)
+    {
+        memcpy(writer->table_data + writer->table_size, data, size);
+        writer->table_size += size;
+    }
+    if (writer->decompressing)
+        return vgm_decompressor_feed(&writer->decompressor, data, size);
+    return write_block_output(writer, data, size);
+}
+
+// Write a decompressed block to the pack, then index the block
+static bool add_pack_entry(struct block_writer* writer, const struct VGMDataBlock* block)
+{
+    struct VGMBlockList* list = writer->list;
+
+    if (writer->pack_offset == NO_PACK_OFFSET)
+    {
+        enum vgm_phase phase = switch_phase(list, VGM_PHASE_WRITE);
+        writer->pack_offset = vgm_pack_reserve(list->pack, writer->buffer_size);
+        bool result = vgm_writer_write_pack(list->writer, list->pack, writer->pack_offset, writer->buffer,
+            writer->buffer_size, true);
+        switch_phase(list, phase);
+        if (!result)
+            return false;
+    }
+
+    if (writer->entry_count == writer->entry_capacity)
+    {
+        size_t capacity = writer->entry_capacity ? writer->entry_capacity * 2 : 256;
+        struct vgm_pack_entry* tmp = (struct vgm_pack_entry*)realloc(writer->entries, capacity * sizeof(struct vgm_pack_entry));
+        if (!tmp)
+        {
+            set_error(list, "Memory allocation failed\n");
+            return false;
+        }
+        count_allocation(list, (capacity - writer->entry_capacity) * sizeof(struct vgm_pack_entry));
+        writer->entries = tmp;
+        writer->entry_capacity = capacity;
+    }
+
+    struct vgm_pack_entry* entry = &writer->entries[writer->entry_count++];
+    memset(entry, 0, sizeof(*entry));
+    entry->offset = writer->pack_offset;
+    entry->length = writer->written;
+    entry->hash = block->hash;
+    entry->block = (uint32_t)(list->count - writer->first_block);
+    entry->type = (uint8_t)block->type;
+    snprintf(entry->chip, sizeof(entry->chip), "%s", get_chip_name(entry->type));
+    return true;
+}
+
+// Keep the 0x7F block just collected as the table for the following blocks
+static void update_decompression_table(struct block_writer* writer)
+{
+    if (!writer->table && !(writer->table = (struct vgm_decompression_table*)malloc(sizeof(*writer->table))))
+        return;
+    if (!vgm_read_decompression_table(writer->table, writer->table_data, writer->table_size))
+    {
+        add_warning(writer->list, "block_%zu.raw: invalid decompression table", writer->list->count);
+        free(writer->table);
+        writer->table = NULL;
+    }
+    if (writer->gz_index)
+        writer->gz_table = (uint32_t)(writer->gz_index->header.block_count - 1);
+    writer->gz_has_table = writer->table != NULL;
+}
+
+// Point the block of an in-memory list at its bytes, the gathered ones become a source of their own
+static bool keep_block_in_memory(struct block_writer* writer, struct VGMDataBlock* entry)
+{
+    entry->size = writer->written;
+    if (!writer->buffered) return true;
+
+    // the block stays where it was gathered in the arena, trimmed to its size
+    uint8_t* base = (uint8_t*)resize_allocation(writer->list, writer->buffer, writer->buffer_capacity,
+        writer->buffer_size);
+    struct VGMSource source = { base, writer->buffer_size, false, true };
+    writer->buffer = NULL;
+    writer->buffer_size = writer->buffer_capacity = 0;
+    if (!add_source(writer->list, &source))
+        return false;
+    entry->source = writer->list->source_count - 1;
+    entry->offset = 0;
+    return true;
+}
+
+static bool end_block(void* user)
+{
+    struct block_writer* writer = (struct block_writer*)user;
+    if (writer->rom)
+    {
+        writer->rom = NULL;
+        switch_phase(writer->list, writer->block_phase);
+        return true;
+    }
+
+    struct VGMDataBlock* entry = &writer->list->blocks[writer->list->count];
+    if (writer->decompressing)
+    {
+        bool result = vgm_decompressor_finish(&writer->decompressor);
+        vgm_decompressor_free(&writer->decompressor);
+        writer->decompressing = false;
+        if (!result) return false;
+
+        if (writer->decompressor.error[0])
+            add_warning(writer->list, "block_%zu.raw: %s%s", writer->list->count, writer->decompressor.error,
+                writer->decompressor.raw ? ", saved compressed" : "");
+        if (!writer->decompressor.raw)
+        {
+            // the file now holds the uncompressed stream
+            entry->type -= 0x40;
+            entry->source = NO_SOURCE;
+        }
+        entry->size = writer->written;
+    }
+
+    if (writer->table_data)
+    {
+        update_decompression_table(writer);
+        free(writer->table_data);
+        writer->table_data = NULL;
+    }
+
+    if (writer->list->in_memory && !keep_block_in_memory(writer, entry))
+        return false;
+
+    if (!writer->hashed)
+        entry->hash = vgm_hash_digest(&writer->hash);
+    if (writer->list->pack && !add_pack_entry(writer, entry))
+        return false;
+
+    if (writer->output)
+    {
+        // a temporary file is moved into the store, unless another file brought the same block first
+        char filename[4096];
+        get_block_file_name(writer->list, writer->list->count, filename, sizeof(filename));
+        switch_phase(writer->list, VGM_PHASE_WRITE);
+        bool result = vgm_writer_close(writer->list->writer, writer->output, writer->list->store_dir ? filename : NULL);
+        writer->output = NULL;
+        if (!result) return false;
+    }
+    //printf("File saved to block_%zu.raw\n", writer->list->count);
+    writer->list->count++;
+    switch_phase(writer->list, writer->block_phase);
+    return true;
+}
+
+// A block left out by the filter still goes into the .vgz index. A table left out cannot be checked,
+// single-block reads find out when they load it.
+static bool skip_block(void* user, const struct vgm_block_info* block)
+{
+    struct block_writer* writer = (struct block_writer*)user;
+    if (!index_block(writer, block))
+        return false;
+    if (writer->gz_index && block->type == 0x7f)
+    {
+        writer->gz_table = (uint32_t)(writer->gz_index->header.block_count - 1);
+        writer->gz_has_table = true;
+    }
+    return true;
+}
+
+static const struct vgm_block_sink block_writer_sink = { begin_block, write_block_data, end_block, skip_block };
+
+// Zeros of a ROM image no piece wrote: a hole in a block file, written out elsewhere
+static bool write_rom_hole(struct block_writer* writer, uint32_t size)
+{
+    static const uint8_t zeros[4096];
+    struct VGMBlockList* list = writer->list;
+
+    if (writer->output)
+    {
+        for (uint32_t left = size; left > 0;)
+        {
+            uint32_t length = left < sizeof(zeros) ? left : sizeof(zeros);
+            vgm_hash_update(&writer->hash, zeros, length);
+            left -= length;
+        }
+        enum vgm_phase phase = switch_phase(list, VGM_PHASE_WRITE);
+        bool result = vgm_writer_skip(list->writer, writer->output, size);
+        switch_phase(list, phase);
+        writer->written += size;
+        return result;
+    }
+
+    for (uint32_t left = size; left > 0;)
+    {
+        uint32_t length = left < sizeof(zeros) ? left : sizeof(zeros);
+        if (!write_block_output(writer, zeros, length)) return false;
+        left -= length;
+    }
+    return true;
+}
+
+// Tell which parts of an image were never uploaded
+static void report_missing_ranges(struct VGMBlockList* list, const struct vgm_rom* rom)
+{
+    struct vgm_rom_range ranges[4];
+    size_t count = vgm_rom_get_missing(rom, ranges, 4);
+    if (count == 0) return;
+
+    char text[128] = "";
+    size_t length = 0;
+    for (size_t i = 0; i < count && i < 4; ++i)
+        length += snprintf(text + length, sizeof(text) - length, "%s%x-%x", i ? ", " : "", ranges[i].start,
+            ranges[i].end - 1);
+    add_warning(list, "block_%zu.raw: %s image, %u of %u bytes missing at %s%s", list->count - 1,
+        get_chip_name(rom->type), vgm_rom_get_missing_size(rom), rom->size, text, count > 4 ? ", ..." : "");
+}
+
+// Write the ROM images put together from the pieces of the file, after its other blocks
+static bool write_rom_images(struct block_writer* writer)
+{
+    // the images are in no source, and the .vgz index lists their pieces
+    writer->source = NO_SOURCE;
+    writer->gz_index = NULL;
+    writer->merge_roms = false;
+
+    for (size_t i = 0; i < writer->rom_count; ++i)
+    {
+        const struct vgm_rom* rom = &writer->roms[i];
+        if (rom->size == 0) continue;
+
+        struct vgm_block_info info = { .type = rom->type, .chip = rom->chip, .size = rom->size };
+        if (!begin_block(writer, &info))
+            return false;
+        uint32_t address = 0;
+        for (size_t j = 0; j < rom->range_count; ++j)
+        {
+            const struct vgm_rom_range* range = &rom->ranges[j];
+            if (!write_rom_hole(writer, range->start - address) ||
+                !write_block_output(writer, rom->data + range->start, range->end - range->start))
+                return false;
+            address = range->end;
+        }
+        if (!write_rom_hole(writer, rom->size - address) || !end_block(writer))
+            return false;
+        report_missing_ranges(writer->list, rom);
+    }
+    return true;
+}
+
+static void close_block_writer(struct block_writer* writer)
+{
+    // block interrupted by an error
+    if (writer->output) vgm_writer_discard(writer->list->writer, writer->output);
+    writer->output = NULL;
+    if (writer->decompressing) vgm_decompressor_free(&writer->decompressor);
+    free(writer->table_data);
+    free(writer->table);
+
+    // the index of the pack lists the blocks of a file together
+    if (writer->entry_count > 0 && !vgm_pack_add(writer->list->pack, writer->filename, writer->entries, writer->entry_count))
+        set_error(writer->list, "Memory allocation failed\n");
+    free(writer->entries);
+    hold_heap(writer->list, -(ptrdiff_t)(writer->entry_capacity * sizeof(struct vgm_pack_entry)));
+    // a block of an in-memory list interrupted by an error is left in the arena
+    if (!writer->list->in_memory)
+    {
+        free(writer->buffer);
+        hold_heap(writer->list, -(ptrdiff_t)writer->buffer_capacity);
+    }
+
+    for (size_t i = 0; i < writer->rom_count; ++i)
+    {
+        hold_heap(writer->list, -(ptrdiff_t)get_rom_size(&writer->roms[i]));
+        vgm_rom_free(&writer->roms[i]);
+    }
+    free(writer->roms);
+    hold_heap(writer->list, -(ptrdiff_t)(writer->rom_capacity * sizeof(struct vgm_rom)));
+}
+
+static void finish_scan(struct VGMBlockList* list, struct vgm_scanner* scanner)
+{
+    if (!vgm_scanner_finish(scanner) && scanner->error[0])
+        set_error(list, "%s", scanner->error);
+    if (scanner->recovered)
+        add_warning(list, "Unknown command 0x%02X at 0x%llx, switched to recovery scan", scanner->unknown_command,
+            (unsigned long long)scanner->unknown_offset);
+}
+
+// Scan a command stream held in the last source
+static size_t extract_data_blocks(struct VGMBlockList* list, const char* filename, const uint8_t* file_data,
+    size_t data_size)
+{
+    size_t last_count = list->count;
+    struct VGMSource* source = &list->sources[list->source_count - 1];
+    struct block_writer writer = { .list = list, .source = list->source_count - 1, .base = file_data - source->base,
+        .filename = filename, .first_block = list->count, .merge_roms = list->merge_roms };
+    struct vgm_scanner scanner;
+
+    if (!get_writer(list))
+        return 0;
+
+    enum vgm_phase phase = switch_phase(list, VGM_PHASE_SCAN);
+    vgm_scanner_init(&scanner, data_size, list->recovery, &block_writer_sink, &writer);
+    scanner.filter = list->filter;
+    size_t offset = 0;
+    while (offset < data_size)
+    {
+        size_t length = data_size - offset < SCAN_SLICE_SIZE ? data_size - offset : SCAN_SLICE_SIZE;
+        bool more = vgm_scanner_feed(&scanner, file_data + offset, length);
+        report_progress(list, length);
+        offset += length;
+        if (!more) break;
+    }
+    list->bytes_scanned += offset;
+    report_progress(list, data_size - offset);
+    finish_scan(list, &scanner);
+    write_rom_images(&writer);
+    close_block_writer(&writer);
+    switch_phase(list, phase);
+
+    return list->count - last_count;
+}
+
+static bool add_source(struct VGMBlockList* list, const struct VGMSource* source)
+{
+    if (list->source_count == list->source_capacity)
+    {
+        size_t capacity = list->source_capacity ? list->source_capacity * 2 : 16;
+        struct VGMSource* tmp = (struct VGMSource*)resize_allocation(list, list->sources,
+            list->source_capacity * sizeof(struct VGMSource), capacity * sizeof(struct VGMSource));
+        if (!tmp)
+            return false;
+        list->sources = tmp;
+        list->source_capacity = capacity;
+    }
+    if (!source->mapped && !source->in_arena) hold_heap(list, source->size);
+
+    list->sources[list->source_count++] = *source;
+    return true;
+}
+
+static void release_source(struct VGMBlockList* list, struct VGMSource* source)
+{
+    if (source->in_arena)
+    {
+        // a large one has a chunk of its own that can go now, the others go with the arena
+        size_t held = list->arena.size;
+        if (vgm_arena_release(&list->arena, source->base))
+            hold_heap(list, -(ptrdiff_t)(held - list->arena.size));
+        return;
+    }
+#if !defined(_WIN32)
+    if (source->mapped)
+    {
+        munmap(source->base, source->size);
+        return;
+    }
+#endif
+    free(source->base);
+}
+
+// Release a source of the list
+static void remove_source(struct VGMBlockList* list, struct VGMSource* source)
+{
+    if (!source->mapped && !source->in_arena) hold_heap(list, -(ptrdiff_t)source->size);
+    release_source(list, source);
+}
+
+bool sync_block_list(struct VGMBlockList* list)
+{
+    if (!list->writer) return true;
+
+    char error[256];
+    enum vgm_phase phase = switch_phase(list, VGM_PHASE_WRITE);
+    bool result = vgm_writer_sync(list->writer, error, sizeof(error), &list->bytes_reused);
+    switch_phase(list, phase);
+    if (!result) set_error(list, "%s", error);
+    return result;
+}
+
+bool share_block_writer(struct VGMBlockList* list, struct VGMBlockList* owner)
+{
+    if (!get_writer(owner)) return false;
+    list->writer = owner->writer;
+    list->shared_writer = true;
+    return true;
+}
+
+bool is_block_list_writing(struct VGMBlockList* list)
+{
+    return list->writer && vgm_writer_busy(list->writer);
+}
+
+// Drop the last source if no block points into it
+static void drop_source_if_unused(struct VGMBlockList* list, size_t result)
+{
+    if (result == 0 && list->source_count > 0)
+    {
+        // an interrupted block may still be written from it
+        sync_block_list(list);
+        remove_source(list, &list->sources[--list->source_count]);
+    }
+}
+
+static bool check_header(struct VGMBlockList* list, const uint8_t* header)
+{
+    // Check for VGM magic number ('Vgm ')
+    if (header[0] != 'V' || header[1] != 'g' || header[2] != 'm' || header[3] != ' ') {
+        set_error(list, "Invalid VGM file: VGM magic string not found\n");
+        return false;
+    }
+    return true;
+}
+
+static uint32_t get_data_offset(const uint8_t* header)
+{
+    // Get the offset to the data section
+    uint32_t data_offset = *(uint32_t *)(header + VGM_DATA_OFFSET);
+    if (data_offset == 0) {
+        data_offset = 0x40; // Default to the end of the header
+    } else {
+        data_offset += 0x34;
+    }
+    return data_offset;
+}
+
+static uint32_t get_eof_offset(struct VGMBlockList* list, const uint8_t* header)
+{
+    // Get the total file size from the EOF offset field
+    uint32_t eof_offset = *(uint32_t *)(header + VGM_EOF_OFFSET);
+    if (eof_offset == 0) {
+        set_error(list, "Invalid EOF offset in header\n");
+        return 0;
+    }
+    return eof_offset;
+}
+
+// .vgz input: zlib's gzread(), the index builder when the list wants an index, or an entry of a .zip
+// inflated in memory
+struct vgz_input {
+    gzFile file;
+    struct vgm_gz_builder* builder;
+    struct vgm_zip_reader* zip;
+};
+
+static bool open_vgz(struct vgz_input* input, const char* filename, struct vgm_gz_index* index)
+{
+    if (!index)
+        return (input->file = gzopen(filename, "rb")) != NULL;
+
+    if (!(input->builder = (struct vgm_gz_builder*)malloc(sizeof(struct vgm_gz_builder))))
+        return false;
+    if (!vgm_gz_builder_open(input->builder, filename, index))
+    {
+        free(input->builder);
+        input->builder = NULL;
+        return false;
+    }
+    return true;
+}
+
+static bool open_zip_entry(struct vgz_input* input, const struct vgm_zip* zip, size_t entry)
+{
+    if (!(input->zip = (struct vgm_zip_reader*)malloc(sizeof(struct vgm_zip_reader))))
+        return false;
+    if (!vgm_zip_reader_open(input->zip, zip, entry))
+    {
+        free(input->zip);
+        input->zip = NULL;
+        return false;
+    }
+    return true;
+}
+
+static int read_vgz(struct vgz_input* input, uint8_t* data, size_t size)
+{
+    if (input->zip) return vgm_zip_reader_read(input->zip, data, size);
+    if (input->builder) return vgm_gz_builder_read(input->builder, data, size);
+    return gzread(input->file, data, size);
+}
+
+// Compressed bytes read so far
+static uint64_t get_vgz_offset(struct vgz_input* input)
+{
+    if (input->zip) return input->zip->in;
+    if (input->builder) return input->builder->in;
+    return gzoffset(input->file);
+}
+
+// Skip forward to an uncompressed offset, inflating what comes before
+static bool seek_vgz(struct vgz_input* input, size_t offset, uint8_t* chunk)
+{
+    if (!input->builder && !input->zip) return gzseek(input->file, offset, SEEK_SET) != -1;
+
+    const uint64_t* out = input->zip ? &input->zip->out : &input->builder->out;
+    while (*out < offset)
+    {
+        size_t length = offset - *out < VGZ_CHUNK_SIZE ? offset - *out : VGZ_CHUNK_SIZE;
+        if (read_vgz(input, chunk, length) <= 0) return false;
+    }
+    return true;
+}
+
+// Returns false if an index was wanted but could not be built, or a .zip entry is damaged
+static bool close_vgz(struct vgz_input* input)
+{
+    if (input->zip)
+    {
+        bool result = vgm_zip_reader_close(input->zip);
+        free(input->zip);
+        return result;
+    }
+    if (!input->builder)
+    {
+        gzclose(input->file);
+        return true;
+    }
+    bool result = vgm_gz_builder_close(input->builder);
+    free(input->builder);
+    return result;
+}
+
+static bool abort_vgz(struct VGMBlockList* list, struct vgz_input* input, struct vgm_gz_index* index, uint8_t* chunk)
+{
+    close_vgz(input);
+    vgm_gz_index_free(index);
+    free(chunk);
+    hold_heap(list, -VGZ_CHUNK_SIZE);
+    return false;
+}
+
+// Memory held by a checkpoint index
+static size_t get_gz_index_size(const struct vgm_gz_index* index)
+{
+    return index->point_capacity * (sizeof(struct vgm_gz_point) + VGM_GZ_WINDOW_SIZE) +
+        index->block_capacity * sizeof(struct vgm_gz_block);
+}
+
+// Read the GD3 tag from the rest of the last chunk scanned, which holds the stream from chunk_offset on,
+// or inflate up to it. A tag the scan went past is not read.
+static void read_vgz_gd3(struct vgm_tag* tag, struct vgz_input* input, uint8_t* chunk, size_t chunk_offset,
+    size_t chunk_size)
+{
+    size_t length = 0;
+    if (!tag->gd3_offset || tag->gd3_offset < chunk_offset) return;
+    if (tag->gd3_offset < chunk_offset + chunk_size)
+    {
+        length = chunk_offset + chunk_size - tag->gd3_offset;
+        memmove(chunk, chunk + (tag->gd3_offset - chunk_offset), length);
+    }
+    else if (!seek_vgz(input, tag->gd3_offset, chunk))
+    {
+        return;
+    }
+
+    // the header of the tag gives its size
+    int more = length < 12 ? read_vgz(input, chunk + length, 12 - length) : 0;
+    if (more > 0) length += more;
+    size_t size = vgm_tag_get_gd3_size(chunk, length);
+    more = size > length ? read_vgz(input, chunk + length, size - length) : 0;
+    if (more > 0) length += more;
+    if (size > 0) vgm_tag_read_gd3(tag, chunk, length);
+}
+
+// A .vgz file, or entry number entry of zip (filename is then "<archive>/<entry name>"), which gets no index
+static bool scan_vgz_file(struct VGMBlockList* list, const char* filename, const struct vgm_zip* zip, size_t entry)
+{
+    struct vgm_gz_index index;
+    struct vgz_input input = { 0 };
+    bool indexing = list->gz_index && !zip;
+    vgm_gz_index_init(&index);
+    uint8_t *chunk = (uint8_t *)malloc(VGZ_CHUNK_SIZE);
+    if (!chunk || !get_writer(list)) {
+        free(chunk);
+        set_error(list, "Memory allocation failed\n");
+        return false;
+    }
+    count_allocation(list, VGZ_CHUNK_SIZE);
+    if (zip ? !open_zip_entry(&input, zip, entry) : !open_vgz(&input, filename, indexing ? &index : NULL)) {
+        set_error(list, zip ? "Failed to open the archive entry\n" : "Failed to open .gz file");
+        free(chunk);
+        hold_heap(list, -VGZ_CHUNK_SIZE);
+        return false;
+    }
+
+    switch_phase(list, VGM_PHASE_INFLATE);
+    uint8_t header[VGM_TAG_HEADER_MAX];
+    if (list->tag) vgm_tag_clear(list->tag);
+    if (read_vgz(&input, header, VGM_HEADER_SIZE) != VGM_HEADER_SIZE) {
+        set_error(list, "Error reading VGM header: file too short\n");
+        return abort_vgz(list, &input, &index, chunk);
+    }
+
+    if (!check_header(list, header)) {
+        return abort_vgz(list, &input, &index, chunk);
+    }
+
+    uint32_t data_offset = get_data_offset(header);
+    //printf("data_offset = %x\n", data_offset);
+
+    uint32_t eof_offset = get_eof_offset(list, header);
+    if (!eof_offset) {
+        return abort_vgz(list, &input, &index, chunk);
+    }
+
+    // Calculate the size of the data
+    size_t file_size = eof_offset + 4;
+    if (data_offset >= file_size) {
+        set_error(list, "Error seeking commands\n");
+        return abort_vgz(list, &input, &index, chunk);
+    }
+    size_t data_size = file_size - data_offset;
+    //printf("File data extracted (%zu bytes)\n", data_size);
+
+    // the rest of the header is read instead of skipped when the tag is wanted
+    size_t header_size = data_offset < VGM_TAG_HEADER_MAX ? data_offset : VGM_TAG_HEADER_MAX;
+    if (list->tag && header_size > VGM_HEADER_SIZE &&
+        read_vgz(&input, header + VGM_HEADER_SIZE, header_size - VGM_HEADER_SIZE) != (int)(header_size - VGM_HEADER_SIZE)) {
+        set_error(list, "Error reading VGM header: file too short\n");
+        return abort_vgz(list, &input, &index, chunk);
+    }
+    if (list->tag) vgm_tag_read_header(list->tag, header, header_size);
+
+    if (!seek_vgz(&input, data_offset, chunk))
+    {
+        set_error(list, "Error seeking commands\n");
+        return abort_vgz(list, &input, &index, chunk);
+    }
+
+    // Inflate the commands chunk by chunk, blocks are written out as they stream by
+    size_t last_count = list->count;
+    struct block_writer writer = { .list = list, .source = NO_SOURCE, .base = data_offset,
+        .filename = filename, .first_block = list->count, .gz_index = indexing ? &index : NULL,
+        .merge_roms = list->merge_roms };
+    struct vgm_scanner scanner;
+    vgm_scanner_init(&scanner, data_size, list->recovery, &block_writer_sink, &writer);
+    scanner.filter = list->filter;
+
+    size_t left = data_size;
+    size_t chunk_size = 0;
+    uint64_t reported = 0;
+    while (left > 0)
+    {
+        switch_phase(list, VGM_PHASE_INFLATE);
+        int length = read_vgz(&input, chunk, left < VGZ_CHUNK_SIZE ? left : VGZ_CHUNK_SIZE);
+        if (length <= 0)
+        {
+            set_error(list, "Error reading command data\n");
+            break;
+        }
+        left -= length;
+        chunk_size = length;
+        switch_phase(list, VGM_PHASE_SCAN);
+        bool more = vgm_scanner_feed(&scanner, chunk, length);
+        report_progress(list, get_vgz_offset(&input) - reported);
+        reported = get_vgz_offset(&input);
+        if (!more) break;
+    }
+
+    finish_scan(list, &scanner);
+    write_rom_images(&writer);
+    close_block_writer(&writer);
+    if (list->tag && !list->error[0])
+    {
+        switch_phase(list, VGM_PHASE_INFLATE);
+        read_vgz_gd3(list->tag, &input, chunk, file_size - left - chunk_size, chunk_size);
+    }
+    list->bytes_in += get_vgz_offset(&input);
+
+    // the index is counted at its final size, while the chunk is still held
+    size_t index_size = get_gz_index_size(&index);
+    if (index_size > 0) count_allocation(list, index_size);
+    free(chunk);
+    hold_heap(list, -VGZ_CHUNK_SIZE);
+
+    // an index is only kept for a scan that went through
+    switch_phase(list, VGM_PHASE_INFLATE);
+    bool closed = close_vgz(&input);
+    switch_phase(list, VGM_PHASE_WRITE);
+    if (!closed && zip && !list->error[0])
+        set_error(list, "Damaged archive entry\n");
+    if (closed && indexing && !list->error[0] && !vgm_gz_index_save(&index, filename))
+        set_error(list, "Error writing the index of \"%s\"\n", filename);
+    vgm_gz_index_free(&index);
+    hold_heap(list, -(ptrdiff_t)index_size);
+
+    return list->count > last_count;
+}
+
+bool extract_vgz_file(struct VGMBlockList* list, const char* filename)
+{
+    enum vgm_phase phase = switch_phase(list, VGM_PHASE_READ);
+    bool result = scan_vgz_file(list, filename, NULL, 0);
+    switch_phase(list, phase);
+    return result;
+}
+
+// Passes inflated data to a block writer, or gathers it
+struct vgz_block_reader {
+    struct block_writer* writer;
+    uint8_t* data;
+    size_t size;
+};
+
+static bool write_vgz_block(void* user, const uint8_t* data, size_t size)
+{
+    struct vgz_block_reader* reader = (struct vgz_block_reader*)user;
+    if (reader->writer) return write_block_data(reader->writer, data, size);
+
+    memcpy(reader->data + reader->size, data, size);
+    reader->size += size;
+    return true;
+}
+
+// Load the decompression table of a block from its 0x7F block
+static void read_vgz_table(struct block_writer* writer, const struct vgm_gz_index* index, FILE* file, uint32_t table)
+{
+    const struct vgm_gz_block* block = &index->blocks[table];
+    struct vgz_block_reader reader = { NULL, (uint8_t*)malloc(block->size ? block->size : 1), 0 };
+    writer->table = (struct vgm_decompression_table*)malloc(sizeof(*writer->table));
+    if (!reader.data || !writer->table ||
+        !vgm_gz_index_read(index, file, block->offset, block->size, write_vgz_block, &reader) ||
+        !vgm_read_decompression_table(writer->table, reader.data, reader.size))
+    {
+        free(writer->table);
+        writer->table = NULL;
+    }
+    free(reader.data);
+}
+
+static bool read_vgz_block(struct VGMBlockList* list, const char* filename, size_t number)
+{
+    struct vgm_gz_index index;
+    if (!vgm_gz_index_load(&index, filename))
+    {
+        set_error(list, "No up-to-date index for \"%s\"\n", filename);
+        return false;
+    }
+    if (number >= index.header.block_count)
+    {
+        set_error(list, "\"%s\" has no block %zu\n", filename, number);
+        vgm_gz_index_free(&index);
+        return false;
+    }
+    FILE* file = fopen(filename, "rb");
+    if (!file || !get_writer(list))
+    {
+        if (file) fclose(file);
+        else set_error(list, "Error opening file \"%s\"\n", filename);
+        vgm_gz_index_free(&index);
+        return false;
+    }
+
+    // the block goes through the same path as during a scan, decompression included
+    const struct vgm_gz_block* block = &index.blocks[number];
+    size_t index_size = get_gz_index_size(&index);
+    count_allocation(list, index_size);
+    struct block_writer writer = { .list = list, .source = NO_SOURCE, .filename = filename, .first_block = list->count };
+    switch_phase(list, VGM_PHASE_INFLATE);
+    if (is_compressed(block->type) && block->table < number && index.blocks[block->table].type == 0x7f)
+        read_vgz_table(&writer, &index, file, block->table);
+
+    struct vgm_block_info info = { .type = block->type, .size = block->size, .offset = block->offset };
+    struct vgz_block_reader reader = { &writer, NULL, 0 };
+    bool result = begin_block(&writer, &info);
+    if (result && !vgm_gz_index_read(&index, file, block->offset, block->size, write_vgz_block, &reader))
+    {
+        set_error(list, "Error reading command data\n");
+        result = false;
+    }
+    result = result && end_block(&writer);
+    close_block_writer(&writer);
+
+    fclose(file);
+    vgm_gz_index_free(&index);
+    hold_heap(list, -(ptrdiff_t)index_size);
+    return result;
+}
+
+bool extract_vgz_block(struct VGMBlockList* list, const char* filename, size_t number)
+{
+    enum vgm_phase phase = switch_phase(list, VGM_PHASE_READ);
+    bool result = read_vgz_block(list, filename, number);
+    switch_phase(list, phase);
+    return result;
+}
+
+// Map the whole file read-only into the source, or read it into the arena of the list where mmap is not
+// available: a reset of the list then frees every copy in one call
+static bool map_file(struct VGMBlockList* list, const char* filename, struct VGMSource* source)
+{
+#if !defined(_WIN32) && !defined(PLATFORM_WEB)
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) {
+        set_error(list, "Error opening file \"%s\"\n", filename);
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size < VGM_HEADER_SIZE) {
+        set_error(list, "Error reading VGM header: file too short\n");
+        close(fd);
+        return false;
+    }
+
+    uint8_t* base = (uint8_t*)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        set_error(list, "Error mapping file \"%s\"\n", filename);
+        return false;
+    }
+
+    *source = (struct VGMSource){ base, st.st_size, true, false };
+    return true;
+#else
+    FILE* file = fopen(filename, "rb");
+    if (!file) {
+        set_error(list, "Error opening file \"%s\"\n", filename);
+        return false;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long file_size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (file_size < VGM_HEADER_SIZE) {
+        set_error(list, "Error reading VGM header: file too short\n");
+        fclose(file);
+        return false;
+    }
+
+    uint8_t* base = (uint8_t*)resize_allocation(list, NULL, 0, file_size);
+    if (!base) {
+        fclose(file);
+        return false;
+    }
+    *source = (struct VGMSource){ base, file_size, false, true };
+
+    // in small reads: on web, the browser thread serves each one between two frames
+    for (long offset = 0; offset < file_size; offset += READ_CHUNK_SIZE)
+    {
+        size_t length = file_size - offset < READ_CHUNK_SIZE ? file_size - offset : READ_CHUNK_SIZE;
+        if (fread(base + offset, 1, length, file) != length) {
+            set_error(list, "Error reading command data\n");
+            release_source(list, source);
+            fclose(file);
+            return false;
+        }
+    }
+
+    fclose(file);
+    return true;
+#endif
+}
+
+// Header fields and GD3 tag of a file held whole in memory
+static void read_tag(struct vgm_tag* tag, const uint8_t* base, size_t size, uint32_t data_offset)
+{
+    vgm_tag_read_header(tag, base, data_offset < size ? data_offset : size);
+    if (tag->gd3_offset && tag->gd3_offset < size)
+        vgm_tag_read_gd3(tag, base + tag->gd3_offset, size - tag->gd3_offset);
+}
+
+static bool scan_vgm_file(struct VGMBlockList* list, const char* filename)
+{
+    if (list->tag) vgm_tag_clear(list->tag);
+    struct VGMSource source;
+    if (!map_file(list, filename, &source)) return false;
+
+    uint8_t* base = source.base;
+    size_t map_size = source.size;
+    bool mapped = source.mapped;
+    if (!check_header(list, base)) {
+        release_source(list, &source);
+        return false;
+    }
+
+    uint32_t data_offset = get_data_offset(base);
+    //printf("data_offset = %x\n", data_offset);
+
+    uint32_t eof_offset = get_eof_offset(list, base);
+    if (!eof_offset) {
+        release_source(list, &source);
+        return false;
+    }
+
+    // Calculate the size of the data, trusting the file over the header
+    size_t file_size = eof_offset + 4;
+    if (file_size > map_size) file_size = map_size;
+    if (data_offset >= file_size) {
+        set_error(list, "Error seeking commands\n");
+        release_source(list, &source);
+        return false;
+    }
+    size_t data_size = file_size - data_offset;
+    //printf("File data extracted (%zu bytes)\n", data_size);
+    if (list->tag) read_tag(list->tag, base, map_size, data_offset);
+
+    if (!add_source(list, &source)) {
+        release_source(list, &source);
+        return false;
+    }
+
+#if !defined(_WIN32)
+    if (mapped) madvise(base, map_size, MADV_SEQUENTIAL);
+#endif
+    size_t result = extract_data_blocks(list, filename, base + data_offset, data_size);
+    report_progress(list, map_size - data_size);
+#if !defined(_WIN32)
+    // blocks are read back in any order from now on
+    if (mapped) madvise(base, map_size, MADV_NORMAL);
+#endif
+    drop_source_if_unused(list, result);
+    list->bytes_in += map_size;
+
+    return result > 0;
+}
+
+bool extract_vgm_file(struct VGMBlockList* list, const char* filename)
+{
+    enum vgm_phase phase = switch_phase(list, VGM_PHASE_READ);
+    bool result = scan_vgm_file(list, filename);
+    switch_phase(list, phase);
+    return result;
+}
+
+// Index of the blocks of a file just scanned, for the next time it is seen unchanged
+static void cache_blocks(struct VGMBlockList* list, const char* filename, const struct vgm_cache_key* key,
+    size_t first_block, size_t file_source, bool vgz)
+{
+    size_t count = list->count - first_block;
+    struct vgm_cache_block* blocks = (struct vgm_cache_block*)calloc(count ? count : 1, sizeof(struct vgm_cache_block));
+    if (!blocks) return; // the cache is only an optimization
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        const struct VGMDataBlock* block = &list->blocks[first_block + i];
+        blocks[i].offset = block->offset;
+        blocks[i].hash = block->hash;
+        blocks[i].size = block->size;
+        blocks[i].type = (uint8_t)block->type;
+        if (!vgz && block->source == file_source && !is_compressed(block->type))
+            blocks[i].flags = VGM_CACHE_VIEW;
+    }
+    vgm_cache_store(list->cache, filename, key, blocks, count);
+    free(blocks);
+}
+
+// Blocks all in the store already: listed without reading the file
+static bool list_stored_blocks(struct VGMBlockList* list, const struct vgm_cache_block* blocks, size_t count)
+{
+    char filename[4096];
+    for (size_t i = 0; i < count; ++i)
+    {
+        get_store_file_name(list, blocks[i].hash, filename, sizeof(filename));
+        if (!file_exists(filename)) return false;
+    }
+
+    for (size_t i = 0; i < count && reserve_block(list); ++i)
+    {
+        struct VGMDataBlock* block = &list->blocks[list->count++];
+        block->type = blocks[i].type;
+        block->size = blocks[i].size;
+        block->source = NO_SOURCE;
+        block->offset = blocks[i].offset;
+        block->hash = blocks[i].hash;
+        list->bytes_reused += blocks[i].size;
+    }
+    return true;
+}
+
+// Blocks all stored as is in the file: passed from the file to the output without scanning
+static void write_block_views(struct VGMBlockList* list, const char* filename, const struct vgm_cache_block* blocks,
+    size_t count)
+{
+    struct VGMSource source;
+    if (!map_file(list, filename, &source)) return;
+    if (!get_writer(list) || !add_source(list, &source))
+    {
+        release_source(list, &source);
+        return;
+    }
+    uint8_t* base = source.base;
+    size_t map_size = source.size;
+
+    size_t last_count = list->count;
+    struct block_writer writer = { .list = list, .source = list->source_count - 1, .filename = filename,
+        .first_block = list->count };
+    for (size_t i = 0; i < count; ++i)
+    {
+        struct vgm_block_info info = { .type = blocks[i].type, .size = blocks[i].size, .offset = blocks[i].offset };
+        if (blocks[i].offset > map_size || blocks[i].size > map_size - blocks[i].offset ||
+            !begin_block(&writer, &info) || !write_block_data(&writer, base + info.offset, info.size) ||
+            !end_block(&writer))
+        {
+            set_error(list, "Error reading command data\n");
+            break;
+        }
+    }
+    close_block_writer(&writer);
+    drop_source_if_unused(list, list->count - last_count);
+    list->bytes_in += map_size;
+}
+
+// Take the blocks of an unchanged file from the cache, false if it has to be scanned
+static bool extract_cached_file(struct VGMBlockList* list, const char* filename, const struct vgm_cache_key* key)
+{
+    struct vgm_cache_block* blocks;
+    size_t count;
+    if (!vgm_cache_lookup(list->cache, filename, key, &blocks, &count))
+        return false;
+
+    bool views = true;
+    for (size_t i = 0; i < count; ++i)
+    {
+        views &= (blocks[i].flags & VGM_CACHE_VIEW) != 0;
+    }
+
+    bool result = true;
+    if (count == 0 || (list->store_dir && list_stored_blocks(list, blocks, count)))
+        ;
+    else if (views)
+        write_block_views(list, filename, blocks, count);
+    else
+        result = false;
+
+    if (result)
+    {
+        list->cache_hits++;
+        report_progress(list, key->size);
+    }
+    free(blocks);
+    return result;
+}
+
+// An archive entry is cached like a file, under its name
+static bool extract_entry_or_cached(struct VGMBlockList* list, const struct vgm_zip* zip, size_t entry,
+    const char* name)
+{
+    size_t first_block = list->count;
+    size_t first_source = list->source_count;
+
+    struct vgm_cache_key key;
+    bool cached = list->cache && !list->tag && !list->filter && !list->merge_roms;
+    if (cached) vgm_cache_get_entry_key(&zip->entries[entry], list->recovery, &key);
+    if (cached && extract_cached_file(list, name, &key))
+        return list->count > first_block;
+
+    bool result = scan_vgz_file(list, name, zip, entry);
+    if (cached && !list->error[0])
+        cache_blocks(list, name, &key, first_block, first_source, true);
+    return result;
+}
+
+static bool has_extension(const char* filename, const char* extension)
+{
+    const char* ext = strrchr(filename, '.');
+    return ext && strcasecmp(ext, extension) == 0;
+}
+
+// Every .vgm and .vgz entry in name order, stopping at the first one that fails
+static bool extract_zip_entries(struct VGMBlockList* list, const char* filename)
+{
+    struct vgm_zip zip;
+    if (!vgm_zip_open(&zip, filename))
+    {
+        set_error(list, "Failed to open the archive\n");
+        return false;
+    }
+
+    size_t first_block = list->count;
+    for (size_t i = 0; i < zip.count && !list->error[0]; ++i)
+    {
+        const char* name = zip.entries[i].name;
+        if (!has_extension(name, ".vgm") && !has_extension(name, ".vgz")) continue;
+
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s", filename, name);
+        extract_entry_or_cached(list, &zip, i, path);
+    }
+    vgm_zip_close(&zip);
+    return list->count > first_block;
+}
+
+static bool extract_file_or_cached(struct VGMBlockList* list, const char* filename)
+{
+    if (has_extension(filename, ".zip")) return extract_zip_entries(list, filename);
+
+    bool vgz = has_extension(filename, ".vgz");
+    size_t first_block = list->count;
+    size_t first_source = list->source_count;
+
+    // a wanted .vgz index or tag needs the file read anyway, a filtered or merging scan lists other blocks
+    struct vgm_cache_key key;
+    bool cached = list->cache && !(vgz && list->gz_index) && !list->tag && !list->filter && !list->merge_roms &&
+        vgm_cache_get_key(filename, list->recovery, &key);
+    if (cached && extract_cached_file(list, filename, &key))
+        return list->count > first_block;
+
+    bool result = vgz ? extract_vgz_file(list, filename) : extract_vgm_file(list, filename);
+    if (cached && !list->error[0])
+        cache_blocks(list, filename, &key, first_block, first_source, vgz);
+    return result;
+}
+
+bool extract_file(struct VGMBlockList* list, const char* filename)
+{
+    // the cache and the store are looked up while reading
+    enum vgm_phase phase = switch_phase(list, VGM_PHASE_READ);
+    bool result = extract_file_or_cached(list, filename);
+    switch_phase(list, phase);
+    return result;
+}
+
+bool extract_zip_file(struct VGMBlockList* list, const char* filename)
+{
+    enum vgm_phase phase = switch_phase(list, VGM_PHASE_READ);
+    bool result = extract_zip_entries(list, filename);
+    switch_phase(list, phase);
+    return result;
+}
+
+bool extract_zip_entry(struct VGMBlockList* list, const struct vgm_zip* zip, size_t entry, const char* name)
+{
+    enum vgm_phase phase = switch_phase(list, VGM_PHASE_READ);
+    bool result = extract_entry_or_cached(list, zip, entry, name);
+    switch_phase(list, phase);
+    return result;
+}
+
+bool merge_block_list(struct VGMBlockList* dst, struct VGMBlockList* src)
+{
+    size_t source_base = dst->source_count;
+    bool result = true;
+
+    // renames are queued after the writes of src when both lists share a writer
+    if (src->writer != dst->writer && !sync_block_list(src))
+        set_error(dst, "%s", src->error);
+    if (!src->store_dir && !src->pack && !get_writer(dst))
+    {
+        reset_block_list(src);
+        return false;
+    }
+
+    for (size_t i = 0; i < src->source_count; ++i)
+    {
+        struct VGMSource* source = &src->sources[i];
+        if (!add_source(dst, source))
+        {
+            // nobody else owns the remaining sources
+            sync_block_list(src);
+            for (; i < src->source_count; ++i) remove_source(src, &src->sources[i]);
+            src->count = 0;
+            result = false;
+            break;
+        }
+        if (!source->mapped && !source->in_arena) hold_heap(src, -(ptrdiff_t)source->size);
+    }
+    src->source_count = 0;
+
+    for (size_t i = 0; i < src->count; ++i)
+    {
+        if (!reserve_block(dst))
+        {
+            result = false;
+            break;
+        }
+
+        // stored, packed and in-memory blocks stay where they are
+        char from[4096], to[4096];
+        if (!src->store_dir && !src->pack && !src->in_memory)
+        {
+            get_block_file_name(src, i, from, sizeof(from));
+            get_block_file_name(dst, dst->count, to, sizeof(to));
+            if (strcmp(from, to) != 0 && !vgm_writer_rename(dst->writer, from, to))
+            {
+                result = false;
+                break;
+            }
+        }
+
+        struct VGMDataBlock* block = &dst->blocks[dst->count++];
+        *block = src->blocks[i];
+        if (block->source != NO_SOURCE) block->source += source_base;
+    }
+    src->count = 0;
+
+    // the gathered blocks stay where they are, the index of src goes along with them
+    hold_heap(src, -(ptrdiff_t)src->arena.size);
+    hold_heap(dst, src->arena.size);
+    vgm_arena_merge(&dst->arena, &src->arena);
+    src->blocks = NULL;
+    src->sources = NULL;
+    src->capacity = src->source_capacity = 0;
+
+    dst->bytes_in += src->bytes_in;
+    dst->bytes_out += src->bytes_out;
+    dst->bytes_scanned += src->bytes_scanned;
+    dst->bytes_reused += src->bytes_reused;
+    dst->cache_hits += src->cache_hits;
+    src->bytes_in = src->bytes_out = src->bytes_scanned = src->bytes_reused = 0;
+    src->cache_hits = 0;
+    for (int i = 0; i < VGM_PHASE_COUNT; ++i)
+    {
+        dst->stats.seconds[i] += src->stats.seconds[i];
+    }
+    dst->stats.allocations += src->stats.allocations;
+    clear_block_list_stats(src);
+    return result;
+}
+
+void reset_block_list(struct VGMBlockList* list)
+{
+    // queued writes may still read from the sources
+    if (list->source_count > 0)
+        sync_block_list(list);
+    for (size_t i = 0; i < list->source_count; ++i)
+    {
+        remove_source(list, &list->sources[i]);
+    }
+
+    // one call for the index, the sources and the gathered blocks
+    hold_heap(list, -(ptrdiff_t)list->arena.size);
+    vgm_arena_reset(&list->arena);
+    hold_heap(list, list->arena.size);
+    list->blocks = NULL;
+    list->sources = NULL;
+    list->count = list->capacity = 0;
+    list->source_count = list->source_capacity = 0;
+}
+
+void free_block_list(struct VGMBlockList* list)
+{
+    reset_block_list(list);
+    if (!list->shared_writer)
+        vgm_writer_destroy(list->writer);
+    list->writer = NULL;
+    hold_heap(list, -(ptrdiff_t)list->arena.size);
+    vgm_arena_free(&list->arena);
+}
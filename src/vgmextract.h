@@ -0,0 +1,150 @@
+#ifndef _VGMEXTRACT_H_
+#define _VGMEXTRACT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vgmarena.h"
+
+#define NO_SOURCE SIZE_MAX
+
+struct vgm_cache;
+struct vgm_pack;
+struct vgm_tag;
+struct vgm_type_filter;
+struct vgm_writer;
+
+// Structure to hold data block information
+struct VGMDataBlock {
+    uint32_t type;
+    uint32_t size;
+    size_t source; // index in sources[], or NO_SOURCE when only written out
+    size_t offset; // data offset inside the source buffer
+    uint64_t hash; // XXH64 of the written data
+};
+
+// Buffer that data blocks point into: a file in memory, or one block gathered for an in-memory list
+struct VGMSource {
+    uint8_t *base;
+    size_t size;
+    bool mapped;
+    bool in_arena;  // gathered block or file copy, released with the arena of the list
+};
+
+// Phases an extraction spends its time in. Pages of a mapped file are read while it is scanned.
+enum vgm_phase {
+    VGM_PHASE_READ,     // opening, mapping or reading files, loading indexes, looking up the cache and store
+    VGM_PHASE_INFLATE,  // reading and inflating .vgz data
+    VGM_PHASE_SCAN,     // walking commands or searching "67 66" pairs
+    VGM_PHASE_COPY,     // hashing, gathering and decompressing block data
+    VGM_PHASE_WRITE,    // handing blocks to the writer and waiting for it
+    VGM_PHASE_COUNT
+};
+
+// Counters of the work done by a list, see clear_block_list_stats()
+struct VGMStats {
+    double seconds[VGM_PHASE_COUNT];
+    size_t allocations;     // buffers allocated or grown
+    size_t heap;            // bytes the list holds in them now: block index, file copies, gathered blocks
+    size_t peak_heap;
+    enum vgm_phase phase;   // phase running since phase_start, none while phase_start is 0
+    double phase_start;
+};
+
+// Blocks extracted from one or more files, written to <output_dir>/<name_prefix>block_N.raw,
+// once per distinct content to <store_dir>/<hash>.raw, all into one pack file, or kept in memory
+struct VGMBlockList {
+    struct VGMDataBlock *blocks;
+    size_t count;
+    size_t capacity;
+    struct VGMSource *sources;
+    size_t source_count;
+    size_t source_capacity;
+    struct vgm_arena arena; // holds the index, the sources, the gathered blocks and the file copies where
+                            // files are not mapped, all released at once
+    const char* output_dir; // NULL for the working directory
+    const char* store_dir;  // content-addressed store shared by lists, NULL to write block_N.raw
+    struct vgm_pack* pack;  // pack file shared by lists, used instead of block files when set
+    bool in_memory;         // write no files, blocks stay in their sources (see get_block_data())
+    bool list_only;         // write and gather nothing, blocks are only listed with their size and hash
+    char name_prefix[32];   // lets several lists write to the same directory
+    struct vgm_writer* writer; // block files are written through it, created on first use
+    bool shared_writer;     // writer belongs to another list
+    bool recovery;          // search every "67 66" pair instead of walking commands
+    const struct vgm_type_filter* filter; // optional, blocks of other types are skipped unread and get no number
+    bool merge_roms;        // ROM dump pieces (0x80-0xBF) make one block per chip and file, see vgmrom.h
+    bool gz_index;          // write a checkpoint index next to each .vgz, see extract_vgz_block()
+    struct vgm_cache* cache; // optional, blocks of unchanged files are taken from it instead of scanned
+    struct vgm_tag* tag;    // optional, filled with the header and GD3 tag of each file scanned (not cached)
+    void (*progress)(void* user, uint64_t bytes); // optional, called with the input bytes scanned since the last call
+    void* progress_user;
+    uint64_t bytes_in;      // bytes read from the input files
+    uint64_t bytes_out;     // bytes written to block files
+    uint64_t bytes_scanned; // bytes of command stream scanned, in the scan phase
+    uint64_t bytes_reused;  // bytes of blocks found in the store instead of stored again
+    size_t cache_hits;      // files taken from the cache
+    struct VGMStats stats;
+    char error[256];        // first error since the last clear_block_list_error()
+    char warnings[512];     // warnings since the last clear_block_list_warnings(), one per line, as many as fit
+    size_t warning_count;   // all of them, those left out of warnings[] too
+};
+
+const char* get_chip_name(uint8_t type);
+
+const char* get_type_description(uint8_t type);
+
+// Extract the blocks of a .vgm, .vgz or .zip file (chosen by extension) into the list, from the cache when
+// the file did not change: without reading it when all its blocks are in the store, otherwise without
+// scanning it when all its blocks are stored as is in a .vgm
+bool extract_file(struct VGMBlockList* list, const char* filename);
+
+bool extract_vgm_file(struct VGMBlockList* list, const char* filename);
+
+bool extract_vgz_file(struct VGMBlockList* list, const char* filename);
+
+// Extract the .vgm and .vgz entries of a .zip archive in name order, each one inflated in memory
+bool extract_zip_file(struct VGMBlockList* list, const char* filename);
+
+// Extract one entry of an archive opened with vgm_zip_open(), name being "<archive>/<entry name>". Entries
+// of one archive can be extracted from several threads at once, they get no checkpoint index.
+struct vgm_zip;
+bool extract_zip_entry(struct VGMBlockList* list, const struct vgm_zip* zip, size_t entry, const char* name);
+
+// Extract block number index of a .vgz file into the list, inflating from the nearest checkpoint
+// of the index written by an earlier scan with gz_index set
+bool extract_vgz_block(struct VGMBlockList* list, const char* filename, size_t index);
+
+// Move all blocks and sources of src to the end of dst, renaming their files. The arena of src goes to dst.
+bool merge_block_list(struct VGMBlockList* dst, struct VGMBlockList* src);
+
+// Wait until the block files are written, return false if writing failed
+bool sync_block_list(struct VGMBlockList* list);
+
+// Write the block files of list through the writer of owner, which must outlive list
+bool share_block_writer(struct VGMBlockList* list, struct VGMBlockList* owner);
+
+// Block files still being written in the background
+bool is_block_list_writing(struct VGMBlockList* list);
+
+// Forget all blocks and release their sources and the arena at once, keeping a chunk for the next files
+void reset_block_list(struct VGMBlockList* list);
+
+void free_block_list(struct VGMBlockList* list);
+
+void clear_block_list_error(struct VGMBlockList* list);
+
+void clear_block_list_warnings(struct VGMBlockList* list);
+
+// Start counting time and allocations from zero, the peak from what the list holds now
+void clear_block_list_stats(struct VGMBlockList* list);
+
+const char* get_phase_name(enum vgm_phase phase);
+
+// Data of block i inside its source, NULL if the block was only written out
+const uint8_t* get_block_data(const struct VGMBlockList* list, size_t index, size_t* size);
+
+// Path of the file holding block i of the list
+void get_block_file_name(const struct VGMBlockList* list, size_t index, char* filename, size_t size);
+
+#endif // _VGMEXTRACT_H_
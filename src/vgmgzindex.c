@@ -0,0 +1,368 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "vgmgzindex.h"
+
+_Static_assert(sizeof(struct vgm_gz_index_header) == 64, "index header must be 64 bytes");
+_Static_assert(sizeof(struct vgm_gz_point) == 24, "checkpoints must be 24 bytes");
+_Static_assert(sizeof(struct vgm_gz_block) == 24, "index blocks must be 24 bytes");
+
+static int seek_file(FILE* file, uint64_t offset)
+{
+#if defined(_WIN32)
+    return _fseeki64(file, offset, SEEK_SET);
+#else
+    return fseeko(file, (off_t)offset, SEEK_SET);
+#endif
+}
+
+void vgm_gz_index_init(struct vgm_gz_index* index)
+{
+    memset(index, 0, sizeof(*index));
+    memcpy(index->header.magic, VGM_GZ_INDEX_MAGIC, sizeof(index->header.magic));
+    index->header.version = VGM_GZ_INDEX_VERSION;
+    index->header.window_size = VGM_GZ_WINDOW_SIZE;
+}
+
+void vgm_gz_index_free(struct vgm_gz_index* index)
+{
+    free(index->points);
+    free(index->windows);
+    free(index->blocks);
+    memset(index, 0, sizeof(*index));
+}
+
+bool vgm_gz_index_add_block(struct vgm_gz_index* index, uint64_t offset, uint32_t size, uint8_t type, uint32_t table)
+{
+    if (index->header.block_count == index->block_capacity)
+    {
+        size_t capacity = index->block_capacity ? index->block_capacity * 2 : 256;
+        struct vgm_gz_block* tmp = (struct vgm_gz_block*)realloc(index->blocks, capacity * sizeof(struct vgm_gz_block));
+        if (!tmp) return false;
+        index->blocks = tmp;
+        index->block_capacity = capacity;
+    }
+
+    struct vgm_gz_block* block = &index->blocks[index->header.block_count++];
+    memset(block, 0, sizeof(*block));
+    block->offset = offset;
+    block->size = size;
+    block->table = table;
+    block->type = type;
+    return true;
+}
+
+// Save the inflate state at the block boundary just reached
+static bool add_point(struct vgm_gz_builder* builder)
+{
+    struct vgm_gz_index* index = builder->index;
+    if (index->header.point_count == index->point_capacity)
+    {
+        size_t capacity = index->point_capacity ? index->point_capacity * 2 : 16;
+        struct vgm_gz_point* points = (struct vgm_gz_point*)realloc(index->points, capacity * sizeof(struct vgm_gz_point));
+        if (!points) return false;
+        index->points = points;
+        uint8_t* windows = (uint8_t*)realloc(index->windows, capacity * VGM_GZ_WINDOW_SIZE);
+        if (!windows) return false;
+        index->windows = windows;
+        index->point_capacity = capacity;
+    }
+
+    struct vgm_gz_point* point = &index->points[index->header.point_count];
+    memset(point, 0, sizeof(*point));
+    point->out = builder->out;
+    point->in = builder->in - builder->stream.avail_in;
+    point->bits = builder->stream.data_type & 7;
+
+    // oldest byte first, zeros before the start of the data
+    uint8_t* window = index->windows + index->header.point_count * VGM_GZ_WINDOW_SIZE;
+    size_t tail = VGM_GZ_WINDOW_SIZE - builder->window_pos;
+    memcpy(window, builder->window + builder->window_pos, tail);
+    memcpy(window + tail, builder->window, builder->window_pos);
+    index->header.point_count++;
+    return true;
+}
+
+static void update_window(struct vgm_gz_builder* builder, const uint8_t* data, size_t size)
+{
+    if (size >= VGM_GZ_WINDOW_SIZE)
+    {
+        memcpy(builder->window, data + size - VGM_GZ_WINDOW_SIZE, VGM_GZ_WINDOW_SIZE);
+        builder->window_pos = 0;
+        return;
+    }
+
+    size_t tail = VGM_GZ_WINDOW_SIZE - builder->window_pos;
+    size_t first = size < tail ? size : tail;
+    memcpy(builder->window + builder->window_pos, data, first);
+    memcpy(builder->window, data + first, size - first);
+    builder->window_pos = (builder->window_pos + size) % VGM_GZ_WINDOW_SIZE;
+}
+
+static bool fill_input(struct vgm_gz_builder* builder)
+{
+    size_t length = fread(builder->input, 1, sizeof(builder->input), builder->file);
+    if (length == 0) return false;
+    builder->stream.next_in = builder->input;
+    builder->stream.avail_in = (uInt)length;
+    builder->in += length;
+    return true;
+}
+
+bool vgm_gz_builder_open(struct vgm_gz_builder* builder, const char* filename, struct vgm_gz_index* index)
+{
+    memset(builder, 0, sizeof(*builder));
+    builder->index = index;
+    if (!(builder->file = fopen(filename, "rb")))
+        return false;
+
+    // gzread() passes data without the gzip magic through unchanged
+    fill_input(builder);
+    builder->plain = builder->stream.avail_in < 2 || builder->input[0] != 0x1f || builder->input[1] != 0x8b;
+    if (!builder->plain && inflateInit2(&builder->stream, 15 + 16) != Z_OK)
+    {
+        fclose(builder->file);
+        return false;
+    }
+    return true;
+}
+
+static int read_plain(struct vgm_gz_builder* builder, uint8_t* data, size_t size)
+{
+    size_t length = 0;
+    while (length < size && (builder->stream.avail_in > 0 || fill_input(builder)))
+    {
+        size_t chunk = size - length < builder->stream.avail_in ? size - length : builder->stream.avail_in;
+        memcpy(data + length, builder->stream.next_in, chunk);
+        builder->stream.next_in += chunk;
+        builder->stream.avail_in -= (uInt)chunk;
+        length += chunk;
+    }
+    builder->out += length;
+    return (int)length;
+}
+
+int vgm_gz_builder_read(struct vgm_gz_builder* builder, uint8_t* data, size_t size)
+{
+    if (builder->failed) return -1;
+    if (builder->plain) return read_plain(builder, data, size);
+
+    size_t length = 0;
+    while (length < size && !builder->end)
+    {
+        if (builder->stream.avail_in == 0 && !fill_input(builder))
+        {
+            // truncated: what was inflated is returned first, like gzread() does
+            builder->failed = true;
+            break;
+        }
+
+        // Z_BLOCK returns at every deflate block boundary, where a checkpoint can be taken
+        builder->stream.next_out = data + length;
+        builder->stream.avail_out = (uInt)(size - length);
+        int ret = inflate(&builder->stream, Z_BLOCK);
+        size_t produced = size - length - builder->stream.avail_out;
+        update_window(builder, data + length, produced);
+        length += produced;
+        builder->out += produced;
+
+        if (ret == Z_NEED_DICT || ret == Z_DATA_ERROR || ret == Z_MEM_ERROR)
+        {
+            builder->failed = true;
+            return length > 0 ? (int)length : -1;
+        }
+        if (ret == Z_STREAM_END)
+        {
+            // concatenated members are read on like gzread() does, but not indexed
+            if (builder->stream.avail_in == 0 && !fill_input(builder))
+                builder->end = true;
+            else if (builder->stream.next_in[0] == 0x1f)
+            {
+                builder->multiple = true;
+                inflateReset(&builder->stream);
+            }
+            else
+                builder->end = true; // trailing garbage
+            continue;
+        }
+
+        bool boundary = (builder->stream.data_type & 0xc0) == 0x80;
+        struct vgm_gz_index* index = builder->index;
+        if (boundary && index && !builder->multiple && (index->header.point_count == 0 ||
+            builder->out - index->points[index->header.point_count - 1].out >= VGM_GZ_SPAN))
+        {
+            if (!add_point(builder))
+            {
+                builder->failed = true;
+                return -1;
+            }
+        }
+    }
+    return length > 0 || !builder->failed ? (int)length : -1;
+}
+
+bool vgm_gz_builder_close(struct vgm_gz_builder* builder)
+{
+    bool result = !builder->failed && !builder->plain && !builder->multiple;
+    if (!builder->plain) inflateEnd(&builder->stream);
+    fclose(builder->file);
+    if (builder->index) builder->index->header.length = builder->out;
+    return result;
+}
+
+void vgm_gz_index_file_name(const char* filename, char* index_name, size_t size)
+{
+    snprintf(index_name, size, "%s%s", filename, VGM_GZ_INDEX_SUFFIX);
+}
+
+bool vgm_gz_index_save(const struct vgm_gz_index* index, const char* filename)
+{
+    struct stat st;
+    if (stat(filename, &st) == -1) return false;
+
+    struct vgm_gz_index_header header = index->header;
+    header.source_size = st.st_size;
+    header.source_mtime = st.st_mtime;
+
+    char index_name[4096];
+    vgm_gz_index_file_name(filename, index_name, sizeof(index_name));
+    FILE* file = fopen(index_name, "wb");
+    if (!file) return false;
+
+    bool result = fwrite(&header, sizeof(header), 1, file) == 1 &&
+        fwrite(index->points, sizeof(struct vgm_gz_point), header.point_count, file) == header.point_count &&
+        fwrite(index->windows, VGM_GZ_WINDOW_SIZE, header.point_count, file) == header.point_count &&
+        fwrite(index->blocks, sizeof(struct vgm_gz_block), header.block_count, file) == header.block_count;
+    result &= fclose(file) == 0;
+    if (!result) remove(index_name);
+    return result;
+}
+
+bool vgm_gz_index_load(struct vgm_gz_index* index, const char* filename)
+{
+    memset(index, 0, sizeof(*index));
+
+    struct stat st;
+    if (stat(filename, &st) == -1) return false;
+
+    char index_name[4096];
+    vgm_gz_index_file_name(filename, index_name, sizeof(index_name));
+    FILE* file = fopen(index_name, "rb");
+    if (!file) return false;
+
+    struct vgm_gz_index_header* header = &index->header;
+    bool result = fread(header, sizeof(*header), 1, file) == 1 &&
+        memcmp(header->magic, VGM_GZ_INDEX_MAGIC, sizeof(header->magic)) == 0 &&
+        header->version == VGM_GZ_INDEX_VERSION && header->window_size == VGM_GZ_WINDOW_SIZE &&
+        header->source_size == (uint64_t)st.st_size && header->source_mtime == (int64_t)st.st_mtime &&
+        header->point_count > 0 && header->point_count <= header->length / VGM_GZ_SPAN + 1 &&
+        header->block_count <= header->length;
+    if (result)
+    {
+        index->points = (struct vgm_gz_point*)malloc(header->point_count * sizeof(struct vgm_gz_point));
+        index->windows = (uint8_t*)malloc(header->point_count * VGM_GZ_WINDOW_SIZE);
+        index->blocks = (struct vgm_gz_block*)malloc((header->block_count ? header->block_count : 1) * sizeof(struct vgm_gz_block));
+        index->point_capacity = header->point_count;
+        index->block_capacity = header->block_count;
+        result = index->points && index->windows && index->blocks &&
+            fread(index->points, sizeof(struct vgm_gz_point), header->point_count, file) == header->point_count &&
+            fread(index->windows, VGM_GZ_WINDOW_SIZE, header->point_count, file) == header->point_count &&
+            fread(index->blocks, sizeof(struct vgm_gz_block), header->block_count, file) == header->block_count;
+    }
+    for (uint64_t i = 0; result && i < header->point_count; ++i)
+    {
+        const struct vgm_gz_point* point = &index->points[i];
+        result = point->bits < 8 && point->in <= header->source_size && point->out <= header->length &&
+            (i == 0 || point->out > index->points[i - 1].out);
+    }
+    fclose(file);
+
+    if (!result) vgm_gz_index_free(index);
+    return result;
+}
+
+// Last checkpoint at or before offset
+static const struct vgm_gz_point* find_point(const struct vgm_gz_index* index, uint64_t offset, size_t* number)
+{
+    size_t low = 0, high = index->header.point_count;
+    while (high - low > 1)
+    {
+        size_t middle = low + (high - low) / 2;
+        if (index->points[middle].out <= offset)
+            low = middle;
+        else
+            high = middle;
+    }
+    *number = low;
+    return index->points[low].out <= offset ? &index->points[low] : NULL;
+}
+
+bool vgm_gz_index_read(const struct vgm_gz_index* index, FILE* file, uint64_t offset, uint64_t size,
+    bool (*write)(void* user, const uint8_t* data, size_t size), void* user)
+{
+    size_t number;
+    const struct vgm_gz_point* point = index->header.point_count > 0 ? find_point(index, offset, &number) : NULL;
+    if (!point) return false;
+
+    // the first byte may hold the last bits of the block before
+    if (seek_file(file, point->in - (point->bits ? 1 : 0)) != 0)
+        return false;
+    int byte = 0;
+    if (point->bits && (byte = getc(file)) == EOF)
+        return false;
+
+    z_stream stream = { 0 };
+    if (inflateInit2(&stream, -15) != Z_OK)
+        return false;
+    if (point->bits)
+        inflatePrime(&stream, point->bits, byte >> (8 - point->bits));
+    size_t dictionary = point->out < VGM_GZ_WINDOW_SIZE ? point->out : VGM_GZ_WINDOW_SIZE;
+    const uint8_t* window = index->windows + number * VGM_GZ_WINDOW_SIZE;
+    if (dictionary > 0)
+        inflateSetDictionary(&stream, window + VGM_GZ_WINDOW_SIZE - dictionary, (uInt)dictionary);
+
+    uint8_t input[16384];
+    uint8_t output[65536];
+    uint64_t skip = offset - point->out;
+    bool result = true;
+    int ret = Z_OK;
+    while (size > 0 && ret != Z_STREAM_END)
+    {
+        if (stream.avail_in == 0)
+        {
+            size_t length = fread(input, 1, sizeof(input), file);
+            if (length == 0)
+            {
+                result = false; // truncated
+                break;
+            }
+            stream.next_in = input;
+            stream.avail_in = (uInt)length;
+        }
+
+        stream.next_out = output;
+        stream.avail_out = sizeof(output);
+        ret = inflate(&stream, Z_NO_FLUSH);
+        if (ret == Z_NEED_DICT || ret == Z_DATA_ERROR || ret == Z_MEM_ERROR)
+        {
+            result = false;
+            break;
+        }
+
+        // drop what comes before offset, pass on what is wanted
+        size_t produced = sizeof(output) - stream.avail_out;
+        size_t dropped = skip < produced ? skip : produced;
+        skip -= dropped;
+        size_t length = produced - dropped < size ? produced - dropped : size;
+        if (length > 0 && !write(user, output + dropped, length))
+        {
+            result = false;
+            break;
+        }
+        size -= length;
+    }
+
+    inflateEnd(&stream);
+    return result && size == 0;
+}
@@ -0,0 +1,112 @@
+#ifndef _VGMGZINDEX_H_
+#define _VGMGZINDEX_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <zlib.h>
+
+// Random access into .vgz files, after zlib's examples/zran.c: while a file is inflated
+// front to back, the state at a deflate block boundary is saved every VGM_GZ_SPAN bytes of
+// output. A later read starts inflating at the nearest checkpoint before the wanted offset.
+//
+// The index is stored next to the file as <file>.idx, all integers little-endian:
+//   header              64 bytes at offset 0
+//   checkpoints         point_count entries of struct vgm_gz_point
+//   windows             point_count * VGM_GZ_WINDOW_SIZE bytes, in checkpoint order
+//   blocks              block_count entries of struct vgm_gz_block
+#define VGM_GZ_INDEX_MAGIC   "VGMZIDX"
+#define VGM_GZ_INDEX_VERSION 1
+#define VGM_GZ_INDEX_SUFFIX  ".idx"
+#define VGM_GZ_WINDOW_SIZE   32768
+#define VGM_GZ_SPAN          (1024 * 1024)
+#define VGM_GZ_NO_TABLE      UINT32_MAX
+
+struct vgm_gz_index_header
+{
+    char magic[8];          // VGM_GZ_INDEX_MAGIC
+    uint32_t version;
+    uint32_t window_size;   // VGM_GZ_WINDOW_SIZE
+    uint64_t source_size;   // size and modification time of the .vgz, a changed file
+    int64_t source_mtime;   // makes the index stale
+    uint64_t length;        // uncompressed bytes inflated while indexing, reads may go further
+    uint64_t point_count;
+    uint64_t block_count;
+    uint8_t reserved[8];
+};
+
+struct vgm_gz_point
+{
+    uint64_t out;           // uncompressed offset
+    uint64_t in;            // offset in the .vgz of the first byte holding no bits of earlier blocks
+    uint32_t bits;          // bits of the byte before in that start the block, 0-7
+    uint32_t reserved;
+};
+
+// Data block of the uncompressed file, as stored in it
+struct vgm_gz_block
+{
+    uint64_t offset;        // uncompressed offset of the data, block header excluded
+    uint32_t size;
+    uint32_t table;         // block number of the 0x7F block in effect, or VGM_GZ_NO_TABLE
+    uint8_t type;
+    uint8_t reserved[7];
+};
+
+struct vgm_gz_index
+{
+    struct vgm_gz_index_header header;
+    struct vgm_gz_point* points;
+    uint8_t* windows;       // VGM_GZ_WINDOW_SIZE bytes per checkpoint
+    size_t point_capacity;
+    struct vgm_gz_block* blocks;
+    size_t block_capacity;
+};
+
+// Inflates a .vgz front to back like gzread(), filling in an index on the way
+struct vgm_gz_builder
+{
+    FILE* file;
+    z_stream stream;
+    uint8_t input[16384];
+    uint64_t in;            // bytes read from the file
+    uint64_t out;           // bytes inflated
+    uint8_t window[VGM_GZ_WINDOW_SIZE]; // last bytes inflated, circular
+    size_t window_pos;
+    bool plain;             // not gzip data: passed through like gzread() does, cannot be indexed
+    bool multiple;          // a second gzip member was found: cannot be indexed
+    bool end;
+    bool failed;
+    struct vgm_gz_index* index;
+};
+
+void vgm_gz_index_init(struct vgm_gz_index* index);
+
+void vgm_gz_index_free(struct vgm_gz_index* index);
+
+bool vgm_gz_index_add_block(struct vgm_gz_index* index, uint64_t offset, uint32_t size, uint8_t type, uint32_t table);
+
+// Path of the index of a .vgz file
+void vgm_gz_index_file_name(const char* filename, char* index_name, size_t size);
+
+// Write the index next to the file it was built from
+bool vgm_gz_index_save(const struct vgm_gz_index* index, const char* filename);
+
+// Read the index of a file, false if there is none or the file changed since
+bool vgm_gz_index_load(struct vgm_gz_index* index, const char* filename);
+
+// Inflate size bytes from offset on and pass them to write, starting at the nearest checkpoint
+bool vgm_gz_index_read(const struct vgm_gz_index* index, FILE* file, uint64_t offset, uint64_t size,
+    bool (*write)(void* user, const uint8_t* data, size_t size), void* user);
+
+// index may be NULL to only inflate
+bool vgm_gz_builder_open(struct vgm_gz_builder* builder, const char* filename, struct vgm_gz_index* index);
+
+// Like gzread(): the number of bytes read, 0 at the end of the data, -1 on error
+int vgm_gz_builder_read(struct vgm_gz_builder* builder, uint8_t* data, size_t size);
+
+// Close the file, false if it could not be indexed or reading failed
+bool vgm_gz_builder_close(struct vgm_gz_builder* builder);
+
+#endif // _VGMGZINDEX_H_
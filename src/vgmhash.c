@@ -0,0 +1,143 @@
+#include <string.h>
+
+#include "vgmhash.h"
+
+#define PRIME1 0x9E3779B185EBCA87ULL
+#define PRIME2 0xC2B2AE3D27D4EB4FULL
+#define PRIME3 0x165667B19E3779F9ULL
+#define PRIME4 0x85EBCA77C2B2AE63ULL
+#define PRIME5 0x27D4EB2F165667C5ULL
+
+static inline uint64_t rotl(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t read_u64(const uint8_t* ptr)
+{
+    uint64_t value;
+    memcpy(&value, ptr, 8); // xxHash is defined on little-endian input
+    return value;
+}
+
+static inline uint32_t read_u32(const uint8_t* ptr)
+{
+    uint32_t value;
+    memcpy(&value, ptr, 4);
+    return value;
+}
+
+static inline uint64_t round64(uint64_t acc, uint64_t input)
+{
+    acc += input * PRIME2;
+    acc = rotl(acc, 31);
+    return acc * PRIME1;
+}
+
+static inline uint64_t merge_round(uint64_t acc, uint64_t value)
+{
+    acc ^= round64(0, value);
+    return acc * PRIME1 + PRIME4;
+}
+
+void vgm_hash_reset(struct vgm_hash* hash)
+{
+    hash->v[0] = PRIME1 + PRIME2;
+    hash->v[1] = PRIME2;
+    hash->v[2] = 0;
+    hash->v[3] = -PRIME1;
+    hash->total = 0;
+    hash->buffer_size = 0;
+}
+
+static inline const uint8_t* consume_stripes(uint64_t* v, const uint8_t* ptr, const uint8_t* end)
+{
+    uint64_t v0 = v[0], v1 = v[1], v2 = v[2], v3 = v[3];
+    while (end - ptr >= 32)
+    {
+        v0 = round64(v0, read_u64(ptr));
+        v1 = round64(v1, read_u64(ptr + 8));
+        v2 = round64(v2, read_u64(ptr + 16));
+        v3 = round64(v3, read_u64(ptr + 24));
+        ptr += 32;
+    }
+    v[0] = v0; v[1] = v1; v[2] = v2; v[3] = v3;
+    return ptr;
+}
+
+void vgm_hash_update(struct vgm_hash* hash, const uint8_t* data, size_t size)
+{
+    const uint8_t* ptr = data;
+    const uint8_t* end = data + size;
+    hash->total += size;
+
+    if (hash->buffer_size)
+    {
+        size_t copy = 32 - hash->buffer_size;
+        if (copy > size) copy = size;
+        memcpy(hash->buffer + hash->buffer_size, ptr, copy);
+        hash->buffer_size += copy;
+        ptr += copy;
+        if (hash->buffer_size < 32) return;
+        consume_stripes(hash->v, hash->buffer, hash->buffer + 32);
+        hash->buffer_size = 0;
+    }
+
+    ptr = consume_stripes(hash->v, ptr, end);
+    memcpy(hash->buffer, ptr, end - ptr);
+    hash->buffer_size = end - ptr;
+}
+
+uint64_t vgm_hash_digest(const struct vgm_hash* hash)
+{
+    const uint64_t* v = hash->v;
+    uint64_t h;
+
+    if (hash->total >= 32)
+    {
+        h = rotl(v[0], 1) + rotl(v[1], 7) + rotl(v[2], 12) + rotl(v[3], 18);
+        h = merge_round(h, v[0]);
+        h = merge_round(h, v[1]);
+        h = merge_round(h, v[2]);
+        h = merge_round(h, v[3]);
+    }
+    else
+    {
+        h = PRIME5;
+    }
+    h += hash->total;
+
+    const uint8_t* ptr = hash->buffer;
+    const uint8_t* end = hash->buffer + hash->buffer_size;
+    for (; end - ptr >= 8; ptr += 8)
+    {
+        h ^= round64(0, read_u64(ptr));
+        h = rotl(h, 27) * PRIME1 + PRIME4;
+    }
+    if (end - ptr >= 4)
+    {
+        h ^= (uint64_t)read_u32(ptr) * PRIME1;
+        h = rotl(h, 23) * PRIME2 + PRIME3;
+        ptr += 4;
+    }
+    for (; ptr < end; ++ptr)
+    {
+        h ^= *ptr * PRIME5;
+        h = rotl(h, 11) * PRIME1;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+uint64_t vgm_hash_buffer(const uint8_t* data, size_t size)
+{
+    struct vgm_hash hash;
+    vgm_hash_reset(&hash);
+    vgm_hash_update(&hash, data, size);
+    return vgm_hash_digest(&hash);
+}
@@ -0,0 +1,25 @@
+#ifndef _VGMHASH_H_
+#define _VGMHASH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Streaming XXH64, used to identify block contents
+struct vgm_hash
+{
+    uint64_t v[4];
+    uint64_t total;
+    uint8_t buffer[32];
+    size_t buffer_size;
+};
+
+void vgm_hash_reset(struct vgm_hash* hash);
+
+void vgm_hash_update(struct vgm_hash* hash, const uint8_t* data, size_t size);
+
+uint64_t vgm_hash_digest(const struct vgm_hash* hash);
+
+// One-shot version of the functions above
+uint64_t vgm_hash_buffer(const uint8_t* data, size_t size);
+
+#endif // _VGMHASH_H_
@@ -0,0 +1,273 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#if defined(VGM_THREADS)
+    #include <pthread.h>
+#endif
+
+#include "vgmpack.h"
+
+_Static_assert(sizeof(struct vgm_pack_header) == 64, "pack header must be 64 bytes");
+_Static_assert(sizeof(struct vgm_pack_entry) == 96, "pack entries must be 96 bytes");
+
+struct vgm_pack
+{
+    FILE* file;
+    uint64_t end;                   // first free payload offset
+    struct vgm_pack_entry* entries;
+    size_t count;
+    size_t capacity;
+    char* names;
+    size_t names_size;
+    size_t names_capacity;
+    bool failed;
+#if defined(VGM_THREADS)
+    pthread_mutex_t lock;
+#endif
+};
+
+static void lock(struct vgm_pack* pack)
+{
+#if defined(VGM_THREADS)
+    pthread_mutex_lock(&pack->lock);
+#else
+    (void)pack;
+#endif
+}
+
+static void unlock(struct vgm_pack* pack)
+{
+#if defined(VGM_THREADS)
+    pthread_mutex_unlock(&pack->lock);
+#else
+    (void)pack;
+#endif
+}
+
+static uint64_t align(uint64_t offset)
+{
+    return (offset + VGM_PACK_ALIGNMENT - 1) & ~(uint64_t)(VGM_PACK_ALIGNMENT - 1);
+}
+
+struct vgm_pack* vgm_pack_create(const char* filename)
+{
+    struct vgm_pack* pack = (struct vgm_pack*)calloc(1, sizeof(struct vgm_pack));
+    if (!pack) return NULL;
+
+    if (!(pack->file = fopen(filename, "wb")))
+    {
+        free(pack);
+        return NULL;
+    }
+    pack->end = sizeof(struct vgm_pack_header);
+#if defined(VGM_THREADS)
+    pthread_mutex_init(&pack->lock, NULL);
+#endif
+    return pack;
+}
+
+uint64_t vgm_pack_reserve(struct vgm_pack* pack, uint64_t size)
+{
+    lock(pack);
+    uint64_t offset = pack->end;
+    pack->end = align(offset + size);
+    unlock(pack);
+    return offset;
+}
+
+bool vgm_pack_write(struct vgm_pack* pack, uint64_t offset, const uint8_t* data, size_t size)
+{
+#if !defined(_WIN32)
+    // positioned writes need no lock, payloads never overlap
+    int fd = fileno(pack->file);
+    while (size > 0)
+    {
+        ssize_t length = pwrite(fd, data, size, (off_t)offset);
+        if (length <= 0) return false;
+        data += length;
+        offset += length;
+        size -= length;
+    }
+    return true;
+#else
+    lock(pack);
+    bool result = _fseeki64(pack->file, offset, SEEK_SET) == 0 && fwrite(data, 1, size, pack->file) == size;
+    unlock(pack);
+    return result;
+#endif
+}
+
+static bool add_name(struct vgm_pack* pack, const char* name, uint32_t* offset)
+{
+    size_t length = strlen(name) + 1;
+    if (pack->names_size + length > pack->names_capacity)
+    {
+        size_t capacity = pack->names_capacity ? pack->names_capacity * 2 : 4096;
+        while (capacity < pack->names_size + length) capacity *= 2;
+        char* tmp = (char*)realloc(pack->names, capacity);
+        if (!tmp) return false;
+        pack->names = tmp;
+        pack->names_capacity = capacity;
+    }
+    *offset = (uint32_t)pack->names_size;
+    memcpy(pack->names + pack->names_size, name, length);
+    pack->names_size += length;
+    return true;
+}
+
+static bool reserve_entries(struct vgm_pack* pack, size_t count)
+{
+    if (pack->count + count <= pack->capacity) return true;
+
+    size_t capacity = pack->capacity ? pack->capacity * 2 : 1024;
+    while (capacity < pack->count + count) capacity *= 2;
+    struct vgm_pack_entry* tmp = (struct vgm_pack_entry*)realloc(pack->entries, capacity * sizeof(struct vgm_pack_entry));
+    if (!tmp) return false;
+    pack->entries = tmp;
+    pack->capacity = capacity;
+    return true;
+}
+
+bool vgm_pack_add(struct vgm_pack* pack, const char* source, struct vgm_pack_entry* entries, size_t count)
+{
+    lock(pack);
+    uint32_t name;
+    bool result = reserve_entries(pack, count) && add_name(pack, source, &name);
+    if (result)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            entries[i].source = name;
+            pack->entries[pack->count++] = entries[i];
+        }
+    }
+    else
+    {
+        pack->failed = true; // the index would miss blocks
+    }
+    unlock(pack);
+    return result;
+}
+
+bool vgm_pack_finish(struct vgm_pack* pack)
+{
+    struct vgm_pack_header header = { VGM_PACK_MAGIC, VGM_PACK_VERSION, sizeof(struct vgm_pack_entry) };
+    header.entry_count = pack->count;
+    header.index_offset = pack->end;
+    header.names_offset = header.index_offset + pack->count * sizeof(struct vgm_pack_entry);
+    header.names_size = pack->names_size;
+
+    bool result = !pack->failed &&
+        vgm_pack_write(pack, header.index_offset, (const uint8_t*)pack->entries, pack->count * sizeof(struct vgm_pack_entry)) &&
+        vgm_pack_write(pack, header.names_offset, (const uint8_t*)pack->names, pack->names_size) &&
+        vgm_pack_write(pack, 0, (const uint8_t*)&header, sizeof(header));
+    result &= fclose(pack->file) == 0;
+
+#if defined(VGM_THREADS)
+    pthread_mutex_destroy(&pack->lock);
+#endif
+    free(pack->entries);
+    free(pack->names);
+    free(pack);
+    return result;
+}
+
+bool vgm_pack_open(struct vgm_pack_reader* reader, const char* filename)
+{
+    memset(reader, 0, sizeof(*reader));
+
+#if !defined(_WIN32)
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) return false;
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size < (off_t)sizeof(struct vgm_pack_header))
+    {
+        close(fd);
+        return false;
+    }
+    reader->base = (uint8_t*)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (reader->base == MAP_FAILED)
+    {
+        reader->base = NULL;
+        return false;
+    }
+    reader->size = st.st_size;
+    reader->mapped = true;
+#else
+    FILE* file = fopen(filename, "rb");
+    if (!file) return false;
+    _fseeki64(file, 0, SEEK_END);
+    reader->size = _ftelli64(file);
+    _fseeki64(file, 0, SEEK_SET);
+    if (reader->size < sizeof(struct vgm_pack_header) || !(reader->base = (uint8_t*)malloc(reader->size)) ||
+        fread(reader->base, 1, reader->size, file) != reader->size)
+    {
+        fclose(file);
+        vgm_pack_close(reader);
+        return false;
+    }
+    fclose(file);
+#endif
+
+    const struct vgm_pack_header* header = (const struct vgm_pack_header*)reader->base;
+    uint64_t index_size = header->entry_count * sizeof(struct vgm_pack_entry);
+    if (memcmp(header->magic, VGM_PACK_MAGIC, sizeof(header->magic)) != 0 || header->version != VGM_PACK_VERSION ||
+        header->entry_size != sizeof(struct vgm_pack_entry) ||
+        header->entry_count > reader->size / sizeof(struct vgm_pack_entry) ||
+        header->index_offset > reader->size - index_size || header->index_offset % 8 != 0 ||
+        header->names_offset > reader->size || header->names_size > reader->size - header->names_offset ||
+        (header->names_size > 0 && reader->base[header->names_offset + header->names_size - 1] != '\0'))
+    {
+        vgm_pack_close(reader);
+        return false;
+    }
+
+    reader->header = header;
+    reader->entries = (const struct vgm_pack_entry*)(reader->base + header->index_offset);
+    reader->names = (const char*)reader->base + header->names_offset;
+    return true;
+}
+
+size_t vgm_pack_count(const struct vgm_pack_reader* reader)
+{
+    return reader->header ? reader->header->entry_count : 0;
+}
+
+bool vgm_pack_get(const struct vgm_pack_reader* reader, size_t i, struct vgm_pack_block* block)
+{
+    if (i >= vgm_pack_count(reader)) return false;
+
+    const struct vgm_pack_entry* entry = &reader->entries[i];
+    if (entry->offset > reader->size || entry->length > reader->size - entry->offset ||
+        entry->source >= reader->header->names_size)
+        return false;
+
+    block->data = reader->base + entry->offset;
+    block->size = entry->length;
+    block->hash = entry->hash;
+    block->type = entry->type;
+    block->block = entry->block;
+    block->chip = entry->chip[sizeof(entry->chip) - 1] == '\0' ? entry->chip : "???";
+    block->source = reader->names + entry->source;
+    return true;
+}
+
+void vgm_pack_close(struct vgm_pack_reader* reader)
+{
+#if !defined(_WIN32)
+    if (reader->mapped && reader->base)
+        munmap(reader->base, reader->size);
+    else
+#endif
+        free(reader->base);
+    memset(reader, 0, sizeof(*reader));
+}
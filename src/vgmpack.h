@@ -0,0 +1,90 @@
+#ifndef _VGMPACK_H_
+#define _VGMPACK_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Pack file: every block of a run in one file. All integers are little-endian.
+//   header              64 bytes at offset 0
+//   payloads            each one starting at a multiple of VGM_PACK_ALIGNMENT
+//   index               entry_count entries of struct vgm_pack_entry at index_offset
+//   source file names   NUL-terminated strings at names_offset
+#define VGM_PACK_MAGIC     "VGMPACK"
+#define VGM_PACK_VERSION   1
+#define VGM_PACK_ALIGNMENT 64
+
+struct vgm_pack_header
+{
+    char magic[8];          // VGM_PACK_MAGIC
+    uint32_t version;
+    uint32_t entry_size;    // sizeof(struct vgm_pack_entry)
+    uint64_t entry_count;
+    uint64_t index_offset;
+    uint64_t names_offset;
+    uint64_t names_size;
+    uint8_t reserved[16];
+};
+
+struct vgm_pack_entry
+{
+    uint64_t offset;        // payload offset in the pack
+    uint64_t length;
+    uint64_t hash;          // XXH64 of the payload
+    uint32_t source;        // offset of the source file name in the names table
+    uint32_t block;         // block number inside the source file
+    uint8_t type;           // data block type, after decompression
+    uint8_t reserved[7];
+    char chip[56];          // get_chip_name(type)
+};
+
+// Pack file being written, safe to use from several threads
+struct vgm_pack;
+
+struct vgm_pack* vgm_pack_create(const char* filename);
+
+// Room for a payload of the given size, returns its offset
+uint64_t vgm_pack_reserve(struct vgm_pack* pack, uint64_t size);
+
+// Write payload data anywhere inside the reserved room
+bool vgm_pack_write(struct vgm_pack* pack, uint64_t offset, const uint8_t* data, size_t size);
+
+// Index the blocks of one source file, their source field is filled in
+bool vgm_pack_add(struct vgm_pack* pack, const char* source, struct vgm_pack_entry* entries, size_t count);
+
+// Write the index and the header, then free the pack
+bool vgm_pack_finish(struct vgm_pack* pack);
+
+// Pack file mapped for reading
+struct vgm_pack_reader
+{
+    uint8_t* base;
+    size_t size;
+    bool mapped;
+    const struct vgm_pack_header* header;
+    const struct vgm_pack_entry* entries;
+    const char* names;
+};
+
+// View of one block, pointing into the mapped pack
+struct vgm_pack_block
+{
+    const uint8_t* data;
+    uint64_t size;
+    uint64_t hash;
+    uint8_t type;
+    uint32_t block;
+    const char* chip;
+    const char* source;
+};
+
+bool vgm_pack_open(struct vgm_pack_reader* reader, const char* filename);
+
+size_t vgm_pack_count(const struct vgm_pack_reader* reader);
+
+// Block i of the pack in O(1), false if its entry is out of bounds
+bool vgm_pack_get(const struct vgm_pack_reader* reader, size_t i, struct vgm_pack_block* block);
+
+void vgm_pack_close(struct vgm_pack_reader* reader);
+
+#endif // _VGMPACK_H_
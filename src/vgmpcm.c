@@ -0,0 +1,270 @@
+#include <string.h>
+
+#include "vgmpcm.h"
+
+#define DECODE_CHUNK_SIZE 4096  // bytes decoded at a time by vgm_pcm_write_wav()
+
+static const char* format_names[VGM_PCM_FORMAT_COUNT] = {
+    [VGM_PCM_NONE] = "no audio",
+    [VGM_PCM_U8] = "8-bit unsigned PCM",
+    [VGM_PCM_SIGN_MAGNITUDE] = "8-bit sign-magnitude PCM",
+    [VGM_PCM_OKI_ADPCM] = "4-bit OKI ADPCM",
+    [VGM_PCM_ADPCM_A] = "4-bit ADPCM-A",
+    [VGM_PCM_DELTA_T] = "4-bit DELTA-T ADPCM",
+    [VGM_PCM_DPCM] = "1-bit delta PCM",
+};
+
+// Step sizes shared by the OKI and ADPCM-A decoders
+#define ADPCM_STEPS(X) \
+    X(16) X(17) X(19) X(21) X(23) X(25) X(28) X(31) X(34) X(37) X(41) X(45) X(50) X(55) X(60) X(66) X(73) \
+    X(80) X(88) X(97) X(107) X(118) X(130) X(143) X(157) X(173) X(190) X(209) X(230) X(253) X(279) X(307) \
+    X(337) X(371) X(408) X(449) X(494) X(544) X(598) X(658) X(724) X(796) X(876) X(963) X(1060) X(1166) \
+    X(1282) X(1411) X(1552)
+#define ADPCM_STEP_COUNT 49
+
+#define NIBBLES(f, s) { f(s, 0), f(s, 1), f(s, 2), f(s, 3), f(s, 4), f(s, 5), f(s, 6), f(s, 7), \
+    f(s, 8), f(s, 9), f(s, 10), f(s, 11), f(s, 12), f(s, 13), f(s, 14), f(s, 15) }
+
+// Difference added by a nibble at a step size: the OKIM6258 sums truncated fractions of the step,
+// the YM2610 scales it once
+#define OKI_DIFF(s, n) (((n) & 8 ? -1 : 1) * \
+    (((n) & 4 ? (s) : 0) + ((n) & 2 ? (s) >> 1 : 0) + ((n) & 1 ? (s) >> 2 : 0) + ((s) >> 3)))
+#define ADPCM_A_DIFF(s, n) (((n) & 8 ? -1 : 1) * ((2 * ((n) & 7) + 1) * (s) / 8))
+#define OKI_ROW(s) NIBBLES(OKI_DIFF, s),
+#define ADPCM_A_ROW(s) NIBBLES(ADPCM_A_DIFF, s),
+
+static const int16_t oki_diffs[ADPCM_STEP_COUNT][16] = { ADPCM_STEPS(OKI_ROW) };
+static const int16_t adpcm_a_diffs[ADPCM_STEP_COUNT][16] = { ADPCM_STEPS(ADPCM_A_ROW) };
+
+// Step index changes by the magnitude of a nibble
+static const int8_t oki_shifts[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+static const int8_t adpcm_a_shifts[8] = { -1, -1, -1, -1, 2, 5, 7, 9 };
+
+// DELTA-T: the difference is (2n + 1) / 8 of the step, the step is scaled by n / 64 after it
+static const int8_t delta_t_factors[16] = { 1, 3, 5, 7, 9, 11, 13, 15, -1, -3, -5, -7, -9, -11, -13, -15 };
+static const uint8_t delta_t_scales[16] = { 57, 57, 57, 57, 77, 102, 128, 153, 57, 57, 57, 57, 77, 102, 128, 153 };
+
+#define DELTA_T_MIN_STEP 127
+#define DELTA_T_MAX_STEP 24576
+
+// DPCM: level change after bits 0 to k of a byte, while the level stays clear of its limits
+#define BITS_SET(x) (((x) & 1) + ((x) >> 1 & 1) + ((x) >> 2 & 1) + ((x) >> 3 & 1) + \
+    ((x) >> 4 & 1) + ((x) >> 5 & 1) + ((x) >> 6 & 1) + ((x) >> 7 & 1))
+#define DPCM_DELTA(b, k) (4 * BITS_SET((b) & ((2 << (k)) - 1)) - 2 * ((k) + 1))
+#define DPCM_ROW(b) { DPCM_DELTA(b, 0), DPCM_DELTA(b, 1), DPCM_DELTA(b, 2), DPCM_DELTA(b, 3), \
+    DPCM_DELTA(b, 4), DPCM_DELTA(b, 5), DPCM_DELTA(b, 6), DPCM_DELTA(b, 7) }
+#define DPCM_ROWS_4(b) DPCM_ROW(b), DPCM_ROW(b + 1), DPCM_ROW(b + 2), DPCM_ROW(b + 3)
+#define DPCM_ROWS_16(b) DPCM_ROWS_4(b), DPCM_ROWS_4(b + 4), DPCM_ROWS_4(b + 8), DPCM_ROWS_4(b + 12)
+#define DPCM_ROWS_64(b) DPCM_ROWS_16(b), DPCM_ROWS_16(b + 16), DPCM_ROWS_16(b + 32), DPCM_ROWS_16(b + 48)
+
+static const int8_t dpcm_deltas[256][8] = { DPCM_ROWS_64(0), DPCM_ROWS_64(64), DPCM_ROWS_64(128), DPCM_ROWS_64(192) };
+
+#define DPCM_START_LEVEL 64
+#define DPCM_MAX_LEVEL   127
+#define DPCM_SAFE_MIN    16     // a byte moves the level by 16 at most
+#define DPCM_SAFE_MAX    (DPCM_MAX_LEVEL - 16)
+
+enum vgm_pcm_format vgm_pcm_get_format(uint8_t type)
+{
+    if (type >= 0x40 && type <= 0x7e) type -= 0x40;
+
+    switch (type)
+    {
+    case 0x00: case 0x03:
+        return VGM_PCM_U8;
+    case 0x01: case 0x02: case 0xc0: case 0xc1:
+        return VGM_PCM_SIGN_MAGNITUDE;
+    case 0x04:
+        return VGM_PCM_OKI_ADPCM;
+    case 0x82:
+        return VGM_PCM_ADPCM_A;
+    case 0x81: case 0x83: case 0x88:
+        return VGM_PCM_DELTA_T;
+    case 0x07: case 0xc2:
+        return VGM_PCM_DPCM;
+    default:
+        return VGM_PCM_NONE;
+    }
+}
+
+const char* vgm_pcm_get_format_name(enum vgm_pcm_format format)
+{
+    return format < VGM_PCM_FORMAT_COUNT ? format_names[format] : "";
+}
+
+uint32_t vgm_pcm_get_rate(uint8_t type)
+{
+    if (type >= 0x40 && type <= 0x7e) type -= 0x40;
+
+    switch (type)
+    {
+    case 0x04: return 15625;    // 8 MHz / 512
+    case 0x82: return 18518;    // 8 MHz / 432
+    case 0x81: case 0x83: case 0x88: return 16000;
+    case 0x07: case 0xc2: return 33144;     // fastest DMC rate, NTSC
+    default: return 22050;
+    }
+}
+
+size_t vgm_pcm_get_sample_count(enum vgm_pcm_format format, size_t size)
+{
+    switch (format)
+    {
+    case VGM_PCM_NONE: return 0;
+    case VGM_PCM_OKI_ADPCM: case VGM_PCM_ADPCM_A: case VGM_PCM_DELTA_T: return size * 2;
+    case VGM_PCM_DPCM: return size * 8;
+    default: return size;
+    }
+}
+
+void vgm_pcm_decoder_init(struct vgm_pcm_decoder* decoder, enum vgm_pcm_format format)
+{
+    decoder->format = format;
+    decoder->signal = format == VGM_PCM_DPCM ? DPCM_START_LEVEL : 0;
+    decoder->step = format == VGM_PCM_DELTA_T ? DELTA_T_MIN_STEP : 0;
+}
+
+static inline int clamp(int value, int min, int max)
+{
+    return value < min ? min : value > max ? max : value;
+}
+
+static inline int16_t decode_oki(int nibble, int* signal, int* step)
+{
+    *signal = clamp(*signal + oki_diffs[*step][nibble], -2048, 2047);
+    *step = clamp(*step + oki_shifts[nibble & 7], 0, ADPCM_STEP_COUNT - 1);
+    return (int16_t)(*signal * 16);
+}
+
+static inline int16_t decode_adpcm_a(int nibble, int* signal, int* step)
+{
+    // 12-bit sum, wrapping like the chip
+    *signal = ((*signal + adpcm_a_diffs[*step][nibble]) & 0xfff) ^ 0x800;
+    *signal -= 0x800;
+    *step = clamp(*step + adpcm_a_shifts[nibble & 7], 0, ADPCM_STEP_COUNT - 1);
+    return (int16_t)(*signal * 16);
+}
+
+static inline int16_t decode_delta_t(int nibble, int* signal, int* step)
+{
+    *signal = clamp(*signal + delta_t_factors[nibble] * *step / 8, -32768, 32767);
+    *step = clamp(*step * delta_t_scales[nibble] / 64, DELTA_T_MIN_STEP, DELTA_T_MAX_STEP);
+    return (int16_t)*signal;
+}
+
+size_t vgm_pcm_decode(struct vgm_pcm_decoder* decoder, const uint8_t* data, size_t size, int16_t* samples)
+{
+    int signal = decoder->signal;
+    int step = decoder->step;
+    switch (decoder->format)
+    {
+    case VGM_PCM_NONE:
+        return 0;
+    case VGM_PCM_U8:
+        for (size_t i = 0; i < size; ++i) samples[i] = (int16_t)((data[i] - 128) * 256);
+        break;
+    case VGM_PCM_SIGN_MAGNITUDE:
+        for (size_t i = 0; i < size; ++i)
+        {
+            int magnitude = data[i] & 0x7f;
+            samples[i] = (int16_t)((data[i] & 0x80 ? magnitude : -magnitude) * 256);
+        }
+        break;
+    case VGM_PCM_OKI_ADPCM:
+        for (size_t i = 0; i < size; ++i)
+        {
+            samples[2 * i] = decode_oki(data[i] & 0x0f, &signal, &step);
+            samples[2 * i + 1] = decode_oki(data[i] >> 4, &signal, &step);
+        }
+        break;
+    case VGM_PCM_ADPCM_A:
+        for (size_t i = 0; i < size; ++i)
+        {
+            samples[2 * i] = decode_adpcm_a(data[i] >> 4, &signal, &step);
+            samples[2 * i + 1] = decode_adpcm_a(data[i] & 0x0f, &signal, &step);
+        }
+        break;
+    case VGM_PCM_DELTA_T:
+        for (size_t i = 0; i < size; ++i)
+        {
+            samples[2 * i] = decode_delta_t(data[i] >> 4, &signal, &step);
+            samples[2 * i + 1] = decode_delta_t(data[i] & 0x0f, &signal, &step);
+        }
+        break;
+    case VGM_PCM_DPCM:
+        // 7-bit output level, moved by 2 per bit and held at its limits
+        for (size_t i = 0; i < size; ++i)
+        {
+            if (signal >= DPCM_SAFE_MIN && signal <= DPCM_SAFE_MAX)
+            {
+                const int8_t* deltas = dpcm_deltas[data[i]];
+                for (int bit = 0; bit < 8; ++bit)
+                {
+                    samples[8 * i + bit] = (int16_t)((signal + deltas[bit] - DPCM_START_LEVEL) * 512);
+                }
+                signal += deltas[7];
+                continue;
+            }
+            for (int bit = 0; bit < 8; ++bit)
+            {
+                if (data[i] >> bit & 1)
+                    signal += signal <= DPCM_MAX_LEVEL - 2 ? 2 : 0;
+                else
+                    signal -= signal >= 2 ? 2 : 0;
+                samples[8 * i + bit] = (int16_t)((signal - DPCM_START_LEVEL) * 512);
+            }
+        }
+        break;
+    default:
+        return 0;
+    }
+    decoder->signal = signal;
+    decoder->step = step;
+    return vgm_pcm_get_sample_count(decoder->format, size);
+}
+
+static void put_u16(uint8_t* ptr, uint16_t value)
+{
+    ptr[0] = (uint8_t)value;
+    ptr[1] = (uint8_t)(value >> 8);
+}
+
+static void put_u32(uint8_t* ptr, uint32_t value)
+{
+    put_u16(ptr, (uint16_t)value);
+    put_u16(ptr + 2, (uint16_t)(value >> 16));
+}
+
+bool vgm_pcm_write_wav(FILE* file, uint8_t type, const uint8_t* data, size_t size, uint32_t rate)
+{
+    enum vgm_pcm_format format = vgm_pcm_get_format(type);
+    uint64_t data_size = (uint64_t)vgm_pcm_get_sample_count(format, size) * 2;
+    if (format == VGM_PCM_NONE || data_size > UINT32_MAX - 36) return false;
+
+    uint8_t header[VGM_PCM_WAV_HEADER_SIZE];
+    memcpy(header, "RIFF", 4);
+    put_u32(header + 4, (uint32_t)(36 + data_size));
+    memcpy(header + 8, "WAVEfmt ", 8);
+    put_u32(header + 16, 16);
+    put_u16(header + 20, 1);        // PCM
+    put_u16(header + 22, 1);        // mono
+    put_u32(header + 24, rate);
+    put_u32(header + 28, rate * 2);
+    put_u16(header + 32, 2);        // bytes per frame
+    put_u16(header + 34, 16);
+    memcpy(header + 36, "data", 4);
+    put_u32(header + 40, (uint32_t)data_size);
+    if (fwrite(header, 1, sizeof(header), file) != sizeof(header)) return false;
+
+    // samples are written as the host stores them, little-endian like the rest of the output
+    struct vgm_pcm_decoder decoder;
+    int16_t samples[DECODE_CHUNK_SIZE * 8];
+    vgm_pcm_decoder_init(&decoder, format);
+    for (size_t offset = 0; offset < size; offset += DECODE_CHUNK_SIZE)
+    {
+        size_t length = size - offset < DECODE_CHUNK_SIZE ? size - offset : DECODE_CHUNK_SIZE;
+        size_t count = vgm_pcm_decode(&decoder, data + offset, length, samples);
+        if (fwrite(samples, sizeof(int16_t), count, file) != count) return false;
+    }
+    return true;
+}
@@ -0,0 +1,53 @@
+#ifndef _VGMPCM_H_
+#define _VGMPCM_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Decoders of the sample formats found in data blocks, all to 16-bit signed PCM. The inner loops
+// are table lookups and straight arithmetic without branches on the data, so the PCM formats
+// vectorize and the ADPCM ones (a chain through their state) cost a few instructions per nibble.
+#define VGM_PCM_WAV_HEADER_SIZE 44
+
+enum vgm_pcm_format
+{
+    VGM_PCM_NONE,           // not audio, or no known layout
+    VGM_PCM_U8,             // 8-bit unsigned (YM2612, PWM)
+    VGM_PCM_SIGN_MAGNITUDE, // 8-bit sign-magnitude, bit 7 set is positive (RF5C68, RF5C164)
+    VGM_PCM_OKI_ADPCM,      // 4-bit ADPCM, low nibble first (OKIM6258)
+    VGM_PCM_ADPCM_A,        // 4-bit ADPCM, high nibble first, 12-bit wrapping sum (YM2610 ADPCM-A)
+    VGM_PCM_DELTA_T,        // 4-bit ADPCM, high nibble first, 16-bit sum (YM2608, YM2610, Y8950 DELTA-T)
+    VGM_PCM_DPCM,           // 1-bit delta, least significant bit first (NES APU)
+    VGM_PCM_FORMAT_COUNT
+};
+
+// State carried from one piece of a block to the next
+struct vgm_pcm_decoder
+{
+    enum vgm_pcm_format format;
+    int signal;
+    int step;
+};
+
+// Format of a block type, compressed streams (0x40-0x7E) are read as their chip
+enum vgm_pcm_format vgm_pcm_get_format(uint8_t type);
+
+const char* vgm_pcm_get_format_name(enum vgm_pcm_format format);
+
+// Usual playback rate of a block type. The block does not tell, the chip is programmed for it.
+uint32_t vgm_pcm_get_rate(uint8_t type);
+
+// Samples decoded from size bytes
+size_t vgm_pcm_get_sample_count(enum vgm_pcm_format format, size_t size);
+
+void vgm_pcm_decoder_init(struct vgm_pcm_decoder* decoder, enum vgm_pcm_format format);
+
+// Decode the next bytes of a block, returns the number of samples written
+size_t vgm_pcm_decode(struct vgm_pcm_decoder* decoder, const uint8_t* data, size_t size, int16_t* samples);
+
+// Write a block as a mono 16-bit WAV file, false on a write error or if the type holds no audio
+bool vgm_pcm_write_wav(FILE* file, uint8_t type, const uint8_t* data, size_t size, uint32_t rate);
+
+#endif // _VGMPCM_H_
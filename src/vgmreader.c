@@ -2,400 +2,482 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
-#include <zlib.h>
 
 #include "raylib.h"
 #include "raygui.h"
 #include "functions.h"
+#include "vgmreader.h"
+#include "vgmcache.h"
+#include "vgmextract.h"
+#include "vgmscan.h"
+#include "vgmwave.h"
+#include "vgmzip.h"
 
 #if defined(PLATFORM_WEB)
     #define CUSTOM_MODAL_DIALOGS            // Force custom modal dialogs usage
     #include <emscripten/emscripten.h>      // Emscripten library - LLVM to JavaScript compiler
 #endif
 
-#define VGM_HEADER_SIZE 0x40
-#define VGM_EOF_OFFSET  0x04
-#define VGM_DATA_OFFSET 0x34
-#define MAX_BLOCK_COUNT 1000
+#if defined(VGM_THREADS)
+    #include <pthread.h>
+    #include <stdatomic.h>
+    #include <unistd.h>
+#endif
 
-// Structure to hold data block information
-struct VGMDataBlock {
-    uint32_t type;
-    uint32_t size;
-    uint8_t *data;
-};
-size_t block_count = 0;
-
-static const char* type_descriptions[] = {
-    "uncompressed streams",
-    "compressed streams",
-    "", // redundant
-    "ROM/RAM dumps",
-    "RAM writes (<= 64 KB)",
-    "RAM writes (> 64 KB)",
-};
+// Blocks of the files loaded in the GUI. On web they stay in the loaded files and
+// are handed to the browser on download, nothing is written to MEMFS.
+#if defined(PLATFORM_WEB)
+static struct VGMBlockList blocks = { .in_memory = true };
+#else
+static struct VGMBlockList blocks = { 0 };
+#endif
 
-static const char* chip_type[256] = {
-    [0x00] = "YM2612 PCM data",
-    [0x01] = "RF5C68 PCM data",
-    [0x02] = "RF5C164 PCM data",
-    [0x03] = "PWM PCM data",
-    [0x04] = "OKIM6258 ADPCM data",
-    [0x05] = "HuC6280 PCM data",
-    [0x06] = "SCSP PCM data",
-    [0x07] = "NES APU DPCM",
-    [0x08] = "Mikey PCM data",
-    [0x09 ... 0x3F] = "uncompressed",
-    [0x40] = "YM2612 PCM data (compressed)",
-    [0x41] = "RF5C68 PCM data (compressed)",
-    [0x42] = "RF5C164 PCM data (compressed)",
-    [0x43] = "PWM PCM data (compressed)",
-    [0x44] = "OKIM6258 ADPCM data (compressed)",
-    [0x45] = "HuC6280 PCM data (compressed)",
-    [0x46] = "SCSP PCM data (compressed)",
-    [0x47] = "NES APU DPCM (compressed)",
-    [0x48] = "Mikey PCM data (compressed)",
-    [0x49 ... 0x7E] = "compressed",
-    [0x7F] = "decompression table",
-    [0x80] = "Sega PCM ROM data",
-    [0x81] = "YM2608 DELTA-T ROM data",
-    [0x82] = "YM2610 ADPCM ROM data",
-    [0x83] = "YM2610 DELTA-T ROM data",
-    [0x84] = "YMF278B ROM data",
-    [0x85] = "YMF271 ROM data",
-    [0x86] = "YMZ280B ROM data",
-    [0x87] = "YMF278B RAM data",
-    [0x88] = "Y8950 DELTA-T ROM data",
-    [0x89] = "MultiPCM ROM data",
-    [0x8A] = "uPD7759 ROM data",
-    [0x8B] = "OKIM6295 ROM data",
-    [0x8C] = "K054539 ROM data",
-    [0x8D] = "C140 ROM data",
-    [0x8E] = "K053260 ROM data",
-    [0x8F] = "Q-Sound ROM data",
-    [0x90] = "ES5505/ES5506 ROM data",
-    [0x91] = "X1-010 ROM data",
-    [0x92] = "C352 ROM data",
-    [0x93] = "GA20 ROM data",
-    [0xC0] = "RF5C68 RAM write",
-    [0xC1] = "RF5C164 RAM write",
-    [0xC2] = "NES APU RAM write",
-    [0xE0] = "SCSP RAM write",
-    [0xE1] = "ES5503 RAM write",
-};
+// Blocks of the files seen before, kept next to the block files. Not on web: MEMFS is gone with the page.
+#if !defined(PLATFORM_WEB)
+    #define SCAN_CACHE_FILE ".vgm-xtract-cache"
+#endif
+static struct vgm_cache* cache = NULL;
 
-static struct VGMDataBlock blocks[MAX_BLOCK_COUNT];
+// Counters of the last load, shown in the status bar
+static char load_status[256] = "";
 
-// Dropdown options
-static bool changed = false;
-static char block_options[1000] = "#113#no blocks found";
+// Waveform of the block selected last, built again when another one is selected
+static struct vgm_wave wave = { 0 };
+static size_t wave_block = SIZE_MAX;
 
-void download_block(int i)
+void set_scan_mode(enum scan_mode mode)
 {
-#if defined(PLATFORM_WEB)
-    char filename[50];
-    snprintf(filename, 50, "block_%i.raw", i);
-    // Download file from MEMFS (emscripten memory filesystem)
-    emscripten_run_script(TextFormat("saveFileFromMEMFSToDisk('%s','%s')", filename, GetFileName(filename)));
-#endif
+    blocks.recovery = mode == SCAN_RECOVERY;
+}
+
+void set_rom_merging(bool merge)
+{
+    blocks.merge_roms = merge;
 }
 
-char* get_data_blocks(void)
+// Types of the selected filter, copied by every load so it can change while files load
+static struct vgm_type_filter type_filter = { 0 };
+
+void set_block_filter(enum block_filter filter)
 {
-    if (changed)
+    static const uint8_t ranges[][2] = {
+        [BLOCKS_STREAMS] = { 0x00, 0x7f },
+        [BLOCKS_ROM] = { 0x80, 0xbf },
+        [BLOCKS_RAM] = { 0xc0, 0xff },
+    };
+
+    memset(&type_filter, 0, sizeof(type_filter));
+    if (filter == BLOCKS_ALL)
     {
-        char filename[50];
-        snprintf(block_options, 1000, "#113#no block");
-        for (int i = 0; i < block_count; ++i)
-        {
-            const char* desc;
-            const char* chip = chip_type[blocks[i].type] ? chip_type[blocks[i].type] : "???";
-            if (blocks[i].type <= 0x3f)
-                desc = type_descriptions[0];
-            else if (blocks[i].type <= 0x7e)
-                desc = type_descriptions[1];
-            else if (blocks[i].type == 0x7f)
-                desc = type_descriptions[2];
-            else if (blocks[i].type <= 0xbf)
-                desc = type_descriptions[3];
-            else if (blocks[i].type <= 0xdf)
-                desc = type_descriptions[4];
-            else {
-                desc = type_descriptions[5];
-            }
-            strcat(block_options, ";#06#");
-            snprintf(filename, 50, "block_%i.raw: %s (%s)", i, chip, desc);
-            strcat(block_options, filename);
-        }
-        changed = false;
+        blocks.filter = NULL;
+        return;
     }
+    vgm_type_filter_add(&type_filter, ranges[filter][0], ranges[filter][1]);
+    blocks.filter = &type_filter;
+}
 
-    return block_options;
+// Move the error of the last extraction to the GUI error queue
+static bool report_result(struct VGMBlockList* list, bool result)
+{
+    if (list->error[0])
+    {
+        append_error_message("%s", list->error);
+        clear_block_list_error(list);
+    }
+    if (list->warning_count)
+    {
+        append_error_message("%s%zu warning%s", list->warnings, list->warning_count, list->warning_count > 1 ? "s" : "");
+        clear_block_list_warnings(list);
+    }
+    return result;
 }
 
-bool save_block(int index, uint8_t* file_data, size_t size)
+void download_block(int i)
 {
-    char filename[100];
-    snprintf(filename, 100, "block_%i.raw", index);
+#if defined(PLATFORM_WEB)
+    size_t size;
+    const uint8_t* data = i >= 0 && (size_t)i < blocks.count ? get_block_data(&blocks, i, &size) : NULL;
+    if (!data) return;
 
-    FILE* file = fopen(filename, "wb");
-    if (!file) {
-        append_error_message("Error opening file \"%s\"\n", filename);
-        return false;
-    }
+    char filename[50];
+    snprintf(filename, 50, "block_%i.raw", i);
+    // The page builds the Blob from a view of the wasm heap
+    EM_ASM({ saveBlockToDisk(HEAPU8.subarray($0, $0 + $1), UTF8ToString($2)); }, data, size, filename);
+#else
+    (void)i;
+#endif
+}
 
-    if (fwrite(file_data, 1, size, file) != size) {
-        append_error_message("Error writing raw sample: out of space?\n");
-        fclose(file);
-        return false;
-    }
+size_t get_block_count(void)
+{
+    return blocks.count;
+}
 
-    fclose(file);
-    //printf("File saved to %s\n", filename);
+const char* get_block_label(size_t i)
+{
+    if (i >= blocks.count) return "";
 
-    return true;
+    uint8_t type = blocks.blocks[i].type;
+    return TextFormat("block_%zu.raw: %s (%s)", i, get_chip_name(type), get_type_description(type));
 }
 
-size_t extract_data_blocks(uint32_t data_offset, uint8_t* file_data, size_t data_size)
+bool is_writing_blocks(void)
 {
-    uint8_t* ptr = file_data;
-    const uint8_t* end = file_data + data_size;
-    size_t last_count = block_count;
+    if (is_block_list_writing(&blocks)) return true;
 
-    // Search for 0x67 command byte and extract data blocks
-    while (ptr < end)
-    {
-        // detect data block
-        if (*ptr == 0x67 && (*(ptr + 1) == 0x66) && (ptr + 7 < end))
-        {
-            //printf("%zu: data block found at: %lx\n", block_count, data_offset + ptr - file_data);
-            ptr += 2; // skip command bytes (67 66)
-            uint8_t type = *ptr++;  // data type
-            uint32_t size = *(uint32_t*)ptr; // size
-            // ignore most significant bit
-            size &= 0x7fffffff;
-            //printf("%zu: block size: %x, at: %x\n", block_count, size, data_offset + ptr - file_data + size - 8);
-            ptr += 4;
-
-            if (ptr + size <= end)
-            {
-                blocks[block_count].type = type;
-                blocks[block_count].size = size - 8;
-                if (blocks[block_count].size > 0)
-                {
-                    blocks[block_count].data = (uint8_t*)malloc(blocks[block_count].size);
-                    if (!blocks[block_count].data)
-                    {
-                        append_error_message("Memory allocation error");
-                        return block_count - last_count - 1;
-                    }
-                    memcpy(blocks[block_count].data, ptr, blocks[block_count].size);
-                    if (!save_block(block_count, blocks[block_count].data, blocks[block_count].size))
-                    {
-                        append_error_message("Error writing \"block_%i.raw\".\n", block_count);
-                        return block_count - last_count - 1;
-                    }
-
-                    block_count++;
-                }
-                if (block_count >= MAX_BLOCK_COUNT)
-                {
-                    append_error_message("Reserved memory exhausted.\n");
-                    return block_count - last_count - 1;
-                }
-            }
-            ptr += size - 8;
-        }
-        else
-        {
-            ptr++;
-        }
-    }
+    // done: report write errors, if any
+    report_result(&blocks, sync_block_list(&blocks));
+    return false;
+}
 
-    return block_count - last_count;
+void free_blocks()
+{
+    reset_block_list(&blocks);
+    vgm_wave_free(&wave);
+    wave_block = SIZE_MAX;
 }
 
-bool check_header(const uint8_t* header)
+bool load_gzfile(const char* filename, bool append)
 {
-    // Check for VGM magic number ('Vgm ')
-    if (header[0] != 'V' || header[1] != 'g' || header[2] != 'm' || header[3] != ' ') {
-        append_error_message("Invalid VGM file: VGM magic string not found\n");
-        return false;
-    }
-    return true;
+    if (!append) free_blocks();
+    return report_result(&blocks, extract_vgz_file(&blocks, filename));
 }
 
-uint32_t get_data_offset(const uint8_t* header)
+bool load_file(const char* filename, bool append)
 {
-    // Get the offset to the data section
-    uint32_t data_offset = *(uint32_t *)(header + VGM_DATA_OFFSET);
-    if (data_offset == 0) {
-        data_offset = 0x40; // Default to the end of the header
-    } else {
-        data_offset += 0x34;
-    }
-    return data_offset;
+    if (!append) free_blocks();
+    return report_result(&blocks, extract_vgm_file(&blocks, filename));
 }
 
-uint32_t get_eof_offset(const uint8_t* header)
+bool load_zipfile(const char* filename, bool append)
 {
-    // Get the total file size from the EOF offset field
-    uint32_t eof_offset = *(uint32_t *)(header + VGM_EOF_OFFSET);
-    if (eof_offset == 0) {
-        append_error_message("Invalid EOF offset in header\n");
-        return 0;
-    }
-    return eof_offset;
+    if (!append) free_blocks();
+    return report_result(&blocks, extract_zip_file(&blocks, filename));
 }
 
-bool load_gzfile(const char* filename, bool append)
+const struct vgm_wave* get_block_wave(int i)
 {
-    gzFile file = gzopen(filename, "rb");
-    if (!file) {
-        append_error_message("Failed to open .gz file");
-        return false;
-    }
+    if (i < 0 || (size_t)i >= blocks.count) return NULL;
+    if ((size_t)i == wave_block) return wave.sample_count > 0 ? &wave : NULL;
+
+    // block files are read once the writer is done with them
+    size_t size = 0;
+    const uint8_t* data = get_block_data(&blocks, i, &size);
+    unsigned char* file_data = NULL;
+    if (!data)
+    {
+        if (is_block_list_writing(&blocks)) return NULL;
 
-    uint8_t header[VGM_HEADER_SIZE];
-    if (gzread(file, header, VGM_HEADER_SIZE) != VGM_HEADER_SIZE) {
-        append_error_message("Error reading VGM header: file too short\n");
-        gzclose(file);
-        return false;
+        char filename[4096];
+        int file_size = 0;
+        get_block_file_name(&blocks, i, filename, sizeof(filename));
+        data = file_data = LoadFileData(filename, &file_size);
+        size = file_size > 0 ? (size_t)file_size : 0;
     }
 
-    if (!check_header(header)) return false;
-
-    uint32_t data_offset = get_data_offset(header);
-    //printf("data_offset = %x\n", data_offset);
+    vgm_wave_free(&wave);
+    wave_block = i;
+    if (data && !vgm_wave_build(&wave, blocks.blocks[i].type, data, size))
+        append_error_message("Memory allocation failed\n");
+    if (file_data) UnloadFileData(file_data);
+    return wave.sample_count > 0 ? &wave : NULL;
+}
 
-    uint32_t eof_offset = get_eof_offset(header);
-    if (!eof_offset) {
-        gzclose(file);
-        return false;
-    }
+// Files of one load_files() call, each scanned into its own block list. The scan runs
+// on a loader thread when threads are available, the GUI merges the lists when it is done.
+// The .vgm and .vgz entries of a .zip are scanned like files, straight from the archive.
+struct load_job {
+    char** paths;           // a file, or "<archive>/<entry name>"
+    unsigned int count;
+    struct VGMBlockList* lists;
+    struct vgm_zip** archives; // archive of every path, NULL for a file
+    size_t* entries;
+    struct vgm_zip* zips;   // one per .zip file, empty if it could not be read
+    unsigned int zip_count;
+#if defined(VGM_THREADS)
+    atomic_uint next;
+    atomic_uint_least64_t bytes_done;
+    atomic_bool done;
+    pthread_t thread;
+#else
+    unsigned int next;
+    uint64_t bytes_done;
+    bool done;
+#endif
+    uint64_t bytes_total;
+    double start;
+    struct vgm_type_filter filter;
+};
 
-    // Calculate the size of the data
-    size_t file_size = eof_offset + 4;
-    size_t data_size = file_size - data_offset;
-    printf("File data extracted (%zu bytes)\n", data_size);
+static struct load_job* loading = NULL;
 
-    // Allocate memory for all file commands
-    uint8_t *file_data = (uint8_t *)malloc(data_size);
-    if (!file_data) {
-        append_error_message("Memory allocation failed\n");
-        gzclose(file);
-        return false;
-    }
+static void add_progress(void* user, uint64_t bytes)
+{
+    struct load_job* job = (struct load_job*)user;
+#if defined(VGM_THREADS)
+    atomic_fetch_add(&job->bytes_done, bytes);
+#else
+    job->bytes_done += bytes;
+#endif
+}
 
-    if (gzseek(file, data_offset, SEEK_SET) == -1)
-    {
-        append_error_message("Error seeking commands\n");
-        free(file_data);
-        gzclose(file);
-        return false;
-    }
+static void* load_worker(void* arg)
+{
+    struct load_job* job = (struct load_job*)arg;
+    unsigned int i;
 
-    if (gzread(file, file_data, data_size) != data_size)
+#if defined(VGM_THREADS)
+    while ((i = atomic_fetch_add(&job->next, 1)) < job->count)
+#else
+    while ((i = job->next++) < job->count)
+#endif
     {
-        append_error_message("Error reading command data\n");
-        free(file_data);
-        gzclose(file);
-        return false;
+        if (job->archives[i])
+            extract_zip_entry(&job->lists[i], job->archives[i], job->entries[i], job->paths[i]);
+        else
+            extract_file(&job->lists[i], job->paths[i]);
     }
+    return NULL;
+}
 
-    gzclose(file);
-
-    size_t result = extract_data_blocks(data_offset, file_data, data_size);
-    free(file_data);
-
-    if (result > 0) changed = true;
-    return result > 0;
+static int get_worker_count(unsigned int file_count)
+{
+    int count = 1;
+#if defined(VGM_THREADS) && defined(PLATFORM_WEB)
+    count = emscripten_num_logical_cores();
+#elif defined(VGM_THREADS)
+    count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    if (count > (int)file_count) count = file_count;
+    return count > 0 ? count : 1;
 }
 
-bool load_file(const char* filename, bool append)
+// Scan files in parallel, every file into its own list
+static void* load_thread(void* arg)
 {
-    FILE* file = fopen(filename, "rb");
-    if (!file) {
-        append_error_message("Error opening file \"%s\"\n", filename);
-        return false;
+    struct load_job* job = (struct load_job*)arg;
+    int workers = get_worker_count(job->count);
+#if defined(VGM_THREADS)
+    pthread_t threads[workers];
+    int started = 0;
+    for (; started < workers - 1; ++started)
+    {
+        if (pthread_create(&threads[started], NULL, load_worker, job) != 0) break;
     }
-
-    uint8_t header[VGM_HEADER_SIZE];
-    if (fread(header, 1, VGM_HEADER_SIZE, file) != VGM_HEADER_SIZE) {
-        append_error_message("Error reading VGM header: file too short\n");
-        fclose(file);
-        return false;
+    load_worker(job);
+    for (int i = 0; i < started; ++i)
+    {
+        pthread_join(threads[i], NULL);
     }
+#else
+    (void)workers;
+    load_worker(job);
+#endif
+    job->done = true;
+    return NULL;
+}
 
-    if (!check_header(header)) return false;
-    uint32_t data_offset = get_data_offset(header);
-    //printf("data_offset = %x\n", data_offset);
-
-    uint32_t eof_offset = get_eof_offset(header);
-    if (!eof_offset) {
-        fclose(file);
-        return false;
+static void free_load_job(struct load_job* job)
+{
+    for (unsigned int i = 0; i < job->count; ++i)
+    {
+        free(job->paths[i]);
+        free_block_list(&job->lists[i]);
     }
-
-    // Calculate the size of the data
-    size_t file_size = eof_offset + 4;
-    size_t data_size = file_size - data_offset;
-    //printf("File data extracted (%zu bytes)\n", data_size);
-
-    // Allocate memory for all file commands
-    uint8_t *file_data = (uint8_t *)malloc(data_size);
-    if (!file_data) {
-        append_error_message("Memory allocation failed\n");
-        fclose(file);
-        return false;
+    for (unsigned int i = 0; i < job->zip_count; ++i)
+    {
+        vgm_zip_close(&job->zips[i]);
     }
+    free(job->paths);
+    free(job->lists);
+    free(job->archives);
+    free(job->entries);
+    free(job->zips);
+    free(job);
+}
 
-    if (fseek(file, data_offset, SEEK_SET) == -1)
+// Where the time of a load went. The phases add up over the lists, which are scanned in parallel
+// and all held until they are merged.
+static void set_load_status(const struct load_job* job)
+{
+    struct VGMStats total = { 0 };
+    size_t block_count = 0;
+    uint64_t bytes_in = 0;
+    uint64_t bytes_scanned = 0;
+    for (unsigned int i = 0; i < job->count; ++i)
     {
-        append_error_message("Error seeking commands\n");
-        free(file_data);
-        fclose(file);
-        return false;
+        const struct VGMBlockList* list = &job->lists[i];
+        for (int phase = 0; phase < VGM_PHASE_COUNT; ++phase)
+        {
+            total.seconds[phase] += list->stats.seconds[phase];
+        }
+        total.allocations += list->stats.allocations;
+        total.peak_heap += list->stats.peak_heap;
+        block_count += list->count;
+        bytes_in += list->bytes_in;
+        bytes_scanned += list->bytes_scanned;
     }
 
-    if (fread(file_data, 1, data_size, file) != data_size)
+    size_t length = snprintf(load_status, sizeof(load_status), "%u files, %zu blocks, %.1f MB in %.2f s |",
+        job->count, block_count, bytes_in / 1e6, get_time_monotonic() - job->start);
+    for (int phase = 0; phase < VGM_PHASE_COUNT && length < sizeof(load_status); ++phase)
     {
-        append_error_message("Error reading command data\n");
-        free(file_data);
-        fclose(file);
-        return false;
+        length += snprintf(load_status + length, sizeof(load_status) - length, " %s %.2f",
+            get_phase_name(phase), total.seconds[phase]);
     }
+    if (length < sizeof(load_status))
+        length += snprintf(load_status + length, sizeof(load_status) - length, " s | %zu allocations, peak %.1f MB",
+            total.allocations, total.peak_heap / 1e6);
+    // scan seconds are summed over the loading threads, so this is the rate of one thread
+    double scan_seconds = total.seconds[VGM_PHASE_SCAN];
+    if (length < sizeof(load_status) && bytes_scanned && scan_seconds > 0)
+        snprintf(load_status + length, sizeof(load_status) - length, " | %s %.0f MB/s",
+            blocks.recovery ? "recovery scan" : "scan", bytes_scanned / scan_seconds / 1e6);
+}
 
-    fclose(file);
-
-    size_t result = extract_data_blocks(data_offset, file_data, data_size);
-    free(file_data);
+// Merge in input order so block numbering does not depend on timing
+static bool finish_load(struct load_job* job)
+{
+    set_load_status(job);
+    bool result = true;
+    for (unsigned int i = 0; i < job->count; ++i)
+    {
+        result &= report_result(&job->lists[i], job->lists[i].count > 0);
+        if (!merge_block_list(&blocks, &job->lists[i]))
+            report_result(&blocks, false);
+    }
+    free_load_job(job);
+    if (cache) vgm_cache_save(cache);
+    return result;
+}
 
-    if (result > 0) changed = true;
-    return result > 0;
+const char* get_load_status(void)
+{
+    return load_status;
 }
 
-void free_blocks()
+bool is_loading(float* progress)
 {
-    for (int i = 0; i < block_count; ++i)
+    if (!loading) return false;
+
+    if (!loading->done)
     {
-        printf("1\n");
-        free(blocks[i].data);
-        printf("2\n");
+        *progress = loading->bytes_total ? (float)loading->bytes_done / loading->bytes_total : 0.0f;
+        if (*progress > 1.0f) *progress = 1.0f;
+        return true;
     }
-    block_count = 0;
+
+#if defined(VGM_THREADS)
+    pthread_join(loading->thread, NULL);
+#endif
+    struct load_job* job = loading;
+    loading = NULL;
+    finish_load(job);
+    return false;
 }
 
 bool load_files(FilePathList* files)
 {
+    if (loading)
+    {
+        append_error_message("Please wait until the current files are loaded.");
+        return false;
+    }
+
     free_blocks();
-    bool result = true;
+    if (files->count == 0) return true;
+#if defined(SCAN_CACHE_FILE)
+    if (!cache) cache = vgm_cache_open(SCAN_CACHE_FILE);
+#endif
 
-    for (int i = 0; i < files->count; ++i)
+    // paths are copied, the GUI releases the dropped files right away. Archives are read up front for the
+    // number of their entries.
+    struct load_job* job = (struct load_job*)calloc(1, sizeof(struct load_job));
+    unsigned int item_count = 0;
+    if (job && (job->zips = (struct vgm_zip*)calloc(files->count, sizeof(struct vgm_zip))))
+    {
+        for (unsigned int i = 0; i < files->count; ++i)
+        {
+            if (!IsFileExtension(files->paths[i], ".zip"))
+            {
+                item_count++;
+                continue;
+            }
+            struct vgm_zip* zip = &job->zips[job->zip_count++];
+            if (!vgm_zip_open(zip, files->paths[i]))
+            {
+                append_error_message("Cannot read the archive %s\n", files->paths[i]);
+                continue;
+            }
+            unsigned int entry_count = 0;
+            for (size_t j = 0; j < zip->count; ++j)
+            {
+                entry_count += IsFileExtension(zip->entries[j].name, ".vgm;.vgz");
+            }
+            if (entry_count == 0) append_error_message("No VGM files in the archive %s\n", files->paths[i]);
+            item_count += entry_count;
+        }
+        job->paths = (char**)calloc(item_count ? item_count : 1, sizeof(char*));
+        job->lists = (struct VGMBlockList*)calloc(item_count ? item_count : 1, sizeof(struct VGMBlockList));
+        job->archives = (struct vgm_zip**)calloc(item_count ? item_count : 1, sizeof(struct vgm_zip*));
+        job->entries = (size_t*)calloc(item_count ? item_count : 1, sizeof(size_t));
+    }
+    if (job && blocks.filter)
+        job->filter = *blocks.filter;
+    if (!job || !job->paths || !job->lists || !job->archives || !job->entries)
     {
-        result &= IsFileExtension(files->paths[i], ".vgz") ?
-            load_gzfile(files->paths[i], true) : load_file(files->paths[i], true);
+        if (job) free_load_job(job);
+        append_error_message("Memory allocation failed\n");
+        return false;
+    }
+    for (unsigned int i = 0, zip_index = 0; i < files->count; ++i)
+    {
+        struct vgm_zip* zip = IsFileExtension(files->paths[i], ".zip") ? &job->zips[zip_index++] : NULL;
+        for (size_t j = 0; j < (zip ? zip->count : 1); ++j)
+        {
+            if (zip && !IsFileExtension(zip->entries[j].name, ".vgm;.vgz")) continue;
+            unsigned int n = job->count;
+            job->paths[n] = zip ? (char*)malloc(strlen(files->paths[i]) + strlen(zip->entries[j].name) + 2) :
+                strdup(files->paths[i]);
+            if (!job->paths[n])
+            {
+                free_load_job(job);
+                append_error_message("Memory allocation failed\n");
+                return false;
+            }
+            if (zip) sprintf(job->paths[n], "%s/%s", files->paths[i], zip->entries[j].name);
+            job->archives[n] = zip;
+            job->entries[n] = j;
+            job->count++;
+            // progress counts the compressed bytes of an entry read from the archive
+            job->bytes_total += zip ? zip->entries[j].compressed_size : (uint64_t)GetFileLength(files->paths[i]);
+            job->lists[n].recovery = blocks.recovery;
+            job->lists[n].filter = blocks.filter ? &job->filter : NULL;
+            job->lists[n].merge_roms = blocks.merge_roms;
+            job->lists[n].in_memory = blocks.in_memory;
+            job->lists[n].cache = cache;
+            job->lists[n].progress = add_progress;
+            job->lists[n].progress_user = job;
+            share_block_writer(&job->lists[n], &blocks);
+            snprintf(job->lists[n].name_prefix, sizeof(job->lists[n].name_prefix), ".load%u_", n);
+        }
+    }
+    if (job->count == 0)
+    {
+        free_load_job(job);
+        return false;
     }
 
-    return result;
+    // block files are written in the background by the writer of the GUI list,
+    // in the order they were queued
+    job->start = get_time_monotonic();
+#if defined(VGM_THREADS)
+    if (pthread_create(&job->thread, NULL, load_thread, job) == 0)
+    {
+        loading = job;
+        return true;
+    }
+#endif
+    load_thread(job);
+    return finish_load(job);
 }
@@ -1,16 +1,59 @@
 #ifndef _VGMDATA_H_
 #define _VGMDATA_H_
 
+#include <stddef.h>
 #include "raylib.h"
 
+struct vgm_wave;
+
+enum scan_mode
+{
+    SCAN_COMMANDS = 0, // walk the command stream
+    SCAN_RECOVERY = 1, // search every "67 66" pair (damaged or unknown streams)
+};
+
+void set_scan_mode(enum scan_mode mode);
+
+// Block types extracted by the next load, the others are skipped unread
+enum block_filter
+{
+    BLOCKS_ALL = 0,
+    BLOCKS_STREAMS = 1,  // PCM streams and their decompression tables (0x00-0x7F)
+    BLOCKS_ROM = 2,      // ROM/RAM dumps (0x80-0xBF)
+    BLOCKS_RAM = 3,      // RAM writes (0xC0-0xFF)
+};
+
+void set_block_filter(enum block_filter filter);
+
+// Put the pieces of every ROM dump of the next load together, one block per chip and file
+void set_rom_merging(bool merge);
+
 void download_block(int i);
 
-bool load_gzfile(char* filename);
+// Waveform of block i, NULL while its file is being written or if it has no data
+const struct vgm_wave* get_block_wave(int i);
 
-bool load_file(char* filename);
+bool load_gzfile(const char* filename, bool append);
 
+bool load_file(const char* filename, bool append);
+
+// The .vgm and .vgz entries of a .zip, inflated in memory one after the other
+bool load_zipfile(const char* filename, bool append);
+
+// Starts scanning the files in the background when threads are available
 bool load_files(FilePathList* files);
 
-char* get_data_blocks(void);
+// Files still being scanned, progress goes from 0 to 1. Merges the blocks when done.
+bool is_loading(float* progress);
+
+// Counters of the last load: files, blocks, time per phase and memory. Empty before the first load.
+const char* get_load_status(void);
+
+// Block files still being written in the background, write errors are reported when done
+bool is_writing_blocks(void);
+
+size_t get_block_count(void);
+
+const char* get_block_label(size_t i);
 
 #endif // _VGMDATA_H_
@@ -0,0 +1,137 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "vgmrom.h"
+
+static inline uint32_t read_u32(const uint8_t* ptr)
+{
+    // little-endian and alignment-safe
+    return (uint32_t)ptr[0] | (uint32_t)ptr[1] << 8 | (uint32_t)ptr[2] << 16 | (uint32_t)ptr[3] << 24;
+}
+
+void vgm_rom_init(struct vgm_rom* rom, uint8_t type, uint8_t chip)
+{
+    memset(rom, 0, sizeof(*rom));
+    rom->type = type;
+    rom->chip = chip;
+}
+
+void vgm_rom_free(struct vgm_rom* rom)
+{
+    free(rom->data);
+    free(rom->ranges);
+    memset(rom, 0, sizeof(*rom));
+}
+
+uint32_t vgm_rom_begin_piece(struct vgm_rom* rom, const uint8_t* header, uint32_t header_size)
+{
+    rom->piece_count++;
+    if (header_size < 8) return 0;
+
+    uint32_t size = read_u32(header);
+    if (size > rom->size) rom->size = size;
+    return read_u32(header + 4);
+}
+
+// Room for the image up to end, new bytes are zeros
+static bool reserve_data(struct vgm_rom* rom, uint32_t end)
+{
+    if (end <= rom->capacity) return true;
+
+    // pieces usually come in address order: grow geometrically, but not past the declared size
+    size_t capacity = rom->capacity * 2;
+    if (capacity > rom->size) capacity = rom->size;
+    if (capacity < end) capacity = end;
+    uint8_t* tmp = (uint8_t*)realloc(rom->data, capacity);
+    if (!tmp) return false;
+    memset(tmp + rom->capacity, 0, capacity - rom->capacity);
+    rom->data = tmp;
+    rom->capacity = capacity;
+    return true;
+}
+
+// Mark [start, end) as written, merging the ranges it overlaps or touches
+static bool add_range(struct vgm_rom* rom, uint32_t start, uint32_t end)
+{
+    // first range that ends at or after start, the ones before are left alone
+    size_t low = 0, high = rom->range_count;
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        if (rom->ranges[middle].end < start)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    size_t last = low;
+    while (last < rom->range_count && rom->ranges[last].start <= end) last++;
+
+    if (last > low)
+    {
+        struct vgm_rom_range* range = &rom->ranges[low];
+        if (range->start < start) start = range->start;
+        if (rom->ranges[last - 1].end > end) end = rom->ranges[last - 1].end;
+        range->start = start;
+        range->end = end;
+        memmove(range + 1, rom->ranges + last, (rom->range_count - last) * sizeof(struct vgm_rom_range));
+        rom->range_count -= last - low - 1;
+        return true;
+    }
+
+    if (rom->range_count == rom->range_capacity)
+    {
+        size_t capacity = rom->range_capacity ? rom->range_capacity * 2 : 16;
+        struct vgm_rom_range* tmp = (struct vgm_rom_range*)realloc(rom->ranges, capacity * sizeof(struct vgm_rom_range));
+        if (!tmp) return false;
+        rom->ranges = tmp;
+        rom->range_capacity = capacity;
+    }
+    memmove(rom->ranges + low + 1, rom->ranges + low, (rom->range_count - low) * sizeof(struct vgm_rom_range));
+    rom->ranges[low].start = start;
+    rom->ranges[low].end = end;
+    rom->range_count++;
+    return true;
+}
+
+bool vgm_rom_write(struct vgm_rom* rom, uint32_t address, const uint8_t* data, size_t size)
+{
+    if (size > UINT32_MAX - address) size = UINT32_MAX - address;
+    if (size == 0) return true;
+
+    uint32_t end = address + (uint32_t)size;
+    if (end > rom->size) rom->size = end;
+    if (!reserve_data(rom, end) || !add_range(rom, address, end))
+        return false;
+    memcpy(rom->data + address, data, size);
+    return true;
+}
+
+size_t vgm_rom_get_missing(const struct vgm_rom* rom, struct vgm_rom_range* ranges, size_t max)
+{
+    size_t count = 0;
+    uint32_t address = 0;
+    for (size_t i = 0; i <= rom->range_count; ++i)
+    {
+        uint32_t start = i < rom->range_count ? rom->ranges[i].start : rom->size;
+        if (start > address)
+        {
+            if (count < max)
+            {
+                ranges[count].start = address;
+                ranges[count].end = start;
+            }
+            count++;
+        }
+        if (i < rom->range_count) address = rom->ranges[i].end;
+    }
+    return count;
+}
+
+uint32_t vgm_rom_get_missing_size(const struct vgm_rom* rom)
+{
+    uint32_t written = 0;
+    for (size_t i = 0; i < rom->range_count; ++i)
+        written += rom->ranges[i].end - rom->ranges[i].start;
+    return rom->size - written;
+}
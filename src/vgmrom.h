@@ -0,0 +1,51 @@
+#ifndef _VGMROM_H_
+#define _VGMROM_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// ROM images put together from the dump blocks (0x80-0xBF) of a file. Games upload a ROM in pieces,
+// often the same ranges several times: each block holds the size of the whole ROM and the start
+// address of its piece. Later pieces overwrite earlier ones.
+struct vgm_rom_range
+{
+    uint32_t start;
+    uint32_t end;                   // exclusive
+};
+
+struct vgm_rom
+{
+    uint8_t type;
+    uint8_t chip;                   // 1 for the second chip of a pair
+    uint32_t size;                  // largest ROM size declared, or written up to
+    uint8_t* data;                  // image up to capacity, zeros where no piece was written
+    size_t capacity;
+    struct vgm_rom_range* ranges;   // written ranges, sorted, neither overlapping nor touching
+    size_t range_count;
+    size_t range_capacity;
+    size_t piece_count;
+};
+
+static inline bool vgm_rom_is_dump(uint8_t type)
+{
+    return type >= 0x80 && type <= 0xbf;
+}
+
+void vgm_rom_init(struct vgm_rom* rom, uint8_t type, uint8_t chip);
+
+void vgm_rom_free(struct vgm_rom* rom);
+
+// Start a piece from its block header (ROM size, start address), returns the start address
+uint32_t vgm_rom_begin_piece(struct vgm_rom* rom, const uint8_t* header, uint32_t header_size);
+
+// Copy bytes of a piece to their address, false if memory ran out. Bytes past 4 GB are dropped.
+bool vgm_rom_write(struct vgm_rom* rom, uint32_t address, const uint8_t* data, size_t size);
+
+// Ranges of the ROM no piece wrote, up to max of them. Returns how many there are in all.
+size_t vgm_rom_get_missing(const struct vgm_rom* rom, struct vgm_rom_range* ranges, size_t max);
+
+// Bytes of the ROM no piece wrote
+uint32_t vgm_rom_get_missing_size(const struct vgm_rom* rom);
+
+#endif // _VGMROM_H_
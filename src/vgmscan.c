@@ -0,0 +1,522 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "vgmscan.h"
+
+#if defined(VGM_THREADS)
+    #include <pthread.h>
+#endif
+
+#if defined(__wasm_simd128__)
+    #include <wasm_simd128.h>
+    #define SCAN_SIMD128
+#elif defined(__SSE2__) || defined(_M_X64)
+    #include <immintrin.h>
+    #define SCAN_SSE2
+    #if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+        #define SCAN_AVX2
+    #endif
+#endif
+
+const uint8_t* find_data_block_scalar(const uint8_t* ptr, const uint8_t* end)
+{
+    while (ptr + 1 < end)
+    {
+        if (ptr[0] == 0x67 && ptr[1] == 0x66) return ptr;
+        ptr++;
+    }
+    return end;
+}
+
+// Each vector loop compares the bytes at ptr with 0x67 and the bytes at ptr + 1
+// with 0x66, so every lane that survives the AND is the start of a candidate.
+
+#if defined(SCAN_SIMD128)
+static const uint8_t* find_data_block_simd128(const uint8_t* ptr, const uint8_t* end)
+{
+    const v128_t cmd = wasm_i8x16_splat(0x67);
+    const v128_t compat = wasm_i8x16_splat(0x66);
+
+    while (end - ptr >= 17)
+    {
+        v128_t a = wasm_v128_load(ptr);
+        v128_t b = wasm_v128_load(ptr + 1);
+        uint32_t mask = wasm_i8x16_bitmask(wasm_v128_and(wasm_i8x16_eq(a, cmd), wasm_i8x16_eq(b, compat)));
+        if (mask) return ptr + __builtin_ctz(mask);
+        ptr += 16;
+    }
+    return find_data_block_scalar(ptr, end);
+}
+#endif
+
+#if defined(SCAN_SSE2)
+static const uint8_t* find_data_block_sse2(const uint8_t* ptr, const uint8_t* end)
+{
+    const __m128i cmd = _mm_set1_epi8(0x67);
+    const __m128i compat = _mm_set1_epi8(0x66);
+
+    while (end - ptr >= 17)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i*)ptr);
+        __m128i b = _mm_loadu_si128((const __m128i*)(ptr + 1));
+        uint32_t mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, cmd), _mm_cmpeq_epi8(b, compat)));
+        if (mask) return ptr + __builtin_ctz(mask);
+        ptr += 16;
+    }
+    return find_data_block_scalar(ptr, end);
+}
+#endif
+
+#if defined(SCAN_AVX2)
+__attribute__((target("avx2")))
+static const uint8_t* find_data_block_avx2(const uint8_t* ptr, const uint8_t* end)
+{
+    const __m256i cmd = _mm256_set1_epi8(0x67);
+    const __m256i compat = _mm256_set1_epi8(0x66);
+
+    while (end - ptr >= 33)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i*)ptr);
+        __m256i b = _mm256_loadu_si256((const __m256i*)(ptr + 1));
+        uint32_t mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, cmd), _mm256_cmpeq_epi8(b, compat)));
+        if (mask) return ptr + __builtin_ctz(mask);
+        ptr += 32;
+    }
+    return find_data_block_sse2(ptr, end);
+}
+#endif
+
+typedef const uint8_t* (*finder_t)(const uint8_t*, const uint8_t*);
+
+static finder_t select_finder(const char** isa)
+{
+#if defined(SCAN_SIMD128)
+    *isa = "SIMD128";
+    return find_data_block_simd128;
+#elif defined(SCAN_AVX2)
+    if (__builtin_cpu_supports("avx2"))
+    {
+        *isa = "AVX2";
+        return find_data_block_avx2;
+    }
+    *isa = "SSE2";
+    return find_data_block_sse2;
+#elif defined(SCAN_SSE2)
+    *isa = "SSE2";
+    return find_data_block_sse2;
+#else
+    *isa = "scalar";
+    return find_data_block_scalar;
+#endif
+}
+
+static finder_t finder = NULL;
+static const char* finder_isa = "scalar";
+
+static void set_finder(void)
+{
+    finder = select_finder(&finder_isa);
+}
+
+// Picked once for all threads: workers start scanning at the same time
+static void init_finder(void)
+{
+#if defined(VGM_THREADS)
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, set_finder);
+#else
+    if (!finder) set_finder();
+#endif
+}
+
+const uint8_t* find_data_block(const uint8_t* ptr, const uint8_t* end)
+{
+    init_finder();
+    return finder(ptr, end);
+}
+
+const char* find_data_block_isa(void)
+{
+    init_finder();
+    return finder_isa;
+}
+
+size_t count_data_block_candidates(const uint8_t* data, size_t size, bool vectorized)
+{
+    const uint8_t* end = data + size;
+    size_t count = 0;
+
+    for (const uint8_t* ptr = data; ; ptr++)
+    {
+        ptr = vectorized ? find_data_block(ptr, end) : find_data_block_scalar(ptr, end);
+        if (ptr == end) break;
+        count++;
+    }
+    return count;
+}
+
+double get_time_monotonic(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//
+// Command stream scanner
+//
+
+// Length of each VGM command in bytes (opcode included), 0 for unknown commands.
+// Data blocks (0x67) list only the fixed part: 67 66 tt ss ss ss ss
+static const uint8_t command_length[256] = {
+    [0x30 ... 0x3F] = 2, // reserved, one operand (0x31: AY8910 stereo mask)
+    [0x40 ... 0x4E] = 3, // reserved, two operands (0x40: Mikey write)
+    [0x4F] = 2,          // Game Gear PSG stereo
+    [0x50] = 2,          // PSG (SN76489/SN76496) write
+    [0x51 ... 0x5F] = 3, // YM2413, YM2612, YM2151, ... register writes
+    [0x61] = 3,          // wait n samples
+    [0x62] = 1,          // wait 735 samples
+    [0x63] = 1,          // wait 882 samples
+    [0x66] = 1,          // end of sound data
+    [0x67] = 7,          // data block
+    [0x68] = 12,         // PCM RAM write
+    [0x70 ... 0x7F] = 1, // wait n+1 samples
+    [0x80 ... 0x8F] = 1, // YM2612 port 0 address 2A write + wait n samples
+    [0x90] = 5,          // DAC stream: setup stream control
+    [0x91] = 5,          // DAC stream: set stream data
+    [0x92] = 6,          // DAC stream: set stream frequency
+    [0x93] = 11,         // DAC stream: start stream
+    [0x94] = 2,          // DAC stream: stop stream
+    [0x95] = 5,          // DAC stream: start stream (fast call)
+    [0xA0 ... 0xBF] = 3, // two operands
+    [0xC0 ... 0xDF] = 4, // three operands
+    [0xE0 ... 0xFF] = 5, // four operands (0xE0: PCM data bank seek)
+};
+
+static inline uint32_t read_u32(const uint8_t* ptr)
+{
+    // little-endian and alignment-safe
+    return (uint32_t)ptr[0] | (uint32_t)ptr[1] << 8 | (uint32_t)ptr[2] << 16 | (uint32_t)ptr[3] << 24;
+}
+
+uint32_t vgm_block_header_size(uint8_t type)
+{
+    if (type >= 0x80 && type <= 0xbf)
+        return 8; // ROM size + start address
+    else if (type >= 0xc0 && type <= 0xdf)
+        return 2; // 16-bit start address
+    else if (type >= 0xe0)
+        return 4; // 32-bit start address
+    return 0;
+}
+
+void vgm_type_filter_add(struct vgm_type_filter* filter, uint8_t first, uint8_t last)
+{
+    for (unsigned type = first; type <= last; ++type)
+    {
+        filter->bits[type >> 6] |= (uint64_t)1 << (type & 63);
+        if (type <= 0x3e)
+            vgm_type_filter_add(filter, type + 0x40, type + 0x40);
+        else if (type >= 0x40 && type <= 0x7e)
+            filter->bits[0x7f >> 6] |= (uint64_t)1 << (0x7f & 63);
+    }
+}
+
+bool vgm_type_filter_parse(struct vgm_type_filter* filter, const char* text)
+{
+    while (*text)
+    {
+        char* next;
+        unsigned long first = strtoul(text, &next, 16);
+        unsigned long last = first;
+        if (next == text || first > 0xff) return false;
+        if (*next == '-')
+        {
+            text = next + 1;
+            last = strtoul(text, &next, 16);
+            if (next == text || last > 0xff || last < first) return false;
+        }
+        vgm_type_filter_add(filter, (uint8_t)first, (uint8_t)last);
+        if (*next == ',') next++;
+        else if (*next) return false;
+        text = next;
+    }
+    return true;
+}
+
+void vgm_scanner_init(struct vgm_scanner* scanner, uint64_t stream_size, bool recovery,
+    const struct vgm_block_sink* sink, void* user)
+{
+    memset(scanner, 0, sizeof(*scanner));
+    scanner->state = recovery ? VGM_SCAN_RECOVERY : VGM_SCAN_COMMAND;
+    scanner->resume_state = scanner->state;
+    scanner->stream_size = stream_size;
+    scanner->sink = sink;
+    scanner->user = user;
+}
+
+static bool scan_error(struct vgm_scanner* scanner, const char* fmt, uint64_t offset)
+{
+    snprintf(scanner->error, sizeof(scanner->error), fmt, (unsigned long long)offset);
+    scanner->state = VGM_SCAN_ERROR;
+    return false;
+}
+
+// Make `need` contiguous bytes available at *view, keeping partial input in pending[]
+static bool gather(struct vgm_scanner* scanner, const uint8_t** ptr, const uint8_t* end, size_t need, const uint8_t** view)
+{
+    if (scanner->pending_size == 0 && (size_t)(end - *ptr) >= need)
+    {
+        *view = *ptr;
+        *ptr += need;
+        return true;
+    }
+
+    size_t copy = need - scanner->pending_size;
+    if (copy > (size_t)(end - *ptr)) copy = end - *ptr;
+    memcpy(scanner->pending + scanner->pending_size, *ptr, copy);
+    scanner->pending_size += copy;
+    *ptr += copy;
+    if (scanner->pending_size < need) return false;
+
+    *view = scanner->pending;
+    scanner->pending_size = 0;
+    return true;
+}
+
+// Check that a block of the given size starting at the command offset fits in the stream
+static bool block_fits(const struct vgm_scanner* scanner, uint64_t offset, uint32_t size)
+{
+    return !scanner->stream_size || (offset + 7 <= scanner->stream_size && size <= scanner->stream_size - (offset + 7));
+}
+
+// Start a block from its 7-byte command, offset is the stream offset of the command
+static bool start_block(struct vgm_scanner* scanner, const uint8_t* command, uint64_t offset)
+{
+    scanner->block.type = command[2];
+    // the most significant bit tells the chip
+    scanner->remaining = read_u32(command + 3) & 0x7fffffff;
+    scanner->block.chip = command[6] >> 7;
+    scanner->block.header_size = vgm_block_header_size(scanner->block.type);
+    if (scanner->block.header_size > scanner->remaining)
+        scanner->block.header_size = scanner->remaining;
+    scanner->block.size = scanner->remaining - scanner->block.header_size;
+    scanner->block.offset = offset + 7 + scanner->block.header_size;
+
+    if (!block_fits(scanner, offset, scanner->remaining))
+        return scan_error(scanner, "Truncated data block at 0x%llx\n", offset);
+    if (scanner->remaining == 0)
+        return true; // empty block
+
+    scanner->resume_state = scanner->state;
+    if (scanner->filter && !vgm_type_filter_has(scanner->filter, scanner->block.type))
+    {
+        // left out: nothing of it is read, mapped pages are not even touched
+        if (scanner->block.size > 0 && scanner->sink->skip && !scanner->sink->skip(scanner->user, &scanner->block))
+        {
+            scanner->state = VGM_SCAN_ERROR;
+            return false;
+        }
+        scanner->state = VGM_SCAN_SKIP;
+        return true;
+    }
+    scanner->state = VGM_SCAN_HEADER;
+    return true;
+}
+
+static bool valid_candidate(const struct vgm_scanner* scanner, const uint8_t* command, uint64_t offset)
+{
+    if (command[0] != 0x67 || command[1] != 0x66) return false;
+    // the size must fit in the stream
+    return block_fits(scanner, offset, read_u32(command + 3) & 0x7fffffff);
+}
+
+bool vgm_scanner_feed(struct vgm_scanner* scanner, const uint8_t* data, size_t size)
+{
+    const uint8_t* ptr = data;
+    const uint8_t* end = data + size;
+    const uint8_t* view;
+
+    while (ptr < end)
+    {
+        // stream offset of ptr, and of the first byte kept in pending[]
+        uint64_t offset = scanner->position + (ptr - data) - scanner->pending_size;
+
+        switch (scanner->state)
+        {
+        case VGM_SCAN_COMMAND:
+        {
+            uint8_t command = scanner->pending_size ? scanner->pending[0] : *ptr;
+            uint8_t length = command_length[command];
+
+            if (length == 0)
+            {
+                // the rest of the stream cannot be parsed, fall back to brute-force search
+                scanner->recovered = true;
+                scanner->unknown_command = command;
+                scanner->unknown_offset = offset;
+                scanner->state = VGM_SCAN_RECOVERY;
+                break;
+            }
+            if (!gather(scanner, &ptr, end, length, &view))
+                break;
+
+            if (command == 0x66)
+            {
+                scanner->state = VGM_SCAN_END;
+            }
+            else if (command == 0x67)
+            {
+                // data block: 67 66 tt ss ss ss ss (data)
+                if (view[1] != 0x66)
+                    return scan_error(scanner, "Invalid data block at 0x%llx\n", offset);
+                if (!start_block(scanner, view, offset))
+                    return false;
+            }
+            break;
+        }
+
+        case VGM_SCAN_HEADER:
+            if (!gather(scanner, &ptr, end, scanner->block.header_size, &view))
+                break;
+            memcpy(scanner->block.header, view, scanner->block.header_size);
+            scanner->remaining = scanner->block.size;
+            if (scanner->block.size == 0)
+            {
+                // nothing to extract
+                scanner->state = scanner->resume_state;
+                break;
+            }
+            if (!scanner->sink->begin(scanner->user, &scanner->block))
+            {
+                scanner->state = VGM_SCAN_ERROR;
+                return false;
+            }
+            scanner->state = VGM_SCAN_DATA;
+            break;
+
+        case VGM_SCAN_DATA:
+        {
+            size_t length = scanner->remaining;
+            if (length > (size_t)(end - ptr)) length = end - ptr;
+            if (!scanner->sink->data(scanner->user, ptr, length))
+            {
+                scanner->state = VGM_SCAN_ERROR;
+                return false;
+            }
+            ptr += length;
+            scanner->remaining -= length;
+            if (scanner->remaining == 0)
+            {
+                if (!scanner->sink->end(scanner->user))
+                {
+                    scanner->state = VGM_SCAN_ERROR;
+                    return false;
+                }
+                scanner->state = scanner->resume_state;
+            }
+            break;
+        }
+
+        case VGM_SCAN_SKIP:
+        {
+            size_t length = scanner->remaining;
+            if (length > (size_t)(end - ptr)) length = end - ptr;
+            ptr += length;
+            scanner->remaining -= length;
+            if (scanner->remaining == 0)
+                scanner->state = scanner->resume_state;
+            break;
+        }
+
+        case VGM_SCAN_RECOVERY:
+            if (scanner->pending_size)
+            {
+                // a candidate started in the previous chunk
+                if (!gather(scanner, &ptr, end, 7, &view))
+                    break;
+                if (valid_candidate(scanner, view, offset))
+                {
+                    if (!start_block(scanner, view, offset))
+                        return false;
+                    break;
+                }
+                // keep searching from the next 0x67 inside the candidate
+                for (size_t i = 1; i < 7; ++i)
+                {
+                    if (view[i] == 0x67)
+                    {
+                        memmove(scanner->pending, view + i, 7 - i);
+                        scanner->pending_size = 7 - i;
+                        break;
+                    }
+                }
+                break;
+            }
+            else
+            {
+                const uint8_t* candidate = find_data_block(ptr, end);
+                if (candidate == end)
+                {
+                    // a trailing 0x67 may pair with the next chunk
+                    if (end[-1] == 0x67)
+                    {
+                        scanner->pending[0] = 0x67;
+                        scanner->pending_size = 1;
+                    }
+                    ptr = end;
+                    break;
+                }
+                offset += candidate - ptr;
+                ptr = candidate;
+                if (end - ptr < 7)
+                {
+                    gather(scanner, &ptr, end, 7, &view);
+                    break;
+                }
+                if (!valid_candidate(scanner, ptr, offset))
+                {
+                    // size runs past the stream: not a data block
+                    ptr++;
+                    break;
+                }
+                if (!start_block(scanner, ptr, offset))
+                    return false;
+                ptr += 7;
+            }
+            break;
+
+        case VGM_SCAN_END:
+        case VGM_SCAN_ERROR:
+            scanner->position += ptr - data;
+            return false;
+        }
+    }
+
+    scanner->position += size;
+    return scanner->state != VGM_SCAN_END && scanner->state != VGM_SCAN_ERROR;
+}
+
+bool vgm_scanner_finish(struct vgm_scanner* scanner)
+{
+    switch (scanner->state)
+    {
+    case VGM_SCAN_ERROR:
+        return false;
+    case VGM_SCAN_HEADER:
+    case VGM_SCAN_DATA:
+    case VGM_SCAN_SKIP:
+        return scan_error(scanner, "Truncated data block before 0x%llx\n", scanner->position);
+    case VGM_SCAN_COMMAND:
+        if (scanner->pending_size)
+            return scan_error(scanner, "Truncated command at 0x%llx\n", scanner->position - scanner->pending_size);
+        return true;
+    default:
+        return true;
+    }
+}
@@ -0,0 +1,113 @@
+#ifndef _VGMSCAN_H_
+#define _VGMSCAN_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+//
+// "67 66" candidate search
+//
+
+// Return the first "67 66" pair in [ptr, end) or end if none was found
+const uint8_t* find_data_block(const uint8_t* ptr, const uint8_t* end);
+
+// Reference byte-by-byte implementation of find_data_block()
+const uint8_t* find_data_block_scalar(const uint8_t* ptr, const uint8_t* end);
+
+// Count "67 66" pairs using the vectorized or the scalar finder
+size_t count_data_block_candidates(const uint8_t* data, size_t size, bool vectorized);
+
+// Name of the instruction set used by find_data_block()
+const char* find_data_block_isa(void);
+
+// Monotonic clock in seconds
+double get_time_monotonic(void);
+
+//
+// Resumable command stream scanner
+//
+
+#define VGM_BLOCK_HEADER_MAX 8
+
+// Block types to extract, one bit per type
+struct vgm_type_filter
+{
+    uint64_t bits[4];
+};
+
+static inline bool vgm_type_filter_has(const struct vgm_type_filter* filter, uint8_t type)
+{
+    return filter->bits[type >> 6] >> (type & 63) & 1;
+}
+
+// Add types first to last. Blocks are saved decompressed, so a stream type (0x00-0x3E) also takes its
+// compressed form (0x40-0x7E), and compressed streams bring the decompression table (0x7F) along.
+void vgm_type_filter_add(struct vgm_type_filter* filter, uint8_t first, uint8_t last);
+
+// Add hexadecimal types and ranges like "80-93,c0", false if the text is malformed
+bool vgm_type_filter_parse(struct vgm_type_filter* filter, const char* text);
+
+enum vgm_scan_state
+{
+    VGM_SCAN_COMMAND,  // at a command boundary
+    VGM_SCAN_HEADER,   // reading the header that precedes the block data
+    VGM_SCAN_DATA,     // passing block data to the sink
+    VGM_SCAN_SKIP,     // jumping over a block left out by the filter
+    VGM_SCAN_RECOVERY, // searching for "67 66" pairs
+    VGM_SCAN_END,      // end of sound data (0x66) reached
+    VGM_SCAN_ERROR,    // malformed stream or sink failure
+};
+
+struct vgm_block_info
+{
+    uint8_t type;
+    uint8_t chip;                          // 1 for the second chip of a pair (bit 31 of the block size)
+    uint32_t size;                         // data size, header excluded
+    uint64_t offset;                       // stream offset of the data
+    uint8_t header[VGM_BLOCK_HEADER_MAX];  // ROM size/start address or RAM start address
+    uint32_t header_size;
+};
+
+// Receives the data blocks found by the scanner. Returning false stops the scan.
+struct vgm_block_sink
+{
+    bool (*begin)(void* user, const struct vgm_block_info* block);
+    bool (*data)(void* user, const uint8_t* data, size_t size);
+    bool (*end)(void* user);
+    // optional: called instead of begin() for blocks left out by the filter, their header is not read
+    bool (*skip)(void* user, const struct vgm_block_info* block);
+};
+
+struct vgm_scanner
+{
+    enum vgm_scan_state state;
+    enum vgm_scan_state resume_state;      // state to return to after a block
+    uint64_t position;                     // stream offset of the next byte fed
+    uint64_t stream_size;                  // validates block sizes, 0 if unknown
+    uint8_t pending[16];                   // command or header split across chunks
+    size_t pending_size;
+    struct vgm_block_info block;
+    uint32_t remaining;                    // bytes left in the current block
+    const struct vgm_block_sink* sink;
+    void* user;
+    const struct vgm_type_filter* filter;  // blocks of other types are jumped over unread, NULL for all
+    bool recovered;                        // switched to a recovery scan at an unknown command
+    uint8_t unknown_command;
+    uint64_t unknown_offset;               // stream offset of unknown_command
+    char error[128];
+};
+
+// Size of the header that precedes the actual data inside a block payload
+uint32_t vgm_block_header_size(uint8_t type);
+
+void vgm_scanner_init(struct vgm_scanner* scanner, uint64_t stream_size, bool recovery,
+    const struct vgm_block_sink* sink, void* user);
+
+// Scan the next chunk of the stream, return false when no more data is wanted
+bool vgm_scanner_feed(struct vgm_scanner* scanner, const uint8_t* data, size_t size);
+
+// Flag data left in the middle of a command or block, return false on error
+bool vgm_scanner_finish(struct vgm_scanner* scanner);
+
+#endif // _VGMSCAN_H_
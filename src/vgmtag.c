@@ -0,0 +1,207 @@
+#include <string.h>
+#include <strings.h>
+
+#include "vgmtag.h"
+
+#define VGM_EOF_OFFSET         0x04
+#define VGM_VERSION_OFFSET     0x08
+#define VGM_GD3_OFFSET         0x14
+#define VGM_TOTAL_SAMPLES      0x18
+#define VGM_LOOP_OFFSET        0x1c
+#define VGM_LOOP_SAMPLES       0x20
+#define VGM_RATE               0x24
+#define GD3_HEADER_SIZE        12
+
+static const struct
+{
+    uint16_t offset;
+    const char* name;
+} chips[VGM_CHIP_COUNT] = {
+    [VGM_CHIP_SN76489] = { 0x0c, "SN76489" },
+    [VGM_CHIP_YM2413] = { 0x10, "YM2413" },
+    [VGM_CHIP_YM2612] = { 0x2c, "YM2612" },
+    [VGM_CHIP_YM2151] = { 0x30, "YM2151" },
+    [VGM_CHIP_SEGAPCM] = { 0x38, "SegaPCM" },
+    [VGM_CHIP_RF5C68] = { 0x40, "RF5C68" },
+    [VGM_CHIP_YM2203] = { 0x44, "YM2203" },
+    [VGM_CHIP_YM2608] = { 0x48, "YM2608" },
+    [VGM_CHIP_YM2610] = { 0x4c, "YM2610" },
+    [VGM_CHIP_YM3812] = { 0x50, "YM3812" },
+    [VGM_CHIP_YM3526] = { 0x54, "YM3526" },
+    [VGM_CHIP_Y8950] = { 0x58, "Y8950" },
+    [VGM_CHIP_YMF262] = { 0x5c, "YMF262" },
+    [VGM_CHIP_YMF278B] = { 0x60, "YMF278B" },
+    [VGM_CHIP_YMF271] = { 0x64, "YMF271" },
+    [VGM_CHIP_YMZ280B] = { 0x68, "YMZ280B" },
+    [VGM_CHIP_RF5C164] = { 0x6c, "RF5C164" },
+    [VGM_CHIP_PWM] = { 0x70, "PWM" },
+    [VGM_CHIP_AY8910] = { 0x74, "AY8910" },
+    [VGM_CHIP_GAMEBOY] = { 0x80, "GameBoy" },
+    [VGM_CHIP_NES_APU] = { 0x84, "NES_APU" },
+    [VGM_CHIP_MULTIPCM] = { 0x88, "MultiPCM" },
+    [VGM_CHIP_UPD7759] = { 0x8c, "uPD7759" },
+    [VGM_CHIP_OKIM6258] = { 0x90, "OKIM6258" },
+    [VGM_CHIP_OKIM6295] = { 0x98, "OKIM6295" },
+    [VGM_CHIP_K051649] = { 0x9c, "K051649" },
+    [VGM_CHIP_K054539] = { 0xa0, "K054539" },
+    [VGM_CHIP_HUC6280] = { 0xa4, "HuC6280" },
+    [VGM_CHIP_C140] = { 0xa8, "C140" },
+    [VGM_CHIP_K053260] = { 0xac, "K053260" },
+    [VGM_CHIP_POKEY] = { 0xb0, "Pokey" },
+    [VGM_CHIP_QSOUND] = { 0xb4, "QSound" },
+    [VGM_CHIP_SCSP] = { 0xb8, "SCSP" },
+    [VGM_CHIP_WONDERSWAN] = { 0xc0, "WonderSwan" },
+    [VGM_CHIP_VSU] = { 0xc4, "VSU" },
+    [VGM_CHIP_SAA1099] = { 0xc8, "SAA1099" },
+    [VGM_CHIP_ES5503] = { 0xcc, "ES5503" },
+    [VGM_CHIP_ES5506] = { 0xd0, "ES5506" },
+    [VGM_CHIP_X1_010] = { 0xd8, "X1-010" },
+    [VGM_CHIP_C352] = { 0xdc, "C352" },
+    [VGM_CHIP_GA20] = { 0xe0, "GA20" },
+    [VGM_CHIP_MIKEY] = { 0xe4, "Mikey" },
+};
+
+const char* vgm_get_chip_name(enum vgm_chip chip)
+{
+    return chip < VGM_CHIP_COUNT ? chips[chip].name : "???";
+}
+
+bool vgm_find_chip(const char* name, enum vgm_chip* chip)
+{
+    for (int i = 0; i < VGM_CHIP_COUNT; ++i)
+    {
+        if (strcasecmp(chips[i].name, name) == 0)
+        {
+            *chip = (enum vgm_chip)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint32_t read_le32(const uint8_t* data)
+{
+    return data[0] | data[1] << 8 | data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+// A field past the end of the header is command data, not a value
+static uint32_t read_field(const uint8_t* header, size_t size, size_t offset)
+{
+    return offset + 4 <= size ? read_le32(header + offset) : 0;
+}
+
+// Offsets in the header are relative to their own field
+static uint32_t read_offset_field(const uint8_t* header, size_t size, size_t offset)
+{
+    uint32_t value = read_field(header, size, offset);
+    return value ? (uint32_t)(value + offset) : 0;
+}
+
+void vgm_tag_clear(struct vgm_tag* tag)
+{
+    memset(tag, 0, offsetof(struct vgm_tag, text));
+    tag->text[0] = '\0';
+    tag->text_size = 1; // every empty field points at text[0]
+}
+
+void vgm_tag_read_header(struct vgm_tag* tag, const uint8_t* header, size_t size)
+{
+    vgm_tag_clear(tag);
+    if (size > VGM_TAG_HEADER_MAX) size = VGM_TAG_HEADER_MAX;
+
+    tag->version = read_field(header, size, VGM_VERSION_OFFSET);
+    tag->total_samples = read_field(header, size, VGM_TOTAL_SAMPLES);
+    tag->loop_offset = read_offset_field(header, size, VGM_LOOP_OFFSET);
+    tag->loop_samples = read_field(header, size, VGM_LOOP_SAMPLES);
+    tag->rate = read_field(header, size, VGM_RATE);
+    tag->gd3_offset = read_offset_field(header, size, VGM_GD3_OFFSET);
+    for (int i = 0; i < VGM_CHIP_COUNT; ++i)
+    {
+        tag->clocks[i] = read_field(header, size, chips[i].offset);
+    }
+}
+
+size_t vgm_tag_get_gd3_size(const uint8_t* data, size_t size)
+{
+    if (size < GD3_HEADER_SIZE || memcmp(data, "Gd3 ", 4) != 0) return 0;
+    uint32_t length = read_le32(data + 8);
+    return length > VGM_TAG_GD3_MAX - GD3_HEADER_SIZE ? VGM_TAG_GD3_MAX : GD3_HEADER_SIZE + length;
+}
+
+// Append one character as UTF-8, false when the text is full
+static bool append_utf8(struct vgm_tag* tag, uint32_t c)
+{
+    char bytes[4];
+    size_t length;
+    if (c < 0x80)
+    {
+        bytes[0] = (char)c;
+        length = 1;
+    }
+    else if (c < 0x800)
+    {
+        bytes[0] = (char)(0xc0 | c >> 6);
+        bytes[1] = (char)(0x80 | (c & 0x3f));
+        length = 2;
+    }
+    else if (c < 0x10000)
+    {
+        bytes[0] = (char)(0xe0 | c >> 12);
+        bytes[1] = (char)(0x80 | (c >> 6 & 0x3f));
+        bytes[2] = (char)(0x80 | (c & 0x3f));
+        length = 3;
+    }
+    else
+    {
+        bytes[0] = (char)(0xf0 | c >> 18);
+        bytes[1] = (char)(0x80 | (c >> 12 & 0x3f));
+        bytes[2] = (char)(0x80 | (c >> 6 & 0x3f));
+        bytes[3] = (char)(0x80 | (c & 0x3f));
+        length = 4;
+    }
+
+    // room is left for the terminator
+    if (tag->text_size + length >= VGM_TAG_TEXT_MAX) return false;
+    memcpy(tag->text + tag->text_size, bytes, length);
+    tag->text_size += (uint16_t)length;
+    return true;
+}
+
+bool vgm_tag_read_gd3(struct vgm_tag* tag, const uint8_t* data, size_t size)
+{
+    size_t end = vgm_tag_get_gd3_size(data, size);
+    if (end == 0) return false;
+    if (end > size) end = size;
+
+    // fields cut by the end of the tag or of the text are kept as far as they go
+    size_t offset = GD3_HEADER_SIZE;
+    bool full = false;
+    for (int i = 0; i < VGM_GD3_FIELD_COUNT && offset + 2 <= end; ++i)
+    {
+        tag->fields[i] = tag->text_size;
+        while (offset + 2 <= end)
+        {
+            uint32_t c = data[offset] | data[offset + 1] << 8;
+            offset += 2;
+            if (c == 0) break;
+            if (c >= 0xd800 && c < 0xdc00 && offset + 2 <= end)
+            {
+                uint32_t low = data[offset] | data[offset + 1] << 8;
+                if (low >= 0xdc00 && low < 0xe000)
+                {
+                    c = 0x10000 + ((c - 0xd800) << 10) + (low - 0xdc00);
+                    offset += 2;
+                }
+            }
+            if (c >= 0xd800 && c < 0xe000) c = 0xfffd; // unpaired surrogate
+            if (!full && !append_utf8(tag, c)) full = true;
+        }
+        // an empty field points at text[0] instead of taking a byte
+        if (tag->fields[i] == tag->text_size)
+            tag->fields[i] = 0;
+        else
+            tag->text[tag->text_size++] = '\0';
+    }
+    tag->has_gd3 = true;
+    return true;
+}
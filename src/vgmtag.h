@@ -0,0 +1,73 @@
+#ifndef _VGMTAG_H_
+#define _VGMTAG_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Header fields and GD3 tag of a VGM file
+#define VGM_TAG_HEADER_MAX 0x100        // header of VGM 1.72, later fields are ignored
+#define VGM_TAG_GD3_MAX    (64 * 1024)  // bytes of a GD3 tag read at most, the rest of the text is cut
+#define VGM_TAG_TEXT_MAX   (16 * 1024)  // UTF-8 text of the GD3 fields
+
+// Chips with a clock in the header, in the order of their clock fields
+enum vgm_chip
+{
+    VGM_CHIP_SN76489, VGM_CHIP_YM2413, VGM_CHIP_YM2612, VGM_CHIP_YM2151, VGM_CHIP_SEGAPCM, VGM_CHIP_RF5C68,
+    VGM_CHIP_YM2203, VGM_CHIP_YM2608, VGM_CHIP_YM2610, VGM_CHIP_YM3812, VGM_CHIP_YM3526, VGM_CHIP_Y8950,
+    VGM_CHIP_YMF262, VGM_CHIP_YMF278B, VGM_CHIP_YMF271, VGM_CHIP_YMZ280B, VGM_CHIP_RF5C164, VGM_CHIP_PWM,
+    VGM_CHIP_AY8910, VGM_CHIP_GAMEBOY, VGM_CHIP_NES_APU, VGM_CHIP_MULTIPCM, VGM_CHIP_UPD7759, VGM_CHIP_OKIM6258,
+    VGM_CHIP_OKIM6295, VGM_CHIP_K051649, VGM_CHIP_K054539, VGM_CHIP_HUC6280, VGM_CHIP_C140, VGM_CHIP_K053260,
+    VGM_CHIP_POKEY, VGM_CHIP_QSOUND, VGM_CHIP_SCSP, VGM_CHIP_WONDERSWAN, VGM_CHIP_VSU, VGM_CHIP_SAA1099,
+    VGM_CHIP_ES5503, VGM_CHIP_ES5506, VGM_CHIP_X1_010, VGM_CHIP_C352, VGM_CHIP_GA20, VGM_CHIP_MIKEY,
+    VGM_CHIP_COUNT
+};
+
+#define VGM_CLOCK_DUAL 0x40000000   // two chips of this kind
+#define VGM_CLOCK_MASK 0x3fffffff   // clock in Hz, bit 31 selects a variant of some chips
+
+enum vgm_gd3_field
+{
+    VGM_GD3_TRACK, VGM_GD3_TRACK_JP, VGM_GD3_GAME, VGM_GD3_GAME_JP, VGM_GD3_SYSTEM, VGM_GD3_SYSTEM_JP,
+    VGM_GD3_AUTHOR, VGM_GD3_AUTHOR_JP, VGM_GD3_DATE, VGM_GD3_RIPPER, VGM_GD3_NOTES,
+    VGM_GD3_FIELD_COUNT
+};
+
+struct vgm_tag
+{
+    uint32_t version;           // BCD, 0x171 for 1.71
+    uint32_t total_samples;     // at 44100 Hz
+    uint32_t loop_offset;       // file offset of the loop point, 0 if the track does not loop
+    uint32_t loop_samples;
+    uint32_t rate;              // playback rate the track was recorded at, 0 if unknown
+    uint32_t gd3_offset;        // file offset of the GD3 tag, 0 if it has none
+    uint32_t clocks[VGM_CHIP_COUNT]; // header clock fields, 0 for unused chips
+    bool has_gd3;               // the GD3 tag was found and read
+    uint16_t fields[VGM_GD3_FIELD_COUNT]; // offsets of the NUL-terminated fields in text
+    uint16_t text_size;
+    char text[VGM_TAG_TEXT_MAX];
+};
+
+const char* vgm_get_chip_name(enum vgm_chip chip);
+
+// Chip of a header clock field by name, case-insensitive. False if there is none.
+bool vgm_find_chip(const char* name, enum vgm_chip* chip);
+
+// Forget the last file: no header fields, empty GD3 fields
+void vgm_tag_clear(struct vgm_tag* tag);
+
+// Read the header fields from the first size bytes of a file, where size stops at the data offset
+void vgm_tag_read_header(struct vgm_tag* tag, const uint8_t* header, size_t size);
+
+// Bytes to read at gd3_offset for the whole tag, from its first 12 bytes. 0 if they are no GD3 header.
+size_t vgm_tag_get_gd3_size(const uint8_t* data, size_t size);
+
+// Convert the UTF-16 fields of a GD3 tag read at gd3_offset to UTF-8, false if it is damaged
+bool vgm_tag_read_gd3(struct vgm_tag* tag, const uint8_t* data, size_t size);
+
+static inline const char* vgm_tag_get_field(const struct vgm_tag* tag, enum vgm_gd3_field field)
+{
+    return tag->text + tag->fields[field];
+}
+
+#endif // _VGMTAG_H_
@@ -0,0 +1,209 @@
+#include <stdlib.h>
+
+#include "vgmwatch.h"
+
+#if defined(__linux__)
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#if defined(VGM_THREADS)
+    #include <pthread.h>
+#endif
+
+// Entries of a directory created, written to, deleted or renamed. Writes are watched too, so a long copy
+// keeps a burst going until its last write.
+#define WATCH_MASK (IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+    IN_ONLYDIR | IN_EXCL_UNLINK)
+
+struct vgm_watch
+{
+    int fd;
+    char** paths;           // directory of every watch descriptor, NULL once it is gone
+    size_t capacity;
+#if defined(VGM_THREADS)
+    pthread_mutex_t lock;
+#endif
+};
+
+static void lock(struct vgm_watch* watch)
+{
+#if defined(VGM_THREADS)
+    pthread_mutex_lock(&watch->lock);
+#else
+    (void)watch;
+#endif
+}
+
+static void unlock(struct vgm_watch* watch)
+{
+#if defined(VGM_THREADS)
+    pthread_mutex_unlock(&watch->lock);
+#else
+    (void)watch;
+#endif
+}
+
+struct vgm_watch* vgm_watch_create(void)
+{
+    struct vgm_watch* watch = (struct vgm_watch*)calloc(1, sizeof(struct vgm_watch));
+    if (!watch) return NULL;
+    if ((watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1)
+    {
+        free(watch);
+        return NULL;
+    }
+#if defined(VGM_THREADS)
+    pthread_mutex_init(&watch->lock, NULL);
+#endif
+    return watch;
+}
+
+bool vgm_watch_add(struct vgm_watch* watch, const char* path)
+{
+    int wd = inotify_add_watch(watch->fd, path, WATCH_MASK);
+    if (wd == -1) return errno != ENOSPC && errno != ENOMEM;
+
+    // a directory watched again, or moved inside the tree, keeps its descriptor and gets its new path
+    char* copy = strdup(path);
+    if (!copy) return false;
+    lock(watch);
+    bool result = true;
+    if ((size_t)wd >= watch->capacity)
+    {
+        size_t capacity = watch->capacity ? watch->capacity : 64;
+        while (capacity <= (size_t)wd) capacity *= 2;
+        char** tmp = (char**)realloc(watch->paths, capacity * sizeof(char*));
+        if (tmp)
+        {
+            memset(tmp + watch->capacity, 0, (capacity - watch->capacity) * sizeof(char*));
+            watch->paths = tmp;
+            watch->capacity = capacity;
+        }
+        result = tmp != NULL;
+    }
+    if (result)
+    {
+        free(watch->paths[wd]);
+        watch->paths[wd] = copy;
+    }
+    unlock(watch);
+    if (!result)
+    {
+        free(copy);
+        inotify_rm_watch(watch->fd, wd);
+    }
+    return result;
+}
+
+// Pass one event on, events of directories not watched anymore are dropped
+static void report_event(struct vgm_watch* watch, const struct inotify_event* event, vgm_watch_callback callback,
+    void* user)
+{
+    if (event->mask & IN_Q_OVERFLOW)
+    {
+        callback(user, VGM_WATCH_LOST, NULL);
+        return;
+    }
+
+    char path[4096];
+    lock(watch);
+    bool known = event->wd >= 0 && (size_t)event->wd < watch->capacity && watch->paths[event->wd];
+    if (known && (event->mask & IN_IGNORED))
+    {
+        free(watch->paths[event->wd]);
+        watch->paths[event->wd] = NULL;
+        known = false;
+    }
+    if (known && event->len > 0)
+        snprintf(path, sizeof(path), "%s/%s", watch->paths[event->wd], event->name);
+    unlock(watch);
+    if (!known || event->len == 0) return;
+
+    bool gone = event->mask & (IN_DELETE | IN_MOVED_FROM);
+    if (!(event->mask & IN_ISDIR))
+        callback(user, gone ? VGM_WATCH_REMOVED : VGM_WATCH_CHANGED, path);
+    else if (gone)
+        callback(user, VGM_WATCH_REMOVED, path);
+    else if (event->mask & (IN_CREATE | IN_MOVED_TO))
+        callback(user, VGM_WATCH_DIRECTORY, path);
+}
+
+int vgm_watch_read(struct vgm_watch* watch, int timeout_ms, vgm_watch_callback callback, void* user)
+{
+    struct pollfd fd = { watch->fd, POLLIN, 0 };
+    int ready = poll(&fd, 1, timeout_ms);
+    if (ready <= 0) return ready == 0 || errno == EINTR ? 0 : -1;
+
+    // everything queued is read at once, so a burst ends up in one batch
+    char buffer[64 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int count = 0;
+    while (true)
+    {
+        ssize_t size = read(watch->fd, buffer, sizeof(buffer));
+        if (size <= 0)
+        {
+            if (size == -1 && errno == EINTR) continue;
+            if (size == -1 && errno != EAGAIN) return -1;
+            break;
+        }
+        for (ssize_t offset = 0; offset < size;)
+        {
+            const struct inotify_event* event = (const struct inotify_event*)(buffer + offset);
+            report_event(watch, event, callback, user);
+            offset += sizeof(struct inotify_event) + event->len;
+            count++;
+        }
+    }
+    return count;
+}
+
+void vgm_watch_destroy(struct vgm_watch* watch)
+{
+    if (!watch) return;
+
+    close(watch->fd);
+    for (size_t i = 0; i < watch->capacity; ++i)
+    {
+        free(watch->paths[i]);
+    }
+    free(watch->paths);
+#if defined(VGM_THREADS)
+    pthread_mutex_destroy(&watch->lock);
+#endif
+    free(watch);
+}
+
+#else
+
+struct vgm_watch* vgm_watch_create(void)
+{
+    return NULL;
+}
+
+bool vgm_watch_add(struct vgm_watch* watch, const char* path)
+{
+    (void)watch;
+    (void)path;
+    return false;
+}
+
+int vgm_watch_read(struct vgm_watch* watch, int timeout_ms, vgm_watch_callback callback, void* user)
+{
+    (void)watch;
+    (void)timeout_ms;
+    (void)callback;
+    (void)user;
+    return -1;
+}
+
+void vgm_watch_destroy(struct vgm_watch* watch)
+{
+    (void)watch;
+}
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef _VGMWATCH_H_
+#define _VGMWATCH_H_
+
+#include <stdbool.h>
+
+// Changes under a tree of directories, reported by inotify on Linux. Elsewhere no watch can be
+// created and callers fall back to comparing modification times.
+enum vgm_watch_event
+{
+    VGM_WATCH_CHANGED,      // a file was created, written to or moved in
+    VGM_WATCH_REMOVED,      // a file or directory was deleted or moved out
+    VGM_WATCH_DIRECTORY,    // a directory was created or moved in, it is not watched yet
+    VGM_WATCH_LOST,         // the kernel queue overflowed: anything may have changed, path is NULL
+};
+
+typedef void (*vgm_watch_callback)(void* user, enum vgm_watch_event event, const char* path);
+
+// Directories watched, safe to add to from several threads
+struct vgm_watch;
+
+// NULL where inotify is not available
+struct vgm_watch* vgm_watch_create(void);
+
+// Watch one directory, not its subdirectories. False once no more watches can be added
+// (fs.inotify.max_user_watches); a directory that is already gone is not an error.
+bool vgm_watch_add(struct vgm_watch* watch, const char* path);
+
+// Wait up to timeout_ms (-1 for no limit) and pass the events read to callback with the full path.
+// The number of events, 0 on timeout or when interrupted by a signal, -1 on error.
+int vgm_watch_read(struct vgm_watch* watch, int timeout_ms, vgm_watch_callback callback, void* user);
+
+void vgm_watch_destroy(struct vgm_watch* watch);
+
+#endif // _VGMWATCH_H_
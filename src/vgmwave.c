@@ -0,0 +1,123 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vgmwave.h"
+
+#define DECODE_CHUNK_SIZE 4096  // bytes decoded at a time
+
+// Decoded samples, scaled down to 8 bits
+static void decode(enum vgm_pcm_format format, const uint8_t* data, size_t size, int8_t* levels)
+{
+    struct vgm_pcm_decoder decoder;
+    int16_t samples[DECODE_CHUNK_SIZE * 8];
+    vgm_pcm_decoder_init(&decoder, format);
+    for (size_t offset = 0; offset < size; offset += DECODE_CHUNK_SIZE)
+    {
+        size_t length = size - offset < DECODE_CHUNK_SIZE ? size - offset : DECODE_CHUNK_SIZE;
+        size_t count = vgm_pcm_decode(&decoder, data + offset, length, samples);
+        for (size_t i = 0; i < count; ++i) levels[i] = (int8_t)(samples[i] >> 8);
+        levels += count;
+    }
+}
+
+// Reduce count entries of a level (min/max pairs, or single samples when pairs is false) into the next one
+static void reduce(const int8_t* from, size_t count, bool pairs, int8_t* to)
+{
+    for (size_t i = 0; i < count; i += VGM_WAVE_FANOUT)
+    {
+        size_t end = count - i < VGM_WAVE_FANOUT ? count : i + VGM_WAVE_FANOUT;
+        int8_t min = INT8_MAX, max = INT8_MIN;
+        for (size_t j = i; j < end; ++j)
+        {
+            int8_t low = pairs ? from[2 * j] : from[j];
+            int8_t high = pairs ? from[2 * j + 1] : from[j];
+            if (low < min) min = low;
+            if (high > max) max = high;
+        }
+        *to++ = min;
+        *to++ = max;
+    }
+}
+
+bool vgm_wave_build(struct vgm_wave* wave, uint8_t type, const uint8_t* data, size_t size)
+{
+    memset(wave, 0, sizeof(*wave));
+    wave->format = vgm_pcm_get_format(type);
+    if (wave->format == VGM_PCM_NONE) wave->format = VGM_PCM_U8;
+    wave->sample_count = vgm_pcm_get_sample_count(wave->format, size);
+    if (wave->sample_count == 0) return true;
+
+    // the levels go up to a single pair, all in one allocation after the samples
+    size_t total = wave->sample_count;
+    size_t count = wave->sample_count;
+    while (count > 1 && wave->level_count < VGM_WAVE_MAX_LEVELS)
+    {
+        count = (count + VGM_WAVE_FANOUT - 1) / VGM_WAVE_FANOUT;
+        wave->level_size[wave->level_count++] = count;
+        total += 2 * count;
+    }
+    if (!(wave->samples = (int8_t*)malloc(total)))
+    {
+        wave->sample_count = 0;
+        return false;
+    }
+
+    decode(wave->format, data, size, wave->samples);
+    int8_t* level = wave->samples + wave->sample_count;
+    for (int i = 0; i < wave->level_count; ++i)
+    {
+        wave->levels[i] = level;
+        if (i == 0)
+            reduce(wave->samples, wave->sample_count, false, level);
+        else
+            reduce(wave->levels[i - 1], wave->level_size[i - 1], true, level);
+        level += 2 * wave->level_size[i];
+    }
+    return true;
+}
+
+void vgm_wave_free(struct vgm_wave* wave)
+{
+    free(wave->samples);
+    memset(wave, 0, sizeof(*wave));
+}
+
+bool vgm_wave_get_range(const struct vgm_wave* wave, double first, double last, int8_t* min, int8_t* max)
+{
+    if (first < 0) first = 0;
+    if (last > (double)wave->sample_count) last = (double)wave->sample_count;
+    if (first >= last) return false;
+
+    // highest level whose entries are no wider than the range: at most VGM_WAVE_FANOUT + 1 of them
+    int level = 0;
+    double width = 1;
+    while (level < wave->level_count && width * VGM_WAVE_FANOUT <= last - first)
+    {
+        width *= VGM_WAVE_FANOUT;
+        level++;
+    }
+
+    size_t begin = (size_t)(first / width);
+    size_t end = (size_t)ceil(last / width);
+    *min = INT8_MAX;
+    *max = INT8_MIN;
+    if (level == 0)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            if (wave->samples[i] < *min) *min = wave->samples[i];
+            if (wave->samples[i] > *max) *max = wave->samples[i];
+        }
+        return true;
+    }
+
+    const int8_t* pairs = wave->levels[level - 1];
+    if (end > wave->level_size[level - 1]) end = wave->level_size[level - 1];
+    for (size_t i = begin; i < end; ++i)
+    {
+        if (pairs[2 * i] < *min) *min = pairs[2 * i];
+        if (pairs[2 * i + 1] > *max) *max = pairs[2 * i + 1];
+    }
+    return true;
+}
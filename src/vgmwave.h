@@ -0,0 +1,36 @@
+#ifndef _VGMWAVE_H_
+#define _VGMWAVE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vgmpcm.h"
+
+// Waveform preview of a data block. The block is decoded once into 8-bit levels, then
+// reduced into a min/max pyramid: level n holds the smallest and largest level of every
+// VGM_WAVE_FANOUT^n samples. Drawing a column reads a few entries of the level that fits
+// its width, so a redraw costs the same at any zoom, whatever the size of the block.
+#define VGM_WAVE_FANOUT     4
+#define VGM_WAVE_MAX_LEVELS 24
+
+struct vgm_wave
+{
+    enum vgm_pcm_format format; // blocks holding no known audio are shown as unsigned bytes
+    size_t sample_count;
+    int8_t* samples;        // one level per sample, also the base of the single allocation
+    int level_count;        // pyramid levels above the samples
+    int8_t* levels[VGM_WAVE_MAX_LEVELS];    // min/max pairs, level n covers VGM_WAVE_FANOUT^(n+1) samples each
+    size_t level_size[VGM_WAVE_MAX_LEVELS]; // pairs
+};
+
+// Decode block data of the given type and build its pyramid, false if out of memory
+bool vgm_wave_build(struct vgm_wave* wave, uint8_t type, const uint8_t* data, size_t size);
+
+void vgm_wave_free(struct vgm_wave* wave);
+
+// Smallest and largest level of samples first to last (fractional positions, last excluded),
+// widened to whole entries of the level that fits the range. False if no sample is in the range.
+bool vgm_wave_get_range(const struct vgm_wave* wave, double first, double last, int8_t* min, int8_t* max);
+
+#endif // _VGMWAVE_H_
@@ -0,0 +1,407 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(VGM_THREADS)
+    #include <pthread.h>
+#endif
+
+#include "vgmpack.h"
+#include "vgmwriter.h"
+
+enum vgm_write_op_type
+{
+    WRITE_OPEN,
+    WRITE_DATA,
+    WRITE_HOLE,
+    WRITE_CLOSE,
+    WRITE_DISCARD,
+    WRITE_RENAME,
+    WRITE_PACK,
+};
+
+struct vgm_output
+{
+    FILE* file;
+    char* filename;
+    uint64_t written;
+};
+
+struct vgm_write_op
+{
+    enum vgm_write_op_type type;
+    struct vgm_output* output;
+    const uint8_t* data;
+    size_t size;
+    bool owned;     // data is a copy freed after writing
+    char* from;     // WRITE_RENAME
+    char* to;       // WRITE_CLOSE (store name, may be NULL) and WRITE_RENAME
+    struct vgm_pack* pack;  // WRITE_PACK: data goes to offset in the pack
+    uint64_t offset;
+};
+
+struct vgm_writer
+{
+    struct vgm_write_op ops[VGM_WRITER_QUEUE_SIZE];
+    size_t head;
+    size_t count;
+    size_t buffered;    // bytes of copied data in the queue
+    bool running;       // an operation taken from the queue is being done
+    bool failed;
+    char error[256];
+    uint64_t reused;    // bytes of closed files that were in the store already
+#if defined(VGM_THREADS)
+    bool threaded;      // false if the thread could not be started
+    bool stop;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t done;
+#endif
+};
+
+static void lock(struct vgm_writer* writer)
+{
+#if defined(VGM_THREADS)
+    if (writer->threaded) pthread_mutex_lock(&writer->lock);
+#endif
+}
+
+static void unlock(struct vgm_writer* writer)
+{
+#if defined(VGM_THREADS)
+    if (writer->threaded) pthread_mutex_unlock(&writer->lock);
+#endif
+}
+
+// Keep the first error, later ones are usually consequences of it
+static void fail(struct vgm_writer* writer, const char* fmt, ...)
+{
+    lock(writer);
+    if (!writer->failed)
+    {
+        va_list ap;
+        va_start(ap, fmt);
+        vsnprintf(writer->error, sizeof(writer->error), fmt, ap);
+        va_end(ap);
+        writer->failed = true;
+    }
+    unlock(writer);
+}
+
+static bool file_exists(const char* filename)
+{
+    FILE* file = fopen(filename, "rb");
+    if (file) fclose(file);
+    return file != NULL;
+}
+
+static void free_output(struct vgm_output* output)
+{
+    free(output->filename);
+    free(output);
+}
+
+// Move a closed file into the store, unless another file brought the same contents first
+static void store_file(struct vgm_writer* writer, struct vgm_output* output, const char* store_name)
+{
+    if (file_exists(store_name))
+    {
+        remove(output->filename);
+        lock(writer);
+        writer->reused += output->written;
+        unlock(writer);
+    }
+    else if (rename(output->filename, store_name) != 0)
+    {
+        fail(writer, "Error renaming \"%s\" to \"%s\"\n", output->filename, store_name);
+        remove(output->filename);
+    }
+}
+
+static void execute(struct vgm_writer* writer, struct vgm_write_op* op)
+{
+    struct vgm_output* output = op->output;
+
+    switch (op->type)
+    {
+    case WRITE_OPEN:
+        if (!(output->file = fopen(output->filename, "wb")))
+            fail(writer, "Error opening file \"%s\"\n", output->filename);
+        break;
+
+    case WRITE_DATA:
+        if (output->file && fwrite(op->data, 1, op->size, output->file) != op->size)
+        {
+            fail(writer, "Error writing raw sample: out of space?\n");
+            fclose(output->file);
+            output->file = NULL;
+        }
+        output->written += op->size;
+        if (op->owned) free((void*)op->data);
+        break;
+
+    case WRITE_HOLE:
+        // seeking past the end leaves a hole, the last byte sets the file size
+        if (output->file &&
+            (fseek(output->file, (long)(op->size - 1), SEEK_CUR) != 0 || fputc(0, output->file) == EOF))
+        {
+            fail(writer, "Error writing raw sample: out of space?\n");
+            fclose(output->file);
+            output->file = NULL;
+        }
+        output->written += op->size;
+        break;
+
+    case WRITE_CLOSE:
+    {
+        bool closed = output->file && fclose(output->file) == 0;
+        if (output->file && !closed)
+            fail(writer, "Error writing raw sample: out of space?\n");
+        if (closed && op->to)
+            store_file(writer, output, op->to);
+        else if (op->to)
+            remove(output->filename);
+        free(op->to);
+        free_output(output);
+        break;
+    }
+
+    case WRITE_DISCARD:
+        if (output->file)
+        {
+            fclose(output->file);
+            remove(output->filename);
+        }
+        free_output(output);
+        break;
+
+    case WRITE_RENAME:
+        if (rename(op->from, op->to) != 0)
+            fail(writer, "Error renaming \"%s\" to \"%s\"\n", op->from, op->to);
+        free(op->from);
+        free(op->to);
+        break;
+
+    case WRITE_PACK:
+        if (!vgm_pack_write(op->pack, op->offset, op->data, op->size))
+            fail(writer, "Error writing pack file: out of space?\n");
+        if (op->owned) free((void*)op->data);
+        break;
+    }
+}
+
+#if defined(VGM_THREADS)
+static void* writer_thread(void* arg)
+{
+    struct vgm_writer* writer = (struct vgm_writer*)arg;
+
+    pthread_mutex_lock(&writer->lock);
+    for (;;)
+    {
+        while (writer->count == 0 && !writer->stop)
+            pthread_cond_wait(&writer->work, &writer->lock);
+        if (writer->count == 0) break;
+
+        struct vgm_write_op op = writer->ops[writer->head];
+        writer->head = (writer->head + 1) % VGM_WRITER_QUEUE_SIZE;
+        writer->count--;
+        writer->running = true;
+        pthread_mutex_unlock(&writer->lock);
+
+        execute(writer, &op);
+
+        pthread_mutex_lock(&writer->lock);
+        if (op.owned) writer->buffered -= op.size;
+        writer->running = false;
+        pthread_cond_broadcast(&writer->done);
+    }
+    pthread_mutex_unlock(&writer->lock);
+    return NULL;
+}
+#endif
+
+// Queue an operation, or do it now without a thread
+static bool submit(struct vgm_writer* writer, struct vgm_write_op* op)
+{
+#if defined(VGM_THREADS)
+    if (writer->threaded)
+    {
+        pthread_mutex_lock(&writer->lock);
+        // a copy larger than the limit still gets through once the queue holds no other copy
+        while (writer->count == VGM_WRITER_QUEUE_SIZE ||
+            (op->owned && writer->buffered > 0 && writer->buffered + op->size > VGM_WRITER_MAX_BUFFERED))
+            pthread_cond_wait(&writer->done, &writer->lock);
+
+        writer->ops[(writer->head + writer->count) % VGM_WRITER_QUEUE_SIZE] = *op;
+        writer->count++;
+        if (op->owned) writer->buffered += op->size;
+        bool result = !writer->failed;
+        pthread_cond_signal(&writer->work);
+        pthread_mutex_unlock(&writer->lock);
+        return result;
+    }
+#endif
+    execute(writer, op);
+    return !writer->failed;
+}
+
+struct vgm_writer* vgm_writer_create(void)
+{
+    struct vgm_writer* writer = (struct vgm_writer*)calloc(1, sizeof(struct vgm_writer));
+    if (!writer) return NULL;
+
+#if defined(VGM_THREADS)
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->work, NULL);
+    pthread_cond_init(&writer->done, NULL);
+    writer->threaded = pthread_create(&writer->thread, NULL, writer_thread, writer) == 0;
+#endif
+    return writer;
+}
+
+void vgm_writer_destroy(struct vgm_writer* writer)
+{
+    if (!writer) return;
+
+#if defined(VGM_THREADS)
+    if (writer->threaded)
+    {
+        pthread_mutex_lock(&writer->lock);
+        writer->stop = true;
+        pthread_cond_signal(&writer->work);
+        pthread_mutex_unlock(&writer->lock);
+        pthread_join(writer->thread, NULL);
+    }
+    pthread_cond_destroy(&writer->done);
+    pthread_cond_destroy(&writer->work);
+    pthread_mutex_destroy(&writer->lock);
+#endif
+    free(writer);
+}
+
+struct vgm_output* vgm_writer_open(struct vgm_writer* writer, const char* filename)
+{
+    struct vgm_output* output = (struct vgm_output*)calloc(1, sizeof(struct vgm_output));
+    if (!output || !(output->filename = strdup(filename)))
+    {
+        free(output);
+        fail(writer, "Memory allocation failed\n");
+        return NULL;
+    }
+
+    struct vgm_write_op op = { .type = WRITE_OPEN, .output = output };
+    if (!submit(writer, &op))
+    {
+        vgm_writer_discard(writer, output);
+        return NULL;
+    }
+    return output;
+}
+
+// Queue data for a file or a pack
+static bool submit_data(struct vgm_writer* writer, struct vgm_write_op* op, bool copy)
+{
+#if defined(VGM_THREADS)
+    // the caller may reuse its buffer as soon as this returns
+    if (copy && writer->threaded)
+    {
+        uint8_t* buffer = (uint8_t*)malloc(op->size);
+        if (!buffer)
+        {
+            fail(writer, "Memory allocation failed\n");
+            return false;
+        }
+        memcpy(buffer, op->data, op->size);
+        op->data = buffer;
+        op->owned = true;
+    }
+#else
+    (void)copy;
+#endif
+    return submit(writer, op);
+}
+
+bool vgm_writer_write(struct vgm_writer* writer, struct vgm_output* output, const uint8_t* data, size_t size,
+    bool copy)
+{
+    struct vgm_write_op op = { .type = WRITE_DATA, .output = output, .data = data, .size = size };
+    return submit_data(writer, &op, copy);
+}
+
+bool vgm_writer_skip(struct vgm_writer* writer, struct vgm_output* output, size_t size)
+{
+    if (size == 0) return true;
+    struct vgm_write_op op = { .type = WRITE_HOLE, .output = output, .size = size };
+    return submit(writer, &op);
+}
+
+bool vgm_writer_write_pack(struct vgm_writer* writer, struct vgm_pack* pack, uint64_t offset, const uint8_t* data,
+    size_t size, bool copy)
+{
+    struct vgm_write_op op = { .type = WRITE_PACK, .data = data, .size = size, .pack = pack, .offset = offset };
+    return submit_data(writer, &op, copy);
+}
+
+bool vgm_writer_close(struct vgm_writer* writer, struct vgm_output* output, const char* store_name)
+{
+    struct vgm_write_op op = { .type = WRITE_CLOSE, .output = output };
+    if (store_name && !(op.to = strdup(store_name)))
+    {
+        fail(writer, "Memory allocation failed\n");
+        vgm_writer_discard(writer, output);
+        return false;
+    }
+    return submit(writer, &op);
+}
+
+void vgm_writer_discard(struct vgm_writer* writer, struct vgm_output* output)
+{
+    struct vgm_write_op op = { .type = WRITE_DISCARD, .output = output };
+    submit(writer, &op);
+}
+
+bool vgm_writer_rename(struct vgm_writer* writer, const char* from, const char* to)
+{
+    struct vgm_write_op op = { .type = WRITE_RENAME, .from = strdup(from), .to = strdup(to) };
+    if (!op.from || !op.to)
+    {
+        free(op.from);
+        free(op.to);
+        fail(writer, "Memory allocation failed\n");
+        return false;
+    }
+    return submit(writer, &op);
+}
+
+bool vgm_writer_sync(struct vgm_writer* writer, char* error, size_t error_size, uint64_t* reused)
+{
+    lock(writer);
+#if defined(VGM_THREADS)
+    while (writer->threaded && (writer->count > 0 || writer->running))
+        pthread_cond_wait(&writer->done, &writer->lock);
+#endif
+    bool result = !writer->failed;
+    if (writer->failed && error_size > 0)
+        snprintf(error, error_size, "%s", writer->error);
+    writer->failed = false;
+    writer->error[0] = '\0';
+    *reused += writer->reused;
+    writer->reused = 0;
+    unlock(writer);
+    return result;
+}
+
+bool vgm_writer_busy(struct vgm_writer* writer)
+{
+    bool result = false;
+#if defined(VGM_THREADS)
+    lock(writer);
+    result = writer->count > 0 || writer->running;
+    unlock(writer);
+#else
+    (void)writer;
+#endif
+    return result;
+}
@@ -0,0 +1,53 @@
+#ifndef _VGMWRITER_H_
+#define _VGMWRITER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define VGM_WRITER_QUEUE_SIZE   1024                // operations waiting for the writer thread
+#define VGM_WRITER_MAX_BUFFERED (32 * 1024 * 1024)  // bytes of copied data waiting
+
+// File operations done in order by a background thread (VGM_THREADS), or right away
+// by the caller otherwise. Callers block while the queue is full.
+struct vgm_writer;
+
+// File being written through a writer, released by vgm_writer_close() or vgm_writer_discard()
+struct vgm_output;
+
+struct vgm_pack;
+
+struct vgm_writer* vgm_writer_create(void);
+
+// Finish all queued operations and stop the thread
+void vgm_writer_destroy(struct vgm_writer* writer);
+
+// The functions below return NULL/false once an operation failed, vgm_writer_sync() tells why
+struct vgm_output* vgm_writer_open(struct vgm_writer* writer, const char* filename);
+
+// Unless copy is set, data must stay valid until the writer is synced
+bool vgm_writer_write(struct vgm_writer* writer, struct vgm_output* output, const uint8_t* data, size_t size,
+    bool copy);
+
+// Leave size zero bytes in a file as a hole where the file system supports it
+bool vgm_writer_skip(struct vgm_writer* writer, struct vgm_output* output, size_t size);
+
+// Write data at offset into a pack file, see vgm_pack_reserve()
+bool vgm_writer_write_pack(struct vgm_writer* writer, struct vgm_pack* pack, uint64_t offset, const uint8_t* data,
+    size_t size, bool copy);
+
+// With store_name, the file is renamed to it, or deleted if store_name exists already
+bool vgm_writer_close(struct vgm_writer* writer, struct vgm_output* output, const char* store_name);
+
+// Close and delete an unfinished file
+void vgm_writer_discard(struct vgm_writer* writer, struct vgm_output* output);
+
+bool vgm_writer_rename(struct vgm_writer* writer, const char* from, const char* to);
+
+// Wait for the queued operations, then take the first error and the bytes found in the store
+bool vgm_writer_sync(struct vgm_writer* writer, char* error, size_t error_size, uint64_t* reused);
+
+// Operations still queued or running
+bool vgm_writer_busy(struct vgm_writer* writer);
+
+#endif // _VGMWRITER_H_
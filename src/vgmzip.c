@@ -0,0 +1,352 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#include "vgmzip.h"
+
+#define ZIP_LOCAL_SIGNATURE     0x04034b50
+#define ZIP_CENTRAL_SIGNATURE   0x02014b50
+#define ZIP_END_SIGNATURE       0x06054b50
+#define ZIP64_END_SIGNATURE     0x06064b50
+#define ZIP64_LOCATOR_SIGNATURE 0x07064b50
+#define ZIP64_EXTRA_ID          0x0001
+
+#define ZIP_LOCAL_SIZE          30
+#define ZIP_CENTRAL_SIZE        46
+#define ZIP_END_SIZE            22
+#define ZIP64_END_SIZE          56
+#define ZIP64_LOCATOR_SIZE      20
+
+// Stored entries are passed on in pieces, so the CRC is taken over what was just read
+#define ZIP_STORED_CHUNK        (64 * 1024)
+
+// Fields of the archive are little-endian and not aligned
+static uint16_t read_u16(const uint8_t* p)
+{
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static uint32_t read_u32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint64_t read_u64(const uint8_t* p)
+{
+    return (uint64_t)read_u32(p) | (uint64_t)read_u32(p + 4) << 32;
+}
+
+// Offset, size and entry count of the central directory, from the end record or its ZIP64 version
+static bool find_directory(const struct vgm_zip* zip, uint64_t* offset, uint64_t* size, uint64_t* count)
+{
+    // the end record is followed by a comment of up to 64 KiB
+    size_t lowest = zip->size > ZIP_END_SIZE + 0xffff ? zip->size - ZIP_END_SIZE - 0xffff : 0;
+    size_t pos = zip->size - ZIP_END_SIZE;
+    while (read_u32(zip->base + pos) != ZIP_END_SIGNATURE ||
+        pos + ZIP_END_SIZE + read_u16(zip->base + pos + 20) > zip->size)
+    {
+        if (pos == lowest) return false;
+        pos--;
+    }
+
+    const uint8_t* end = zip->base + pos;
+    *count = read_u16(end + 10);
+    *size = read_u32(end + 12);
+    *offset = read_u32(end + 16);
+    if (*count == 0xffff || *size == 0xffffffff || *offset == 0xffffffff)
+    {
+        const uint8_t* locator = end - ZIP64_LOCATOR_SIZE;
+        if (pos < ZIP64_LOCATOR_SIZE || read_u32(locator) != ZIP64_LOCATOR_SIGNATURE) return false;
+        uint64_t end64 = read_u64(locator + 8);
+        if (zip->size < ZIP64_END_SIZE || end64 > zip->size - ZIP64_END_SIZE ||
+            read_u32(zip->base + end64) != ZIP64_END_SIGNATURE)
+            return false;
+        *count = read_u64(zip->base + end64 + 32);
+        *size = read_u64(zip->base + end64 + 40);
+        *offset = read_u64(zip->base + end64 + 48);
+    }
+    return *offset <= zip->size && *size <= zip->size - *offset && *count <= *size / ZIP_CENTRAL_SIZE;
+}
+
+// Sizes and offset too large for the central directory record are in the ZIP64 extra field,
+// in this order and only those that are
+static bool read_zip64_extra(struct vgm_zip_entry* entry, const uint8_t* extra, size_t size)
+{
+    while (size >= 4)
+    {
+        uint16_t id = read_u16(extra), length = read_u16(extra + 2);
+        if (length > size - 4) return false;
+        if (id == ZIP64_EXTRA_ID)
+        {
+            uint64_t* fields[] = { &entry->size, &entry->compressed_size, &entry->offset };
+            const uint8_t* p = extra + 4;
+            for (int i = 0; i < 3; ++i)
+            {
+                if (*fields[i] != 0xffffffff) continue;
+                if (p + 8 > extra + 4 + length) return false;
+                *fields[i] = read_u64(p);
+                p += 8;
+            }
+            return true;
+        }
+        extra += 4 + length;
+        size -= 4 + length;
+    }
+    return true;
+}
+
+static int compare_entries(const void* a, const void* b)
+{
+    return strcmp(((const struct vgm_zip_entry*)a)->name, ((const struct vgm_zip_entry*)b)->name);
+}
+
+static bool read_directory(struct vgm_zip* zip)
+{
+    uint64_t offset, size, count;
+    if (!find_directory(zip, &offset, &size, &count)) return false;
+
+    // every name and its NUL fit in the records they come from
+    zip->entries = (struct vgm_zip_entry*)malloc((count ? count : 1) * sizeof(struct vgm_zip_entry));
+    zip->names = (char*)malloc(size ? size : 1);
+    if (!zip->entries || !zip->names) return false;
+
+    const uint8_t* p = zip->base + offset;
+    const uint8_t* end = p + size;
+    size_t names_size = 0;
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        if (end - p < ZIP_CENTRAL_SIZE || read_u32(p) != ZIP_CENTRAL_SIGNATURE) return false;
+        size_t name_length = read_u16(p + 28), extra_length = read_u16(p + 30), comment_length = read_u16(p + 32);
+        size_t record_size = ZIP_CENTRAL_SIZE + name_length + extra_length + comment_length;
+        if ((size_t)(end - p) < record_size) return false;
+
+        struct vgm_zip_entry* entry = &zip->entries[zip->count];
+        entry->flags = read_u16(p + 8);
+        entry->method = read_u16(p + 10);
+        entry->mtime = (int64_t)read_u16(p + 14) << 16 | read_u16(p + 12);
+        entry->crc = read_u32(p + 16);
+        entry->compressed_size = read_u32(p + 20);
+        entry->size = read_u32(p + 24);
+        entry->offset = read_u32(p + 42);
+        if (!read_zip64_extra(entry, p + ZIP_CENTRAL_SIZE + name_length, extra_length)) return false;
+
+        // directories have no data
+        const char* name = (const char*)p + ZIP_CENTRAL_SIZE;
+        if (name_length > 0 && name[name_length - 1] != '/' && !memchr(name, '\0', name_length))
+        {
+            memcpy(zip->names + names_size, name, name_length);
+            zip->names[names_size + name_length] = '\0';
+            entry->name = zip->names + names_size;
+            names_size += name_length + 1;
+            zip->count++;
+        }
+        p += record_size;
+    }
+
+    if (zip->count > 1) qsort(zip->entries, zip->count, sizeof(struct vgm_zip_entry), compare_entries);
+    return true;
+}
+
+bool vgm_zip_open(struct vgm_zip* zip, const char* filename)
+{
+    memset(zip, 0, sizeof(*zip));
+
+#if !defined(_WIN32)
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) return false;
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size < ZIP_END_SIZE)
+    {
+        close(fd);
+        return false;
+    }
+    zip->base = (uint8_t*)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (zip->base == MAP_FAILED)
+    {
+        zip->base = NULL;
+        return false;
+    }
+    zip->size = st.st_size;
+    zip->mapped = true;
+#else
+    FILE* file = fopen(filename, "rb");
+    if (!file) return false;
+    _fseeki64(file, 0, SEEK_END);
+    zip->size = _ftelli64(file);
+    _fseeki64(file, 0, SEEK_SET);
+    if (zip->size < ZIP_END_SIZE || !(zip->base = (uint8_t*)malloc(zip->size)) ||
+        fread(zip->base, 1, zip->size, file) != zip->size)
+    {
+        fclose(file);
+        vgm_zip_close(zip);
+        return false;
+    }
+    fclose(file);
+#endif
+
+    if (!read_directory(zip))
+    {
+        vgm_zip_close(zip);
+        return false;
+    }
+    return true;
+}
+
+size_t vgm_zip_find(const struct vgm_zip* zip, const char* name)
+{
+    size_t low = 0, high = zip->count;
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        if (strcmp(zip->entries[middle].name, name) < 0)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low < zip->count && strcmp(zip->entries[low].name, name) == 0 ? low : SIZE_MAX;
+}
+
+void vgm_zip_close(struct vgm_zip* zip)
+{
+#if !defined(_WIN32)
+    if (zip->mapped && zip->base)
+        munmap(zip->base, zip->size);
+    else
+#endif
+        free(zip->base);
+    free(zip->entries);
+    free(zip->names);
+    memset(zip, 0, sizeof(*zip));
+}
+
+// Next bytes of the entry as stored in the archive, false at its end or on an error
+static bool fill_entry(struct vgm_zip_reader* reader)
+{
+    const struct vgm_zip_entry* entry = reader->entry;
+    while (reader->avail == 0 && !reader->zip_end && !reader->failed)
+    {
+        uint64_t left = entry->compressed_size - reader->in;
+        if (entry->method == VGM_ZIP_STORED)
+        {
+            // straight from the mapped archive, nothing is copied
+            reader->next = reader->data + reader->in;
+            reader->avail = left < ZIP_STORED_CHUNK ? (size_t)left : ZIP_STORED_CHUNK;
+            reader->in += reader->avail;
+            reader->zip_end = reader->in == entry->compressed_size;
+        }
+        else
+        {
+            uInt length = left < UINT32_MAX ? (uInt)left : UINT32_MAX;
+            reader->zip.next_in = (Bytef*)(reader->data + reader->in);
+            reader->zip.avail_in = length;
+            reader->zip.next_out = reader->buffer;
+            reader->zip.avail_out = sizeof(reader->buffer);
+            int ret = inflate(&reader->zip, Z_NO_FLUSH);
+            reader->in += length - reader->zip.avail_in;
+            reader->next = reader->buffer;
+            reader->avail = sizeof(reader->buffer) - reader->zip.avail_out;
+            if (ret == Z_STREAM_END)
+                reader->zip_end = true;
+            else if ((ret != Z_OK && ret != Z_BUF_ERROR) || (reader->avail == 0 && reader->in == entry->compressed_size))
+                reader->failed = true; // damaged, or truncated
+        }
+
+        reader->crc = crc32(reader->crc, reader->next, (uInt)reader->avail);
+        reader->inflated += reader->avail;
+        if (reader->zip_end && (reader->inflated != entry->size || reader->crc != entry->crc))
+            reader->failed = true;
+        if (reader->failed) reader->avail = 0;
+    }
+    return reader->avail > 0;
+}
+
+bool vgm_zip_reader_open(struct vgm_zip_reader* reader, const struct vgm_zip* zip, size_t index)
+{
+    memset(reader, 0, sizeof(*reader));
+    if (index >= zip->count) return false;
+
+    // the lengths of the name and extra field in the local header may differ from the central directory
+    const struct vgm_zip_entry* entry = &zip->entries[index];
+    if ((entry->flags & 1) || (entry->method != VGM_ZIP_STORED && entry->method != VGM_ZIP_DEFLATED) ||
+        (entry->method == VGM_ZIP_STORED && entry->compressed_size != entry->size) ||
+        entry->offset > zip->size - ZIP_LOCAL_SIZE || read_u32(zip->base + entry->offset) != ZIP_LOCAL_SIGNATURE)
+        return false;
+    const uint8_t* local = zip->base + entry->offset;
+    uint64_t start = entry->offset + ZIP_LOCAL_SIZE + read_u16(local + 26) + read_u16(local + 28);
+    if (start > zip->size || entry->compressed_size > zip->size - start) return false;
+
+    reader->entry = entry;
+    reader->data = zip->base + start;
+    reader->crc = crc32(0, Z_NULL, 0);
+    if (entry->method == VGM_ZIP_DEFLATED && inflateInit2(&reader->zip, -15) != Z_OK) return false;
+
+    // gzread() passes data without the gzip magic through unchanged
+    fill_entry(reader);
+    reader->plain = reader->avail < 2 || reader->next[0] != 0x1f || reader->next[1] != 0x8b;
+    if (!reader->plain && inflateInit2(&reader->gz, 15 + 16) != Z_OK)
+    {
+        if (entry->method == VGM_ZIP_DEFLATED) inflateEnd(&reader->zip);
+        return false;
+    }
+    return true;
+}
+
+int vgm_zip_reader_read(struct vgm_zip_reader* reader, uint8_t* data, size_t size)
+{
+    size_t length = 0;
+    while (length < size && !reader->end && fill_entry(reader))
+    {
+        if (reader->plain)
+        {
+            size_t chunk = size - length < reader->avail ? size - length : reader->avail;
+            memcpy(data + length, reader->next, chunk);
+            reader->next += chunk;
+            reader->avail -= chunk;
+            length += chunk;
+            continue;
+        }
+
+        reader->gz.next_in = (Bytef*)reader->next;
+        reader->gz.avail_in = (uInt)reader->avail;
+        reader->gz.next_out = data + length;
+        reader->gz.avail_out = (uInt)(size - length);
+        int ret = inflate(&reader->gz, Z_NO_FLUSH);
+        length = size - reader->gz.avail_out;
+        reader->next = reader->gz.next_in;
+        reader->avail = reader->gz.avail_in;
+        if (ret == Z_NEED_DICT || ret == Z_DATA_ERROR || ret == Z_MEM_ERROR)
+        {
+            reader->failed = true;
+            break;
+        }
+        if (ret == Z_STREAM_END)
+        {
+            // concatenated members are read on like gzread() does, trailing garbage is not
+            if (fill_entry(reader) && reader->next[0] == 0x1f)
+                inflateReset(&reader->gz);
+            else
+                reader->end = true;
+        }
+    }
+
+    // a gzip stream cut short, what was inflated is returned first like gzread() does
+    if (length < size && !reader->plain && !reader->end) reader->failed = true;
+    reader->out += length;
+    return length > 0 || !reader->failed ? (int)length : -1;
+}
+
+bool vgm_zip_reader_close(struct vgm_zip_reader* reader)
+{
+    if (!reader->entry) return false;
+    if (reader->entry->method == VGM_ZIP_DEFLATED) inflateEnd(&reader->zip);
+    if (!reader->plain) inflateEnd(&reader->gz);
+    return !reader->failed;
+}
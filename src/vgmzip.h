@@ -0,0 +1,74 @@
+#ifndef _VGMZIP_H_
+#define _VGMZIP_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <zlib.h>
+
+// .zip archives read in place, like the vgmrips packs of .vgz files: the central directory is
+// read once, then any entry is inflated straight from the mapped archive. Stored and deflated
+// entries can be read, ZIP64 archives too; encrypted and split archives cannot.
+#define VGM_ZIP_STORED   0
+#define VGM_ZIP_DEFLATED 8
+
+struct vgm_zip_entry
+{
+    const char* name;       // path inside the archive, '/' separated
+    uint64_t offset;        // offset of the local header in the archive
+    uint64_t compressed_size;
+    uint64_t size;
+    int64_t mtime;          // DOS date << 16 | DOS time, as stored
+    uint32_t crc;           // CRC-32 of the uncompressed entry
+    uint16_t method;        // VGM_ZIP_*, entries compressed any other way cannot be read
+    uint16_t flags;         // general purpose flags, bit 0 set for an encrypted entry
+};
+
+// Archive mapped for reading, its entries can be read from several threads at once
+struct vgm_zip
+{
+    uint8_t* base;
+    size_t size;
+    bool mapped;
+    struct vgm_zip_entry* entries;  // sorted by name, directories left out
+    size_t count;
+    char* names;
+};
+
+bool vgm_zip_open(struct vgm_zip* zip, const char* filename);
+
+// Index of the entry with this name, SIZE_MAX if there is none
+size_t vgm_zip_find(const struct vgm_zip* zip, const char* name);
+
+void vgm_zip_close(struct vgm_zip* zip);
+
+// Inflates one entry front to back like gzread(): a .vgz entry goes through both the deflate
+// of the archive and its own gzip layer in memory, any other entry is passed on as stored
+struct vgm_zip_reader
+{
+    const struct vgm_zip_entry* entry;
+    const uint8_t* data;    // compressed entry inside the mapped archive
+    uint64_t in;            // bytes of data consumed
+    uint64_t inflated;      // bytes of the entry inflated, checked against its size and CRC at the end
+    uint32_t crc;
+    uint64_t out;           // bytes read
+    z_stream zip;           // raw deflate of the archive, unless the entry is stored
+    uint8_t buffer[16384];  // entry inflated from the archive
+    const uint8_t* next;    // bytes of the entry not passed on yet, in buffer or in the archive
+    size_t avail;
+    z_stream gz;            // gzip layer of a .vgz entry
+    bool plain;             // not gzip data: passed through like gzread() does
+    bool zip_end;
+    bool end;
+    bool failed;
+};
+
+bool vgm_zip_reader_open(struct vgm_zip_reader* reader, const struct vgm_zip* zip, size_t index);
+
+// Like gzread(): the number of bytes read, 0 at the end of the entry, -1 on error
+int vgm_zip_reader_read(struct vgm_zip_reader* reader, uint8_t* data, size_t size);
+
+// False if the entry turned out damaged or truncated
+bool vgm_zip_reader_close(struct vgm_zip_reader* reader);
+
+#endif // _VGMZIP_H_